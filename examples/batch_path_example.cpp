@@ -0,0 +1,120 @@
+// batch_path_example.cpp
+//
+// Runs every pair of data/sample_pairs.json (or argv[1]) through
+// GraphExtension::findPathsBatch on the roadNet edges loaded by
+// api/load_roadnet_to_mongo.py, once per thread count from 1 up to the
+// number of cores, and reports the throughput of each run.
+//
+// argv[2] picks the algorithm: dijkstra, bidirectional, alt or ch
+// (default: bidirectional).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/uri.hpp>
+#include <bsoncxx/json.hpp>
+#include "mongo/graph_extension.h"
+
+using mongo::graph_extension::BatchOptions;
+using mongo::graph_extension::GraphExtension;
+using mongo::graph_extension::PathAlgorithm;
+
+// Timing helper
+template<typename Func>
+double measure_time(Func func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::string pairsFile = argc > 1 ? argv[1] : "data/sample_pairs.json";
+    std::string algorithmName = argc > 2 ? argv[2] : "bidirectional";
+
+    PathAlgorithm algorithm = PathAlgorithm::kBidirectionalDijkstra;
+    if (algorithmName == "dijkstra") {
+        algorithm = PathAlgorithm::kDijkstra;
+    } else if (algorithmName == "alt") {
+        algorithm = PathAlgorithm::kAlt;
+    } else if (algorithmName == "ch") {
+        algorithm = PathAlgorithm::kContractionHierarchy;
+    } else if (algorithmName != "bidirectional") {
+        std::cerr << "❌ Unknown algorithm " << algorithmName << std::endl;
+        return 1;
+    }
+
+    mongocxx::instance instance{};
+    mongocxx::client client{mongocxx::uri{"mongodb://localhost:27017"}};
+
+    // sample_pairs.json is a top-level array, so wrap it to parse it as BSON
+    std::ifstream in(pairsFile);
+    if (!in) {
+        std::cerr << "❌ Cannot open " << pairsFile << std::endl;
+        return 1;
+    }
+    std::stringstream json;
+    json << "{\"pairs\": " << in.rdbuf() << "}";
+    auto pairsDoc = bsoncxx::from_json(json.str());
+
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (auto&& pair : pairsDoc.view()["pairs"].get_array().value) {
+        auto ends = pair.get_array().value;
+        pairs.emplace_back(
+            std::string(ends[0].get_string().value),
+            std::string(ends[1].get_string().value));
+    }
+    if (pairs.empty()) {
+        std::cout << "⚠️ No pairs to run." << std::endl;
+        return 0;
+    }
+
+    GraphExtension graphExt(client);
+    BatchOptions options;
+
+    // The first batch loads the snapshot and any preprocessing; keep it out
+    // of the timings
+    double warmup_time = measure_time([&]() {
+        graphExt.findPathsBatch("graph", "edges", pairs, algorithm, options,
+            [](size_t, bsoncxx::document::value) {});
+    });
+    std::cout << "✅ Warm-up batch in " << warmup_time << " ms" << std::endl;
+
+    // Powers of two, then every core
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cores);
+
+    double single_thread_rate = 0;
+
+    std::cout << "\nthreads,ms,queries_per_s,speedup,found" << std::endl;
+    for (unsigned threads : threadCounts) {
+        graphExt.setThreadCount(threads);
+
+        size_t found = 0;
+        double batch_time = measure_time([&]() {
+            found = graphExt.findPathsBatch("graph", "edges", pairs, algorithm, options,
+                [](size_t, bsoncxx::document::value) {});
+        });
+
+        double rate = pairs.size() * 1000.0 / batch_time;
+        if (threads == 1) {
+            single_thread_rate = rate;
+        }
+        std::cout << threads << "," << batch_time << "," << rate << ","
+                  << rate / single_thread_rate << "," << found << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+// weighted_bidirectional_benchmark.cpp
+//
+// Compares unidirectional Dijkstra, bidirectional Dijkstra, A* with
+// landmarks (ALT) and contraction hierarchies (CH) on the roadNet edges loaded
+// by api/load_roadnet_to_mongo.py, using the pairs in data/sample_pairs.json.
+//
+// Landmark tables and the hierarchy are cached in data/roadnet.landmarks and
+// data/roadnet.ch (or argv[2] and argv[3]) so the preprocessing only runs on
+// the first invocation.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/uri.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include "mongo/graph_extension.h"
+
+// Timing helper
+template<typename Func>
+double measure_time(Func func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::string pairsFile = argc > 1 ? argv[1] : "data/sample_pairs.json";
+    std::string landmarksFile = argc > 2 ? argv[2] : "data/roadnet.landmarks";
+    std::string hierarchyFile = argc > 3 ? argv[3] : "data/roadnet.ch";
+
+    mongocxx::instance instance{};
+    mongocxx::client client{mongocxx::uri{"mongodb://localhost:27017"}};
+
+    // sample_pairs.json is a top-level array, so wrap it to parse it as BSON
+    std::ifstream in(pairsFile);
+    if (!in) {
+        std::cerr << "❌ Cannot open " << pairsFile << std::endl;
+        return 1;
+    }
+    std::stringstream json;
+    json << "{\"pairs\": " << in.rdbuf() << "}";
+    auto pairsDoc = bsoncxx::from_json(json.str());
+
+    mongo::graph_extension::GraphExtension graphExt(client);
+
+    double load_time = measure_time([&]() {
+        graphExt.loadSnapshot("graph", "edges");
+    });
+    std::cout << "✅ Snapshot loaded in " << load_time << " ms" << std::endl;
+
+    double landmark_time = measure_time([&]() {
+        if (graphExt.loadLandmarks("graph", "edges", landmarksFile)) {
+            std::cout << "✅ Landmarks loaded from " << landmarksFile << std::endl;
+            return;
+        }
+        graphExt.buildLandmarks("graph", "edges");
+        if (!graphExt.saveLandmarks("graph", "edges", landmarksFile)) {
+            std::cerr << "⚠️ Could not write " << landmarksFile << std::endl;
+        }
+    });
+    std::cout << "✅ Landmarks ready in " << landmark_time << " ms" << std::endl;
+
+    double hierarchy_time = measure_time([&]() {
+        if (graphExt.loadContractionHierarchy("graph", "edges", hierarchyFile)) {
+            std::cout << "✅ Hierarchy loaded from " << hierarchyFile << std::endl;
+            return;
+        }
+        auto hierarchy = graphExt.buildContractionHierarchy("graph", "edges");
+        std::cout << "✅ Hierarchy built with " << hierarchy->shortcutCount()
+                  << " shortcuts" << std::endl;
+        if (!graphExt.saveContractionHierarchy("graph", "edges", hierarchyFile)) {
+            std::cerr << "⚠️ Could not write " << hierarchyFile << std::endl;
+        }
+    });
+    std::cout << "✅ Hierarchy ready in " << hierarchy_time << " ms" << std::endl;
+
+    double uni_total = 0;
+    double bidi_total = 0;
+    double alt_total = 0;
+    double ch_total = 0;
+    long long uni_settled = 0;
+    long long bidi_settled = 0;
+    long long alt_settled = 0;
+    long long ch_settled = 0;
+    int queries = 0;
+    int mismatches = 0;
+
+    std::cout << "\nstart,end,dijkstra_ms,bidirectional_ms,alt_ms,ch_ms,"
+              << "dijkstra_settled,bidirectional_settled,alt_settled,ch_settled,cost" << std::endl;
+
+    for (auto&& pair : pairsDoc.view()["pairs"].get_array().value) {
+        auto ends = pair.get_array().value;
+        std::string start_node(ends[0].get_string().value);
+        std::string end_node(ends[1].get_string().value);
+
+        bsoncxx::document::value uni = bsoncxx::builder::stream::document{} << bsoncxx::builder::stream::finalize;
+        bsoncxx::document::value bidi = uni;
+        bsoncxx::document::value alt = uni;
+        bsoncxx::document::value ch = uni;
+
+        double uni_time = measure_time([&]() {
+            uni = graphExt.findWeightedPath(
+                "graph", "edges", start_node, end_node, "from", "to", "weight", 1000);
+        });
+        double bidi_time = measure_time([&]() {
+            bidi = graphExt.findWeightedBidirectionalPath(
+                "graph", "edges", start_node, end_node, "from", "to", "weight", 1000);
+        });
+        double alt_time = measure_time([&]() {
+            alt = graphExt.findWeightedAltPath(
+                "graph", "edges", start_node, end_node, "from", "to", "weight", 1000);
+        });
+        double ch_time = measure_time([&]() {
+            ch = graphExt.findContractionHierarchyPath(
+                "graph", "edges", start_node, end_node, "from", "to", "weight");
+        });
+
+        auto settled = [](const bsoncxx::document::view& view) {
+            return view["settledNodes"] ? view["settledNodes"].get_int32().value : 0;
+        };
+        auto cost = [](const bsoncxx::document::view& view) {
+            return view["totalWeight"] ? view["totalWeight"].get_double().value : -1.0;
+        };
+
+        if (std::abs(cost(uni.view()) - cost(bidi.view())) > 1e-9 ||
+            std::abs(cost(uni.view()) - cost(alt.view())) > 1e-9 ||
+            std::abs(cost(uni.view()) - cost(ch.view())) > 1e-9) {
+            ++mismatches;
+        }
+
+        uni_total += uni_time;
+        bidi_total += bidi_time;
+        alt_total += alt_time;
+        ch_total += ch_time;
+        uni_settled += settled(uni.view());
+        bidi_settled += settled(bidi.view());
+        alt_settled += settled(alt.view());
+        ch_settled += settled(ch.view());
+        ++queries;
+
+        std::cout << start_node << "," << end_node << ","
+                  << uni_time << "," << bidi_time << "," << alt_time << "," << ch_time << ","
+                  << settled(uni.view()) << "," << settled(bidi.view()) << ","
+                  << settled(alt.view()) << "," << settled(ch.view()) << ","
+                  << cost(bidi.view()) << std::endl;
+    }
+
+    if (queries == 0) {
+        std::cout << "⚠️ No pairs to benchmark." << std::endl;
+        return 0;
+    }
+
+    std::cout << "\n=== Performance Comparison ===" << std::endl;
+    std::cout << "Dijkstra:      " << uni_total / queries << " ms/query, "
+              << uni_settled / queries << " settled nodes/query" << std::endl;
+    std::cout << "Bidirectional: " << bidi_total / queries << " ms/query, "
+              << bidi_settled / queries << " settled nodes/query" << std::endl;
+    std::cout << "ALT:           " << alt_total / queries << " ms/query, "
+              << alt_settled / queries << " settled nodes/query" << std::endl;
+    std::cout << "CH:            " << ch_total / queries << " ms/query, "
+              << ch_settled / queries << " settled nodes/query" << std::endl;
+    if (bidi_settled > 0) {
+        std::cout << "Bidirectional settles "
+                  << static_cast<double>(uni_settled) / bidi_settled
+                  << "x fewer nodes." << std::endl;
+    }
+    if (alt_settled > 0) {
+        std::cout << "ALT settles "
+                  << static_cast<double>(uni_settled) / alt_settled
+                  << "x fewer nodes." << std::endl;
+    }
+    if (ch_settled > 0) {
+        std::cout << "CH settles "
+                  << static_cast<double>(uni_settled) / ch_settled
+                  << "x fewer nodes." << std::endl;
+    }
+    if (mismatches > 0) {
+        std::cout << "❌ " << mismatches << " queries returned different costs!" << std::endl;
+        return 1;
+    }
+    std::cout << "✅ All costs match." << std::endl;
+
+    return 0;
+}
@@ -158,8 +158,8 @@ std::string end_node = "N1283";
             "edges",    // Collection
             start_node,
             end_node,
-            "from",
-            "_id",      // Ignored internally
+            "from",     // Edge source field
+            "to",       // Edge target field
             "weight",
             10          // Max depth
         );
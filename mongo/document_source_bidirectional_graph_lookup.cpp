@@ -17,6 +17,7 @@
  #include "mongo/logv2/log.h"
  #include "mongo/db/pipeline/expression.h"
  #include "mongo/db/pipeline/expression_dependencies.h"
+ #include "mongo/db/sorter/sorter.h"
  
  #define MONGO_LOGV2_DEFAULT_COMPONENT ::mongo::logv2::LogComponent::kQuery
  
@@ -31,6 +32,24 @@
  ALLOCATE_DOCUMENT_SOURCE_ID(bidirectionalGraphLookup, DocumentSourceBidirectionalGraphLookup::id);
  
  namespace {
+ // Budget for the $in array of one frontier query, leaving room under the
+ // BSON size limit for the rest of the $match and the pipeline around it
+ constexpr int kMaxFrontierBatchBytes = BSONObjMaxUserSize / 2;
+
+ // Orders spilled runs by their keys
+ class SpillComparator {
+ public:
+     explicit SpillComparator(ValueComparator valueComparator)
+         : _valueComparator(std::move(valueComparator)) {}
+
+     int operator()(const Value& lhs, const Value& rhs) const {
+         return _valueComparator.compare(lhs, rhs);
+     }
+
+ private:
+     ValueComparator _valueComparator;
+ };
+
  NamespaceString parseGraphLookupFromAndResolveNamespace(const BSONElement& elem,
                                                          const DatabaseName& defaultDb) {
      uassert(ErrorCodes::FailedToParse,
@@ -181,11 +200,15 @@
        _additionalFilter(restrictSearchWithMatch),
        _depthField(depthField),
        _maxDepth(maxDepth),
-       _maxMemoryUsageBytes(internalDocumentSourceGraphLookupMaxMemoryBytes.load()),
-       _forwardVisited(pExpCtx->getValueComparator().makeUnorderedValueMap<SearchNode>()),
-       _backwardVisited(pExpCtx->getValueComparator().makeUnorderedValueMap<SearchNode>()),
-       _forwardFrontier(pExpCtx->getValueComparator().makeFlatUnorderedValueSet()),
-       _backwardFrontier(pExpCtx->getValueComparator().makeFlatUnorderedValueSet()) {
+       _forwardVisited(pExpCtx->getValueComparator(), pExpCtx->getCollator()),
+       _backwardVisited(pExpCtx->getValueComparator(), pExpCtx->getCollator()),
+       _forwardFrontier(pExpCtx->getValueComparator().makeFlatUnorderedValueMap<Value>()),
+       _backwardFrontier(pExpCtx->getValueComparator().makeFlatUnorderedValueMap<Value>()),
+       _forwardCache(pExpCtx->getValueComparator(),
+                     internalDocumentSourceLookupCacheSizeBytes.load() / 2),
+       _backwardCache(pExpCtx->getValueComparator(),
+                      internalDocumentSourceLookupCacheSizeBytes.load() / 2),
+       _maxMemoryUsageBytes(internalDocumentSourceGraphLookupMaxMemoryBytes.load()) {
      
      const auto& resolvedNamespace = pExpCtx->getResolvedNamespace(_fromNs);
      _fromExpCtx = pExpCtx->copyForSubPipeline(resolvedNamespace.ns, resolvedNamespace.uuid);
@@ -202,17 +225,12 @@
  }
  
  DocumentSource::GetNextResult DocumentSourceBidirectionalGraphLookup::doGetNext() {
-     if (_executed)
-         return GetNextResult::makeEOF();
- 
+     // One search per input document; pauses and EOF pass straight through
      auto input = pSource->getNext();
-     LOGV2(9999999, "doGetNext() - input received: {state}", "state"_attr = input.getStatus());
-
      if (!input.isAdvanced())
          return input;
  
      _inputDoc = input.releaseDocument();
-     _executed = true;
  
      performBidirectionalSearch();
  
@@ -227,44 +245,47 @@
      
      // Initialize forward search with startWith value
      auto startVal = _startWith->evaluate(_inputDoc, &pExpCtx->variables);
-     LOGV2(9999999, "startWith evaluated to: {val}", "val"_attr = startVal);
+     LOGV2_DEBUG(9746101, 2, "startWith evaluated to: {val}", "val"_attr = startVal);
+     // Start documents have no parent
      if (startVal.isArray()) {
          for (const auto& val : startVal.getArray()) {
-             _forwardFrontier.insert(val);
+             _forwardFrontier.try_emplace(val, Value());
          }
      } else {
-         _forwardFrontier.insert(startVal);
-         LOGV2(9999999, "Inserted into forward frontier: {val}", "val"_attr = startVal);
+         _forwardFrontier.try_emplace(startVal, Value());
+         LOGV2_DEBUG(9746102, 2, "Inserted into forward frontier: {val}", "val"_attr = startVal);
 
      }
      
-     // Initialize backward search with target value
+     // Initialize backward search with target value; documents pointing at
+     // the target keep the target value as their parent
      auto targetVal = _target->evaluate(_inputDoc, &pExpCtx->variables);
-     LOGV2(9999999, "target evaluated to: {val}", "val"_attr = targetVal);
+     LOGV2_DEBUG(9746103, 2, "target evaluated to: {val}", "val"_attr = targetVal);
      if (targetVal.isArray()) {
          for (const auto& val : targetVal.getArray()) {
-             _backwardFrontier.insert(val);
+             _backwardFrontier.try_emplace(val, val);
          }
      } else {
-         _backwardFrontier.insert(targetVal);
+         _backwardFrontier.try_emplace(targetVal, targetVal);
      }
      
      size_t depth = 0;
-     boost::optional<BidirectionalPath> pathFound;
      
-     while (!_forwardFrontier.empty() && !_backwardFrontier.empty() && 
-            (!_maxDepth || depth <= *_maxDepth)) {
+     // Once a side runs dry every document it can reach is visited, and after
+     // a full round the other side has seen every document next to its end,
+     // so the best meeting so far (if any) is the shortest path
+     while (hasFrontier(true) && hasFrontier(false) && (!_maxDepth || depth <= *_maxDepth)) {
          
-         // Check if there's a meeting point
-         boost::optional<Value> pathFound = checkMeetingPoint();
-         if (pathFound) {
-             _results = reconstructPath(*pathFound);
-             return;
-         }
-         
-         // Expand both frontiers
+         // Meetings are recorded as documents are visited; stop expanding as
+         // soon as no deeper level could produce a shorter path
          bool forwardExpanded = expandFrontier(true);
+         if (meetingIsOptimal()) {
+             break;
+         }
          bool backwardExpanded = expandFrontier(false);
+         if (meetingIsOptimal()) {
+             break;
+         }
          
          if (!forwardExpanded && !backwardExpanded) {
              break;  // No more nodes to explore
@@ -274,8 +295,11 @@
          checkMemoryUsage();
      }
      
-     // No path found
-     _results.clear();
+     if (_bestMeeting) {
+         _results = reconstructPath(_bestMeeting->id);
+     } else {
+         _results.clear();
+     }
  }
  
 //  bool DocumentSourceBidirectionalGraphLookup::expandFrontier(bool isForward) {
@@ -359,113 +383,435 @@
 // }
 bool DocumentSourceBidirectionalGraphLookup::expandFrontier(bool isForward) {
     auto& frontier = isForward ? _forwardFrontier : _backwardFrontier;
-    auto& visited = isForward ? _forwardVisited : _backwardVisited;
-    const auto& connectField = isForward ? _connectFromField : _connectToField;
+    auto& frontierSpill = isForward ? _forwardFrontierSpill : _backwardFrontierSpill;
+    auto& frontierBytes = isForward ? _forwardFrontierUsageBytes : _backwardFrontierUsageBytes;
+    const auto& visited = isForward ? _forwardVisited : _backwardVisited;
     const auto& matchField = isForward ? _connectToField : _connectFromField;
 
-    if (frontier.empty()) {
+    if (!hasFrontier(isForward)) {
         return false;
     }
+    uassert(6969001, "matchField must not be empty", !matchField.empty());
 
-    ValueFlatUnorderedSet frontierSnapshot = frontier;
-    frontier.clear();
-    LOGV2(9999999, "Starting expandFrontier. Initial snapshot size: {s}", "s"_attr = frontierSnapshot.size());
+    // Documents found in this expansion are this many levels from their end
+    auto& levels = isForward ? _forwardLevels : _backwardLevels;
+    LevelState level;
+    level.depth = levels++;
 
-    _frontierUsageBytes = 0;
-    bool expanded = false;
+    if (frontierSpill.runs.empty()) {
+        ValueFlatUnorderedMap<Value> frontierSnapshot =
+            pExpCtx->getValueComparator().makeFlatUnorderedValueMap<Value>();
+        std::swap(frontierSnapshot, frontier);
+        LOGV2_DEBUG(9746107,
+                    3,
+                    "Starting expandFrontier. Initial snapshot size: {s}",
+                    "s"_attr = frontierSnapshot.size());
 
-    for (const auto& valueBeingMatched : frontierSnapshot) {
-        uassert(6969001, "matchField must not be empty", !matchField.empty());
+        // The snapshot stays in memory until the level is done, so its bytes
+        // move with it rather than being released
+        _expandingUsageBytes = std::exchange(frontierBytes, 0);
+        expandFrontierBatch(isForward, frontierSnapshot, level);
+        _expandingUsageBytes = 0;
+    } else {
+        // Part of the frontier went to disk while it was built: read it all
+        // back in value order and expand it a bounded batch at a time. Its
+        // file goes away with 'spilled' once the level is done.
+        spillFrontier(isForward);
+        SpilledRuns spilled;
+        std::swap(spilled, frontierSpill);
+        std::unique_ptr<Sorter<Value, Value>::Iterator> merged(Sorter<Value, Value>::Iterator::merge(
+            spilled.runs, SortOptions(), SpillComparator(pExpCtx->getValueComparator())));
+        LOGV2_DEBUG(9746108,
+                    3,
+                    "Starting expandFrontier from {r} spilled runs",
+                    "r"_attr = spilled.runs.size());
 
-        BSONObj matchObj;
-        try {
-            BSONObjBuilder matchBuilder;
-            {
-                BSONObjBuilder outer(matchBuilder.subobjStart("$match"));
-                outer.append(matchField, BSON("$in" << BSON_ARRAY(valueBeingMatched)));
+        auto frontierBatch = pExpCtx->getValueComparator().makeFlatUnorderedValueMap<Value>();
+        size_t batchBytes = 0;
+        while (merged->more()) {
+            auto [value, parentId] = merged->next();
+            batchBytes += value.getApproximateSize() + parentId.getApproximateSize();
+            frontierBatch.try_emplace(std::move(value), std::move(parentId));
+            if (batchBytes >= _maxMemoryUsageBytes / 4) {
+                _expandingUsageBytes = batchBytes;
+                expandFrontierBatch(isForward, frontierBatch, level);
+                frontierBatch.clear();
+                batchBytes = 0;
             }
-            matchObj = matchBuilder.obj();
-        } catch (const DBException& ex) {
-            LOGV2_WARNING(9999999, "Failed to build match object: {error}", "error"_attr = ex.toString());
-            continue;
         }
+        if (!frontierBatch.empty()) {
+            _expandingUsageBytes = batchBytes;
+            expandFrontierBatch(isForward, frontierBatch, level);
+        }
+        _expandingUsageBytes = 0;
+    }
 
-        LOGV2(9999999, "Generated match: {match}", "match"_attr = matchObj.toString());
+    // Documents whose _id hash matched spilled state were held back; settle
+    // them with one pass over each side's runs
+    resolvePossiblyVisited(isForward, level);
+    resolvePossibleMeetings(isForward, level);
+
+    LOGV2_DEBUG(9746109,
+                3,
+                "{dir} expansion complete: batches={b}, cached={c}, visited={v}, frontier={f}",
+                "dir"_attr = isForward ? "Forward" : "Backward",
+                "b"_attr = level.batches,
+                "c"_attr = level.cached,
+                "v"_attr = visited.size(),
+                "f"_attr = frontier.size());
+
+    return level.expanded;
+}
 
-        auto pipeline = buildPipeline(matchObj);
+bool DocumentSourceBidirectionalGraphLookup::hasFrontier(bool isForward) const {
+    const auto& frontier = isForward ? _forwardFrontier : _backwardFrontier;
+    const auto& frontierSpill = isForward ? _forwardFrontierSpill : _backwardFrontierSpill;
+    return !frontier.empty() || !frontierSpill.runs.empty();
+}
+
+void DocumentSourceBidirectionalGraphLookup::expandFrontierBatch(
+    bool isForward, const ValueFlatUnorderedMap<Value>& frontierBatch, LevelState& level) {
+    auto& cache = isForward ? _forwardCache : _backwardCache;
+    const auto& connectField = isForward ? _connectFromField : _connectToField;
+    const auto& matchField = isForward ? _connectToField : _connectFromField;
+
+    // Values already queried, for this input document or an earlier one, are
+    // answered from the cache; only the rest go to the from collection
+    std::vector<Value> uncached;
+    for (const auto& [value, parentId] : frontierBatch) {
+        if (const auto* adjacentNodes = cache.find(value)) {
+            for (const auto& adjacent : *adjacentNodes) {
+                visitNode(isForward, adjacent, parentId, level);
+            }
+            ++level.cached;
+        } else {
+            uncached.push_back(value);
+        }
+    }
+
+    // One query per level, split only where a single $in would not fit in a BSON object
+    auto batchStart = uncached.cbegin();
+    while (batchStart != uncached.cend()) {
+        auto batchBegin = batchStart;
+        auto pipeline = buildPipeline(
+            makeMatchStageFromFrontier(matchField, batchStart, uncached.cend()));
         uassert(6969002, "Failed to build pipeline", pipeline != nullptr);
+        ++level.batches;
 
-        LOGV2(9999999,
-              "Expanding valueBeingMatched: {val}, matchField: {mf}",
-              "val"_attr = valueBeingMatched.toString(),
-              "mf"_attr = matchField);
+        // Neighbors of every value of the batch, including the values that
+        // have none, so those are not queried again either
+        auto batchAdjacency =
+            pExpCtx->getValueComparator().makeUnorderedValueMap<std::vector<AdjacentNode>>();
+        for (auto it = batchBegin; it != batchStart; ++it) {
+            batchAdjacency[*it];
+        }
 
         while (auto next = pipeline->getNext()) {
-            LOGV2(9999999, "Fetched doc: {doc}", "doc"_attr = next->toString());
-
-            auto id = next->getField("_id");
-            if (visited.find(id) == visited.end()) {
-                SearchNode node;
-                node.id = id;
-                node.depth = visited.size();
-                node.isForwardDirection = isForward;
-                node.parentId = valueBeingMatched;
-                visited[id] = node;
-                _visitedUsageBytes += id.getApproximateSize() + next->getApproximateSize();
-
-                document_path_support::visitAllValuesAtPath(
-                    *next,
-                    FieldPath(connectField),
-                    [&](const Value& connectVal) {
-                        if (visited.find(connectVal) == visited.end()) {
-                            frontier.insert(connectVal);
-                            _frontierUsageBytes += connectVal.getApproximateSize();
-                        }
-                    });
-
-                expanded = true;
+            AdjacentNode adjacent;
+            adjacent.id = next->getField("_id");
+            document_path_support::visitAllValuesAtPath(
+                *next,
+                FieldPath(connectField),
+                [&](const Value& connectVal) { adjacent.connectValues.push_back(connectVal); });
+
+            // Map the document back to the frontier values it matched, and so
+            // to the document those values came from; any of them is a
+            // shortest-path parent since they share a level
+            const Value* parentId = nullptr;
+            document_path_support::visitAllValuesAtPath(
+                *next,
+                FieldPath(matchField),
+                [&](const Value& matchVal) {
+                    auto entry = batchAdjacency.find(matchVal);
+                    if (entry == batchAdjacency.end()) {
+                        return;
+                    }
+                    entry->second.push_back(adjacent);
+                    if (!parentId) {
+                        parentId = &frontierBatch.find(matchVal)->second;
+                    }
+                });
+            if (!parentId) {
+                continue;  // Matched on a whole array rather than an element of it
             }
+
+            visitNode(isForward, adjacent, *parentId, level);
+        }
+
+        for (auto& [value, adjacentNodes] : batchAdjacency) {
+            cache.insert(value, std::move(adjacentNodes));
+        }
+
+        // A single level can outgrow the limit, so check between queries
+        checkMemoryUsage();
+    }
+}
+
+void DocumentSourceBidirectionalGraphLookup::visitNode(bool isForward,
+                                                       const AdjacentNode& adjacent,
+                                                       const Value& parentId,
+                                                       LevelState& level,
+                                                       bool spillChecked) {
+    auto& visited = isForward ? _forwardVisited : _backwardVisited;
+    const auto& otherVisited = isForward ? _backwardVisited : _forwardVisited;
+    auto& frontier = isForward ? _forwardFrontier : _backwardFrontier;
+    auto& frontierBytes = isForward ? _forwardFrontierUsageBytes : _backwardFrontierUsageBytes;
+
+    if (visited.find(adjacent.id) != VisitedTable::kNotFound) {
+        return;
+    }
+    if (!spillChecked && spilledMayContain(isForward, adjacent.id)) {
+        level.possiblyVisited.push_back(PendingNode{adjacent, parentId});
+        return;
+    }
+
+    visited.insert(adjacent.id, parentId, level.depth);
+
+    // Detect meetings as they happen instead of rescanning the visited
+    // maps after every level
+    auto otherNode = otherVisited.find(adjacent.id);
+    if (otherNode != VisitedTable::kNotFound) {
+        recordMeeting(adjacent.id, level.depth + otherVisited.depth(otherNode));
+    } else if (spilledMayContain(!isForward, adjacent.id)) {
+        level.possibleMeetings.emplace_back(adjacent.id, level.depth);
+    }
+
+    for (const auto& connectVal : adjacent.connectValues) {
+        if (visited.find(connectVal) == VisitedTable::kNotFound &&
+            frontier.try_emplace(connectVal, adjacent.id).second) {
+            frontierBytes += connectVal.getApproximateSize() + adjacent.id.getApproximateSize();
         }
     }
 
-    LOGV2(9999999,
-          "{dir} expansion complete: visited={v}, frontier={f}",
-          "dir"_attr = isForward ? "Forward" : "Backward",
-          "v"_attr = visited.size(),
-          "f"_attr = frontier.size());
+    level.expanded = true;
+}
 
-    return expanded;
+size_t DocumentSourceBidirectionalGraphLookup::AdjacentNode::getApproximateSize() const {
+    size_t size = sizeof(AdjacentNode) + id.getApproximateSize();
+    for (const auto& connectVal : connectValues) {
+        size += connectVal.getApproximateSize();
+    }
+    return size;
 }
 
+DocumentSourceBidirectionalGraphLookup::AdjacencyCache::AdjacencyCache(
+    const ValueComparator& comparator, size_t maxSizeBytes)
+    : _maxSizeBytes(maxSizeBytes),
+      _index(comparator.makeUnorderedValueMap<EntryList::iterator>()) {}
 
-//  boost::optional<DocumentSourceBidirectionalGraphLookup::BidirectionalPath> 
-//  DocumentSourceBidirectionalGraphLookup::checkMeetingPoint() {
-//      for (const auto& [id, forwardNode] : _forwardVisited) {
-//          if (_backwardVisited.find(id) != _backwardVisited.end()) {
-//              BidirectionalPath path;
-//              path.meetingNode = Document{{"_id", id}};
-//              return path;
-//          }
-//      }
-//      return boost::none;
-//  }
+const std::vector<DocumentSourceBidirectionalGraphLookup::AdjacentNode>*
+DocumentSourceBidirectionalGraphLookup::AdjacencyCache::find(const Value& key) {
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    _entries.splice(_entries.begin(), _entries, it->second);
+    ++_hits;
+    return &it->second->adjacentNodes;
+}
+
+void DocumentSourceBidirectionalGraphLookup::AdjacencyCache::insert(
+    const Value& key, std::vector<AdjacentNode> adjacentNodes) {
+    size_t sizeBytes = sizeof(Entry) + key.getApproximateSize();
+    for (const auto& adjacent : adjacentNodes) {
+        sizeBytes += adjacent.getApproximateSize();
+    }
+    if (sizeBytes > _maxSizeBytes || _index.find(key) != _index.end()) {
+        return;  // A hub too large to keep, or already cached
+    }
 
-boost::optional<Value> DocumentSourceBidirectionalGraphLookup::checkMeetingPoint() {
-    LOGV2(9999999, "Checking meeting point - forward size: {fwd}, backward size: {bwd}",
-        "fwd"_attr = _forwardVisited.size(),
-        "bwd"_attr = _backwardVisited.size());
+    while (_sizeBytes + sizeBytes > _maxSizeBytes) {
+        auto& oldest = _entries.back();
+        _sizeBytes -= oldest.sizeBytes;
+        _index.erase(oldest.key);
+        _entries.pop_back();
+        ++_evictions;
+    }
+
+    _entries.push_front(Entry{key, std::move(adjacentNodes), sizeBytes});
+    _index[key] = _entries.begin();
+    _sizeBytes += sizeBytes;
+}
+
+void DocumentSourceBidirectionalGraphLookup::AdjacencyCache::clear() {
+    _entries.clear();
+    _index.clear();
+    _sizeBytes = 0;
+}
+
+Document DocumentSourceBidirectionalGraphLookup::AdjacencyCache::stats() const {
+    return Document{{"hits", static_cast<long long>(_hits)},
+                    {"misses", static_cast<long long>(_misses)},
+                    {"evictions", static_cast<long long>(_evictions)},
+                    {"entries", static_cast<long long>(_entries.size())},
+                    {"sizeBytes", static_cast<long long>(_sizeBytes)}};
+}
+
+DocumentSourceBidirectionalGraphLookup::VisitedTable::VisitedTable(
+    const ValueComparator& comparator, const StringDataComparator* stringComparator)
+    : _comparator(comparator),
+      _stringComparator(stringComparator),
+      _index(0, IdHash{this}, IdEq{this}) {}
+
+size_t DocumentSourceBidirectionalGraphLookup::VisitedTable::IdHash::operator()(Index index) const {
+    return (*this)(table->_ids[index]);
+}
+
+size_t DocumentSourceBidirectionalGraphLookup::VisitedTable::IdHash::operator()(
+    const Value& id) const {
+    size_t seed = 0;
+    id.hash_combine(seed, table->_stringComparator);
+    return seed;
+}
 
-    for (const auto& [id, _] : _forwardVisited) {
-        if (_backwardVisited.find(id) != _backwardVisited.end()) {
-            LOGV2(9999999, "Meeting point found at: {id}", "id"_attr = id.toString());
-            return id;
+bool DocumentSourceBidirectionalGraphLookup::VisitedTable::IdEq::operator()(Index lhs,
+                                                                          Index rhs) const {
+    return lhs == rhs;
+}
+
+bool DocumentSourceBidirectionalGraphLookup::VisitedTable::IdEq::operator()(const Value& lhs,
+                                                                          Index rhs) const {
+    return table->_comparator.compare(lhs, table->_ids[rhs]) == 0;
+}
+
+bool DocumentSourceBidirectionalGraphLookup::VisitedTable::IdEq::operator()(
+    Index lhs, const Value& rhs) const {
+    return (*this)(rhs, lhs);
+}
+
+DocumentSourceBidirectionalGraphLookup::VisitedTable::Index
+DocumentSourceBidirectionalGraphLookup::VisitedTable::find(const Value& id) const {
+    auto it = _index.find(id);
+    if (it == _index.end() || _nodes[*it].depth == kUnvisited) {
+        return kNotFound;
+    }
+    return *it;
+}
+
+DocumentSourceBidirectionalGraphLookup::VisitedTable::Index
+DocumentSourceBidirectionalGraphLookup::VisitedTable::intern(const Value& id) {
+    auto it = _index.find(id);
+    if (it != _index.end()) {
+        return *it;
+    }
+    Index index = static_cast<Index>(_ids.size());
+    _ids.push_back(id);
+    _nodes.push_back(Node{kNotFound, kUnvisited});
+    _idHeapBytes += id.getApproximateSize() - sizeof(Value);
+    _index.insert(index);
+    return index;
+}
+
+void DocumentSourceBidirectionalGraphLookup::VisitedTable::insert(const Value& id,
+                                                                  const Value& parentId,
+                                                                  size_t depth) {
+    // The parent first: interning may grow the arrays
+    Index parent = parentId.missing() ? kNotFound : intern(parentId);
+    Index index = intern(id);
+    _nodes[index] = Node{parent, static_cast<uint32_t>(depth)};
+    ++_visitedCount;
+}
+
+Value DocumentSourceBidirectionalGraphLookup::VisitedTable::parentId(Index index) const {
+    Index parent = _nodes[index].parent;
+    return parent == kNotFound ? Value() : _ids[parent];
+}
+
+std::vector<DocumentSourceBidirectionalGraphLookup::VisitedTable::Index>
+DocumentSourceBidirectionalGraphLookup::VisitedTable::nodesBelow(
+    boost::optional<size_t> belowDepth) const {
+    std::vector<Index> nodes;
+    for (Index index = 0; index < _nodes.size(); ++index) {
+        const Node& node = _nodes[index];
+        if (node.depth != kUnvisited && (!belowDepth || node.depth < *belowDepth)) {
+            nodes.push_back(index);
         }
     }
-    return boost::none;
+    return nodes;
 }
 
+void DocumentSourceBidirectionalGraphLookup::VisitedTable::eraseBelow(
+    boost::optional<size_t> belowDepth) {
+    std::vector<Value> ids;
+    std::vector<Node> nodes;
+    std::vector<Index> remap(_ids.size(), kNotFound);
+    size_t idHeapBytes = 0;
+    auto keep = [&](Index index, Node node) {
+        remap[index] = static_cast<Index>(ids.size());
+        ids.push_back(_ids[index]);
+        nodes.push_back(node);
+        idHeapBytes += _ids[index].getApproximateSize() - sizeof(Value);
+    };
+
+    for (Index index = 0; index < _nodes.size(); ++index) {
+        const Node& node = _nodes[index];
+        if (node.depth != kUnvisited && belowDepth && node.depth >= *belowDepth) {
+            keep(index, node);
+        }
+    }
+    // Then the parents the documents left still refer to, as unvisited
+    // entries if they were dropped
+    const size_t visitedCount = ids.size();
+    for (size_t index = 0; index < visitedCount; ++index) {
+        Index parent = nodes[index].parent;
+        if (parent == kNotFound) {
+            continue;
+        }
+        if (remap[parent] == kNotFound) {
+            keep(parent, Node{kNotFound, kUnvisited});
+        }
+        nodes[index].parent = remap[parent];
+    }
+
+    _ids = std::move(ids);
+    _nodes = std::move(nodes);
+    _idHeapBytes = idHeapBytes;
+    _visitedCount = visitedCount;
+    rebuildIndex();
+}
+
+void DocumentSourceBidirectionalGraphLookup::VisitedTable::rebuildIndex() {
+    _index.clear();
+    _index.reserve(_ids.size());
+    for (Index index = 0; index < _ids.size(); ++index) {
+        _index.insert(index);
+    }
+}
+
+void DocumentSourceBidirectionalGraphLookup::VisitedTable::clear() {
+    // Release the arrays too: the next input document may need far fewer
+    std::vector<Value>().swap(_ids);
+    std::vector<Node>().swap(_nodes);
+    _index = absl::flat_hash_set<Index, IdHash, IdEq>(0, IdHash{this}, IdEq{this});
+    _idHeapBytes = 0;
+    _visitedCount = 0;
+}
+
+size_t DocumentSourceBidirectionalGraphLookup::VisitedTable::getApproximateSize() const {
+    // Capacity rather than size: that is what is allocated
+    return _ids.capacity() * sizeof(Value) + _idHeapBytes + _nodes.capacity() * sizeof(Node) +
+        _index.capacity() * (sizeof(Index) + 1);
+}
+
+void DocumentSourceBidirectionalGraphLookup::recordMeeting(const Value& id, size_t pathLength) {
+    if (!_bestMeeting || pathLength < _bestMeeting->pathLength) {
+        LOGV2_DEBUG(9746104,
+                    2,
+                    "Meeting point found at: {id}, path length: {len}",
+                    "id"_attr = id.toString(),
+                    "len"_attr = pathLength);
+        _bestMeeting = Meeting{id, pathLength};
+    }
+}
+
+bool DocumentSourceBidirectionalGraphLookup::meetingIsOptimal() const {
+    // With F forward and B backward levels expanded, both sides have visited
+    // a middle document of every path of up to F + B - 2 edges, so a meeting
+    // of length F + B - 1 or less cannot be beaten by a deeper level
+    return _bestMeeting && _bestMeeting->pathLength + 1 <= _forwardLevels + _backwardLevels;
+}
 
- 
 //  std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(
 //      const BidirectionalPath& bidirectionalPath) {
 //      // Return only the nodes in the actual path, not all visited nodes
@@ -485,27 +831,34 @@ boost::optional<Value> DocumentSourceBidirectionalGraphLookup::checkMeetingPoint
 //  }
  
 std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Value meetingId) {
-    LOGV2(9999999, "Reconstructing path from meetingId: {id}", "id"_attr = meetingId.toString());
+    LOGV2_DEBUG(9746105, 2, "Reconstructing path from meetingId: {id}", "id"_attr = meetingId.toString());
 
     std::vector<Document> result;
 
-    std::vector<Value> forwardPath;
-    for (auto id = meetingId; !_forwardVisited[id].parentId.missing(); id = _forwardVisited[id].parentId) {
-        LOGV2(9999999, "Forward path step: {id}", "id"_attr = id.toString());
-        forwardPath.push_back(id);
+    // Start document ... meeting document, following forward parents. A
+    // parent is one level up, so a spilled one is only looked for in the
+    // runs of that level and the path reads each spilled level at most once.
+    std::vector<Value> forwardPath{meetingId};
+    for (auto node = findVisited(true, meetingId); node && !node->parentId.missing();
+         node = findVisited(true, node->parentId, node->depth - 1)) {
+        forwardPath.push_back(node->parentId);
     }
     std::reverse(forwardPath.begin(), forwardPath.end());
 
+    // Then towards the target; the last parent is the target value itself
     std::vector<Value> backwardPath;
-    for (auto id = meetingId; !_backwardVisited[id].parentId.missing(); id = _backwardVisited[id].parentId) {
-        backwardPath.push_back(_backwardVisited[id].parentId);
+    for (auto node = findVisited(false, meetingId); node;
+         node = findVisited(false, node->parentId, node->depth - 1)) {
+        backwardPath.push_back(node->parentId);
+        if (node->depth == 0) {
+            break;
+        }
     }
 
     // Merge and convert to Document
     for (auto& val : forwardPath) {
         result.emplace_back(Document{{"_id", val}});
     }
-    result.emplace_back(Document{{"_id", meetingId}});  // Add the meeting node
     for (auto& val : backwardPath) {
         result.emplace_back(Document{{"_id", val}});
     }
@@ -514,18 +867,34 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
 }
 
  BSONObj DocumentSourceBidirectionalGraphLookup::makeMatchStageFromFrontier(
-     const ValueFlatUnorderedSet& frontier) {
+     const std::string& matchField,
+     std::vector<Value>::const_iterator& frontierIt,
+     std::vector<Value>::const_iterator frontierEnd) {
+     // Mirrors $graphLookup: {$match: {$and: [<restrictSearchWithMatch>, {matchField: {$in: [...]}}]}}
      BSONObjBuilder match;
-     BSONObjBuilder query(match.subobjStart("$match"));
-     BSONArrayBuilder in(query.subarrayStart("_id"));
-     
-     for (auto&& value : frontier) {
-         in << value;
+     {
+         BSONObjBuilder query(match.subobjStart("$match"));
+         {
+             BSONArrayBuilder andObj(query.subarrayStart("$and"));
+             if (_additionalFilter) {
+                 andObj << *_additionalFilter;
+             }
+             {
+                 BSONObjBuilder connectObj(andObj.subobjStart());
+                 {
+                     BSONObjBuilder subObj(connectObj.subobjStart(matchField));
+                     {
+                         BSONArrayBuilder in(subObj.subarrayStart("$in"));
+                         // Always take one value so a batch makes progress
+                         do {
+                             in << *frontierIt;
+                             ++frontierIt;
+                         } while (frontierIt != frontierEnd && in.len() < kMaxFrontierBatchBytes);
+                     }
+                 }
+             }
+         }
      }
-     
-     in.done();
-     query.done();
-     
      return match.obj();
  }
  
@@ -540,8 +909,10 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
     if (_fromNs.isEmpty()) {
         LOGV2_WARNING(9999998, "Warning: _fromNs is empty at buildPipeline");
     } else {
-        LOGV2(9999999, "Pipeline built for $lookup fromNs: {ns}", 
-              "ns"_attr = _fromNs.toStringForErrorMsg());
+        LOGV2_DEBUG(9746106,
+                    2,
+                    "Pipeline built for $lookup fromNs: {ns}",
+                    "ns"_attr = _fromNs.toStringForErrorMsg());
     }
 
     auto resolvedNs = pExpCtx->getResolvedNamespace(_fromNs);
@@ -553,10 +924,268 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
 
  
  void DocumentSourceBidirectionalGraphLookup::checkMemoryUsage() {
+     if (getMemoryUsageBytes() < _maxMemoryUsageBytes) {
+         return;
+     }
+     uassert(ErrorCodes::ExceededMemoryLimit,
+             "$bidirectionalGraphLookup reached maximum memory consumption; pass allowDiskUse:true "
+             "to opt in to spilling",
+             pExpCtx->getAllowDiskUse());
+
+     spill();
      uassert(ErrorCodes::ExceededMemoryLimit,
-             "$bidirectionalGraphLookup reached maximum memory consumption",
-             (_visitedUsageBytes + _frontierUsageBytes) < _maxMemoryUsageBytes);
+             "$bidirectionalGraphLookup reached maximum memory consumption after spilling its "
+             "search state",
+             getMemoryUsageBytes() < _maxMemoryUsageBytes);
  }
+
+ size_t DocumentSourceBidirectionalGraphLookup::getMemoryUsageBytes() const {
+     return _forwardVisited.getApproximateSize() + _backwardVisited.getApproximateSize() +
+         _forwardFrontierUsageBytes + _backwardFrontierUsageBytes + _expandingUsageBytes +
+         _spilledIndexUsageBytes;
+ }
+
+void DocumentSourceBidirectionalGraphLookup::spill() {
+    ++_spills;
+
+    // Older levels first: they are only needed again to skip documents
+    // reached twice, for late meetings and to rebuild the path
+    for (bool isForward : {true, false}) {
+        const size_t levels = isForward ? _forwardLevels : _backwardLevels;
+        if (levels > 1) {
+            spillVisited(isForward, levels - 1);
+        }
+    }
+    if (getMemoryUsageBytes() < _maxMemoryUsageBytes) {
+        return;
+    }
+
+    spillFrontier(true);
+    spillFrontier(false);
+    if (getMemoryUsageBytes() < _maxMemoryUsageBytes) {
+        return;
+    }
+
+    spillVisited(true, boost::none);
+    spillVisited(false, boost::none);
+}
+
+void DocumentSourceBidirectionalGraphLookup::spillVisited(bool isForward,
+                                                          boost::optional<size_t> belowDepth) {
+    auto& visited = isForward ? _forwardVisited : _backwardVisited;
+    auto& spilled = isForward ? _forwardSpilled : _backwardSpilled;
+
+    auto entries = visited.nodesBelow(belowDepth);
+    if (entries.empty()) {
+        return;
+    }
+
+    // One run per level, so path reconstruction can read a single level
+    const auto& comparator = pExpCtx->getValueComparator();
+    std::sort(entries.begin(), entries.end(), [&](auto lhs, auto rhs) {
+        if (visited.depth(lhs) != visited.depth(rhs)) {
+            return visited.depth(lhs) < visited.depth(rhs);
+        }
+        return comparator.compare(visited.id(lhs), visited.id(rhs)) < 0;
+    });
+
+    for (auto begin = entries.begin(); begin != entries.end();) {
+        const size_t depth = visited.depth(*begin);
+        auto end = std::find_if(
+            begin, entries.end(), [&](auto index) { return visited.depth(index) != depth; });
+
+        auto& level = spilled.levels[depth];
+        if (!level.file) {
+            level.file = makeSpillFile();
+        }
+        SortedFileWriter<Value, Value> writer(SortOptions().TempDir(pExpCtx->getTempDir()),
+                                              level.file);
+        for (auto it = begin; it != end; ++it) {
+            const Value& id = visited.id(*it);
+            writer.addAlreadySorted(
+                id,
+                Value(std::vector<Value>{visited.parentId(*it),
+                                         Value(static_cast<long long>(depth))}));
+            if (spilled.idHashes.insert(hashId(id)).second) {
+                _spilledIndexUsageBytes += kSpilledIdIndexBytes;
+            }
+        }
+        level.runs.emplace_back(writer.done());
+        begin = end;
+    }
+    _spilledRecords += entries.size();
+
+    visited.eraseBelow(belowDepth);
+}
+
+void DocumentSourceBidirectionalGraphLookup::spillFrontier(bool isForward) {
+    auto& frontier = isForward ? _forwardFrontier : _backwardFrontier;
+    auto& frontierSpill = isForward ? _forwardFrontierSpill : _backwardFrontierSpill;
+    auto& frontierBytes = isForward ? _forwardFrontierUsageBytes : _backwardFrontierUsageBytes;
+    if (frontier.empty()) {
+        return;
+    }
+
+    const auto& comparator = pExpCtx->getValueComparator();
+    std::vector<const std::pair<const Value, Value>*> entries;
+    entries.reserve(frontier.size());
+    for (const auto& entry : frontier) {
+        entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [&](const auto* lhs, const auto* rhs) {
+        return comparator.compare(lhs->first, rhs->first) < 0;
+    });
+
+    if (!frontierSpill.file) {
+        frontierSpill.file = makeSpillFile();
+    }
+    SortedFileWriter<Value, Value> writer(SortOptions().TempDir(pExpCtx->getTempDir()),
+                                          frontierSpill.file);
+    for (const auto* entry : entries) {
+        writer.addAlreadySorted(entry->first, entry->second);
+    }
+    frontierSpill.runs.emplace_back(writer.done());
+    _spilledRecords += entries.size();
+    frontier.clear();
+    frontierBytes = 0;
+}
+
+std::shared_ptr<Sorter<Value, Value>::File>
+DocumentSourceBidirectionalGraphLookup::makeSpillFile() {
+    if (!_spillStats) {
+        _spillStats = std::make_unique<SorterFileStats>(nullptr /* sorterTracker */);
+    }
+    return std::make_shared<Sorter<Value, Value>::File>(
+        pExpCtx->getTempDir() + "/" + nextFileName(), _spillStats.get());
+}
+
+size_t DocumentSourceBidirectionalGraphLookup::hashId(const Value& id) const {
+    size_t seed = 0;
+    id.hash_combine(seed, pExpCtx->getCollator());
+    return seed;
+}
+
+bool DocumentSourceBidirectionalGraphLookup::spilledMayContain(bool isForward,
+                                                               const Value& id) const {
+    const auto& spilled = isForward ? _forwardSpilled : _backwardSpilled;
+    return !spilled.levels.empty() && spilled.idHashes.count(hashId(id));
+}
+
+void DocumentSourceBidirectionalGraphLookup::joinSpilled(
+    bool isForward,
+    const std::vector<Value>& ids,
+    boost::optional<size_t> depth,
+    const std::function<void(size_t index, const Value& entry)>& onMatch) {
+    auto& spilled = isForward ? _forwardSpilled : _backwardSpilled;
+    const auto& comparator = pExpCtx->getValueComparator();
+
+    for (auto& [levelDepth, level] : spilled.levels) {
+        if (depth && levelDepth != *depth) {
+            continue;
+        }
+
+        std::unique_ptr<Sorter<Value, Value>::Iterator> merged(
+            Sorter<Value, Value>::Iterator::merge(
+                level.runs, SortOptions(), SpillComparator(comparator)));
+
+        // Compact the level into one run in a fresh file; the old file is
+        // deleted when 'level' is replaced, so disk use stays at one copy
+        SpilledRuns compacted;
+        compacted.file = makeSpillFile();
+        SortedFileWriter<Value, Value> writer(SortOptions().TempDir(pExpCtx->getTempDir()),
+                                              compacted.file);
+        size_t next = 0;
+        while (merged->more()) {
+            auto [id, entry] = merged->next();
+            while (next < ids.size() && comparator.compare(ids[next], id) < 0) {
+                ++next;
+            }
+            for (size_t i = next; i < ids.size() && comparator.compare(ids[i], id) == 0; ++i) {
+                onMatch(i, entry);
+            }
+            writer.addAlreadySorted(id, entry);
+        }
+        compacted.runs.emplace_back(writer.done());
+        merged.reset();
+        level = std::move(compacted);
+    }
+}
+
+void DocumentSourceBidirectionalGraphLookup::resolvePossiblyVisited(bool isForward,
+                                                                    LevelState& level) {
+    auto& pending = level.possiblyVisited;
+    if (pending.empty()) {
+        return;
+    }
+
+    const auto& comparator = pExpCtx->getValueComparator();
+    std::sort(pending.begin(), pending.end(), [&](const auto& lhs, const auto& rhs) {
+        return comparator.compare(lhs.adjacent.id, rhs.adjacent.id) < 0;
+    });
+    std::vector<Value> ids;
+    ids.reserve(pending.size());
+    for (const auto& node : pending) {
+        ids.push_back(node.adjacent.id);
+    }
+
+    std::vector<bool> isSpilled(pending.size(), false);
+    joinSpilled(isForward, ids, boost::none, [&](size_t index, const Value&) {
+        isSpilled[index] = true;
+    });
+
+    // The rest only shared a hash with a spilled document
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (!isSpilled[i]) {
+            visitNode(isForward, pending[i].adjacent, pending[i].parentId, level, true);
+        }
+    }
+    pending.clear();
+}
+
+void DocumentSourceBidirectionalGraphLookup::resolvePossibleMeetings(bool isForward,
+                                                                     LevelState& level) {
+    auto& candidates = level.possibleMeetings;
+    if (candidates.empty()) {
+        return;
+    }
+
+    const auto& comparator = pExpCtx->getValueComparator();
+    std::sort(candidates.begin(), candidates.end(), [&](const auto& lhs, const auto& rhs) {
+        return comparator.compare(lhs.first, rhs.first) < 0;
+    });
+    std::vector<Value> ids;
+    ids.reserve(candidates.size());
+    for (const auto& candidate : candidates) {
+        ids.push_back(candidate.first);
+    }
+
+    joinSpilled(!isForward, ids, boost::none, [&](size_t index, const Value& entry) {
+        auto otherDepth = static_cast<size_t>(entry.getArray()[1].getLong());
+        recordMeeting(candidates[index].first, candidates[index].second + otherDepth);
+    });
+    candidates.clear();
+}
+
+boost::optional<DocumentSourceBidirectionalGraphLookup::SearchNode>
+DocumentSourceBidirectionalGraphLookup::findVisited(bool isForward,
+                                                    const Value& id,
+                                                    boost::optional<size_t> depth) {
+    const auto& visited = isForward ? _forwardVisited : _backwardVisited;
+    auto index = visited.find(id);
+    if (index != VisitedTable::kNotFound) {
+        return SearchNode{visited.id(index), visited.depth(index), visited.parentId(index)};
+    }
+    if (!spilledMayContain(isForward, id)) {
+        return boost::none;
+    }
+
+    boost::optional<SearchNode> found;
+    joinSpilled(isForward, {id}, depth, [&](size_t, const Value& entry) {
+        found = SearchNode{
+            id, static_cast<size_t>(entry.getArray()[1].getLong()), entry.getArray()[0]};
+    });
+    return found;
+}
  
  void DocumentSourceBidirectionalGraphLookup::resetSearchState() {
      _forwardVisited.clear();
@@ -564,12 +1193,25 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
      _forwardFrontier.clear();
      _backwardFrontier.clear();
      _results.clear();
-     _visitedUsageBytes = 0;
-     _frontierUsageBytes = 0;
+     _forwardLevels = 0;
+     _backwardLevels = 0;
+     _bestMeeting = boost::none;
+     _forwardFrontierUsageBytes = 0;
+     _backwardFrontierUsageBytes = 0;
+     _expandingUsageBytes = 0;
+
+     // Dropping the runs deletes their spill files
+     _forwardSpilled = SpilledVisited();
+     _backwardSpilled = SpilledVisited();
+     _forwardFrontierSpill = SpilledRuns();
+     _backwardFrontierSpill = SpilledRuns();
+     _spilledIndexUsageBytes = 0;
  }
  
  void DocumentSourceBidirectionalGraphLookup::doDispose() {
      resetSearchState();
+     _forwardCache.clear();
+     _backwardCache.clear();
  }
  
  boost::intrusive_ptr<DocumentSource> DocumentSourceBidirectionalGraphLookup::clone(
@@ -611,6 +1253,14 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
      if (_maxDepth) {
          spec["maxDepth"] = Value(*_maxDepth);
      }
+     if (opts.verbosity) {
+         // Adjacency served from the caches rather than the from collection
+         spec["adjacencyCache"] = Value(Document{{"forward", _forwardCache.stats()},
+                                                 {"backward", _backwardCache.stats()}});
+         spec["usedDisk"] = Value(_spills > 0);
+         spec["spills"] = Value(_spills);
+         spec["spilledRecords"] = Value(_spilledRecords);
+     }
  
      container[getSourceName()] = Value(spec.freeze());
      return container.freezeToValue();
@@ -630,7 +1280,7 @@ std::vector<Document> DocumentSourceBidirectionalGraphLookup::reconstructPath(Va
      return StageConstraints(StreamType::kStreaming,
                              PositionRequirement::kNone,
                              HostTypeRequirement::kNone,
-                             DiskUseRequirement::kNoDiskUse,
+                             DiskUseRequirement::kWritesTmpData,
                              FacetRequirement::kAllowed,
                              TransactionRequirement::kAllowed,
                              LookupRequirement::kAllowed,
@@ -7,6 +7,14 @@
  #include "mongo/db/pipeline/document_source.h"
  #include "mongo/db/pipeline/document_source_graph_lookup.h"
  #include "mongo/db/exec/document_value/value_comparator.h"
+ #include "mongo/db/sorter/sorter.h"
+ #include "mongo/stdx/unordered_set.h"
+ #include <absl/container/flat_hash_set.h>
+ #include <cstdint>
+ #include <functional>
+ #include <limits>
+ #include <list>
+ #include <map>
  #include <queue>
  #include <unordered_map>
  #include <set>
@@ -76,14 +84,168 @@
      boost::optional<ShardId> computeMergeShardId() const final;
  
  private:
+     // A visited document as read back from a VisitedTable or a spilled run
      struct SearchNode {
          Value id;
          size_t depth;
-         std::vector<Value> path;
-         bool isForwardDirection;
-         Value parentId;
+         Value parentId;  // Missing for a start document
+     };
+
+     // Documents visited in one direction, in flat arrays: each _id is stored
+     // once and everything else refers to it by index, so a document costs its
+     // _id plus eight bytes. A parent that is not a visited document itself (a
+     // target value, or a document spilled to disk) stays as an unvisited entry.
+     class VisitedTable {
+     public:
+         using Index = uint32_t;
+         static constexpr Index kNotFound = std::numeric_limits<Index>::max();
+
+         VisitedTable(const ValueComparator& comparator,
+                      const StringDataComparator* stringComparator);
+         VisitedTable(const VisitedTable&) = delete;
+         VisitedTable& operator=(const VisitedTable&) = delete;
+
+         // Index of a visited document, or kNotFound
+         Index find(const Value& id) const;
+         // Record a document not visited yet; 'parentId' is missing for a start document
+         void insert(const Value& id, const Value& parentId, size_t depth);
+
+         const Value& id(Index index) const {
+             return _ids[index];
+         }
+         size_t depth(Index index) const {
+             return _nodes[index].depth;
+         }
+         Value parentId(Index index) const;
+
+         // Visited documents found before 'belowDepth', or all of them if unset
+         std::vector<Index> nodesBelow(boost::optional<size_t> belowDepth) const;
+         // Drop those documents; the ones left keep their parents
+         void eraseBelow(boost::optional<size_t> belowDepth);
+
+         size_t size() const {
+             return _visitedCount;
+         }
+         void clear();
+         size_t getApproximateSize() const;
+
+     private:
+         static constexpr uint32_t kUnvisited = std::numeric_limits<uint32_t>::max();
+
+         struct Node {
+             Index parent;    // kNotFound for a start document
+             uint32_t depth;  // kUnvisited for an _id only kept as a parent
+         };
+
+         // The index holds positions in _ids, hashed and compared by the _id
+         // there, and is searched with the _id itself
+         struct IdHash {
+             using is_transparent = void;
+             size_t operator()(Index index) const;
+             size_t operator()(const Value& id) const;
+             const VisitedTable* table;
+         };
+         struct IdEq {
+             using is_transparent = void;
+             bool operator()(Index lhs, Index rhs) const;
+             bool operator()(const Value& lhs, Index rhs) const;
+             bool operator()(Index lhs, const Value& rhs) const;
+             const VisitedTable* table;
+         };
+
+         Index intern(const Value& id);
+         void rebuildIndex();
+
+         ValueComparator _comparator;
+         const StringDataComparator* _stringComparator;
+         std::vector<Value> _ids;
+         std::vector<Node> _nodes;
+         absl::flat_hash_set<Index, IdHash, IdEq> _index;
+         size_t _idHeapBytes = 0;  // Storage of the _ids outside their Values
+         size_t _visitedCount = 0;
+     };
+ 
+     struct Meeting {
+         Value id;
+         size_t pathLength;  // Edges from the start document to the last one before the target
+     };
+ 
+     // A document of the from collection reduced to what the search follows
+     struct AdjacentNode {
+         Value id;
+         std::vector<Value> connectValues;
+ 
+         size_t getApproximateSize() const;
      };
  
+     // Documents matching each value queried so far, kept across input
+     // documents for the life of the operation. Least recently used values
+     // are evicted once the cache exceeds its size.
+     class AdjacencyCache {
+     public:
+         AdjacencyCache(const ValueComparator& comparator, size_t maxSizeBytes);
+ 
+         // nullptr if 'key' has not been queried or has been evicted
+         const std::vector<AdjacentNode>* find(const Value& key);
+         void insert(const Value& key, std::vector<AdjacentNode> adjacentNodes);
+         void clear();
+ 
+         // Hit, miss and eviction counts for explain
+         Document stats() const;
+ 
+     private:
+         struct Entry {
+             Value key;
+             std::vector<AdjacentNode> adjacentNodes;
+             size_t sizeBytes;
+         };
+         using EntryList = std::list<Entry>;
+ 
+         size_t _maxSizeBytes;
+         size_t _sizeBytes = 0;
+         EntryList _entries;  // Most recently used first
+         ValueUnorderedMap<EntryList::iterator> _index;
+         long long _hits = 0;
+         long long _misses = 0;
+         long long _evictions = 0;
+     };
+ 
+     // Sorted runs written to one spill file of their own, which is deleted
+     // once the file and its runs are dropped
+     struct SpilledRuns {
+         std::shared_ptr<Sorter<Value, Value>::File> file;
+         std::vector<std::shared_ptr<Sorter<Value, Value>::Iterator>> runs;
+     };
+
+     // Visited documents moved to disk once the stage outgrows its memory
+     // limit: sorted runs of _id -> [parentId, depth] per level, plus the
+     // hashes of those _ids so only likely hits have to be looked up on disk
+     struct SpilledVisited {
+         std::map<size_t, SpilledRuns> levels;  // By depth
+         stdx::unordered_set<size_t> idHashes;
+     };
+
+     // Memory the resident index takes per spilled _id: one hash-set node
+     static constexpr size_t kSpilledIdIndexBytes = sizeof(size_t) + 2 * sizeof(void*);
+
+     // A document reached on this level whose _id may already be spilled
+     struct PendingNode {
+         AdjacentNode adjacent;
+         Value parentId;
+     };
+
+     // Work carried across the query batches of one frontier expansion
+     struct LevelState {
+         size_t depth = 0;
+         bool expanded = false;
+         size_t batches = 0;
+         size_t cached = 0;
+         // _id hash among this side's spilled ones
+         std::vector<PendingNode> possiblyVisited;
+         // _id hash among the other side's spilled ones: (_id, depth on this side)
+         std::vector<std::pair<Value, size_t>> possibleMeetings;
+     };
+
      struct BidirectionalPath {
          std::vector<Document> forwardPath;
          std::vector<Document> backwardPath;
@@ -93,13 +255,57 @@
      // Core algorithm methods
      void performBidirectionalSearch();
      bool expandFrontier(bool isForward);
-     boost::optional<Value> checkMeetingPoint();
+     // Whether a side has values left to expand, in memory or spilled
+     bool hasFrontier(bool isForward) const;
+     void expandFrontierBatch(bool isForward,
+                              const ValueFlatUnorderedMap<Value>& frontierBatch,
+                              LevelState& level);
+     // Add one document to this side's visited set and queue its connections;
+     // 'spillChecked' once it is known not to be among the spilled documents
+     void visitNode(bool isForward,
+                    const AdjacentNode& adjacent,
+                    const Value& parentId,
+                    LevelState& level,
+                    bool spillChecked = false);
+     void recordMeeting(const Value& id, size_t pathLength);
+     bool meetingIsOptimal() const;
      std::vector<Document> reconstructPath(Value meetingId);
-     BSONObj makeMatchStageFromFrontier(const ValueFlatUnorderedSet& frontier);
+     // $match for the frontier values from 'frontierIt' on, advancing it past
+     // the values that fit in one query
+     BSONObj makeMatchStageFromFrontier(const std::string& matchField,
+                                        std::vector<Value>::const_iterator& frontierIt,
+                                        std::vector<Value>::const_iterator frontierEnd);
      
      std::unique_ptr<Pipeline, PipelineDeleter> buildPipeline(const BSONObj& match);
      void checkMemoryUsage();
+     size_t getMemoryUsageBytes() const;
      void resetSearchState();
+
+     // Spilling, only with allowDiskUse
+     void spill();
+     // Move the visited documents found before 'belowDepth' (all of them if
+     // unset) to a new sorted run
+     void spillVisited(bool isForward, boost::optional<size_t> belowDepth);
+     void spillFrontier(bool isForward);
+     std::shared_ptr<Sorter<Value, Value>::File> makeSpillFile();
+     size_t hashId(const Value& id) const;
+     bool spilledMayContain(bool isForward, const Value& id) const;
+     // Merge join the sorted 'ids' with one side's spilled levels (only the
+     // level at 'depth' if set), calling 'onMatch' with the position in 'ids'
+     // and the spilled [parentId, depth] of every match. Reading consumes
+     // the runs, so each level read is written back to a new file of its own.
+     void joinSpilled(bool isForward,
+                      const std::vector<Value>& ids,
+                      boost::optional<size_t> depth,
+                      const std::function<void(size_t index, const Value& entry)>& onMatch);
+     // Settle the documents of this level that matched a spilled _id hash
+     void resolvePossiblyVisited(bool isForward, LevelState& level);
+     void resolvePossibleMeetings(bool isForward, LevelState& level);
+     // Parent and depth of a visited document, looked up on disk if needed;
+     // a known 'depth' limits that to the runs of one level
+     boost::optional<SearchNode> findVisited(bool isForward,
+                                             const Value& id,
+                                             boost::optional<size_t> depth = boost::none);
  
      // Configuration
      NamespaceString _fromNs;
@@ -116,20 +322,41 @@
      boost::intrusive_ptr<ExpressionContext> _fromExpCtx;
      
      // Search state
-     bool _executed = false;
      Document _inputDoc;
      std::vector<Document> _results;
      
-     // Bidirectional search data structures
-     ValueUnorderedMap<SearchNode> _forwardVisited;
-     ValueUnorderedMap<SearchNode> _backwardVisited;
-     ValueFlatUnorderedSet _forwardFrontier;
-     ValueFlatUnorderedSet _backwardFrontier;
+     // Bidirectional search data structures. Frontiers map each value to
+     // match next to the _id of the document it came from.
+     VisitedTable _forwardVisited;
+     VisitedTable _backwardVisited;
+     ValueFlatUnorderedMap<Value> _forwardFrontier;
+     ValueFlatUnorderedMap<Value> _backwardFrontier;
+     size_t _forwardLevels = 0;
+     size_t _backwardLevels = 0;
+     boost::optional<Meeting> _bestMeeting;
+ 
+     // Adjacency of the from collection, by the value matched, for each direction
+     AdjacencyCache _forwardCache;
+     AdjacencyCache _backwardCache;
      
+     // State spilled under allowDiskUse: visited documents, and frontier
+     // values (value -> parentId) that outgrew memory while being built
+     SpilledVisited _forwardSpilled;
+     SpilledVisited _backwardSpilled;
+     SpilledRuns _forwardFrontierSpill;
+     SpilledRuns _backwardFrontierSpill;
+     std::unique_ptr<SorterFileStats> _spillStats;
+     long long _spills = 0;
+     long long _spilledRecords = 0;
+
      // Memory tracking
      size_t _maxMemoryUsageBytes;
-     size_t _frontierUsageBytes = 0;
-     size_t _visitedUsageBytes = 0;
+     // Each side's frontier under construction, and the frontier (or spilled
+     // batch of it) being expanded, which cannot be spilled until it is done
+     size_t _forwardFrontierUsageBytes = 0;
+     size_t _backwardFrontierUsageBytes = 0;
+     size_t _expandingUsageBytes = 0;
+     size_t _spilledIndexUsageBytes = 0;
  };
  
  }  // namespace mongo
\ No newline at end of file
@@ -0,0 +1,543 @@
+#include "contraction_hierarchy.h"
+#include "indexed_heap.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+using NodeIndex = ContractionHierarchy::NodeIndex;
+using Arc = ContractionHierarchy::Arc;
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+constexpr NodeIndex kNoMiddle = GraphSnapshot::kInvalidNode;
+
+// Witness searches give up after settling this many nodes; a missed witness
+// only costs an unnecessary shortcut, never a wrong answer. Priorities are
+// estimates anyway, so they use a much cheaper search than contraction.
+constexpr int kWitnessSettleLimit = 500;
+constexpr int kPriorityWitnessSettleLimit = 50;
+
+// File layout (host byte order):
+//   magic, version, edge count, graph fingerprint, node count,
+//   node ids in index order,
+//   shortcut count, then the upward and downward arc records, each as
+//   (count, then owner/node/weight/middle per arc).
+constexpr char kFileMagic[8] = {'G', 'X', 'C', 'H', 'I', 'E', 'R', '\0'};
+constexpr uint32_t kFileVersion = 2;
+
+/**
+ * Graph state while nodes are being contracted. Adjacency lists only hold
+ * arcs between uncontracted nodes; a contracted node's arcs are handed to
+ * the hierarchy and removed from its neighbors.
+ */
+class HierarchyBuilder {
+public:
+    explicit HierarchyBuilder(const GraphSnapshot& graph)
+        : _out(graph.nodeCount()),
+          _in(graph.nodeCount()),
+          _contractedNeighbors(graph.nodeCount(), 0),
+          _witnessDistance(graph.nodeCount(), kInfinity),
+          _witnessTarget(graph.nodeCount(), false),
+          _witnessQueue(graph.nodeCount()) {
+
+        for (NodeIndex from = 0; from < graph.nodeCount(); ++from) {
+            for (auto edge = graph.edgeBegin(from); edge < graph.edgeEnd(from); ++edge) {
+                NodeIndex to = graph.target(edge);
+                if (to != from) {
+                    addArc(from, to, graph.weight(edge), kNoMiddle);
+                }
+            }
+        }
+    }
+
+    size_t nodeCount() const { return _out.size(); }
+
+    /**
+     * Edge difference plus contracted neighbors: nodes whose contraction adds
+     * few shortcuts, away from already contracted areas, go first
+     */
+    int priority(NodeIndex node) {
+        int shortcuts = 0;
+        forEachShortcut(node, kPriorityWitnessSettleLimit,
+                        [&](NodeIndex, NodeIndex, double) { ++shortcuts; });
+        int removed = static_cast<int>(_in[node].size() + _out[node].size());
+        return shortcuts - removed + _contractedNeighbors[node];
+    }
+
+    /**
+     * Add the shortcuts `node` needs, move its arcs into the hierarchy records
+     * and detach it; returns the neighbors whose priority may have changed
+     */
+    std::vector<NodeIndex> contract(
+        NodeIndex node,
+        std::vector<ContractionHierarchy::ArcRecord>& upArcs,
+        std::vector<ContractionHierarchy::ArcRecord>& downArcs,
+        size_t& shortcutCount) {
+
+        std::vector<std::pair<std::pair<NodeIndex, NodeIndex>, double>> shortcuts;
+        forEachShortcut(node, kWitnessSettleLimit, [&](NodeIndex from, NodeIndex to, double weight) {
+            shortcuts.push_back({{from, to}, weight});
+        });
+
+        // Every remaining neighbor ranks higher than `node`
+        std::vector<NodeIndex> neighbors;
+        for (const Arc& arc : _out[node]) {
+            upArcs.push_back({node, arc});
+            neighbors.push_back(arc.node);
+            removeArc(_in[arc.node], node);
+        }
+        for (const Arc& arc : _in[node]) {
+            downArcs.push_back({node, arc});
+            neighbors.push_back(arc.node);
+            removeArc(_out[arc.node], node);
+        }
+        _out[node].clear();
+        _out[node].shrink_to_fit();
+        _in[node].clear();
+        _in[node].shrink_to_fit();
+
+        for (const auto& shortcut : shortcuts) {
+            if (addArc(shortcut.first.first, shortcut.first.second, shortcut.second, node)) {
+                ++shortcutCount;
+            }
+        }
+
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (NodeIndex neighbor : neighbors) {
+            ++_contractedNeighbors[neighbor];
+        }
+        return neighbors;
+    }
+
+private:
+    // Add an arc or lower the weight of the existing one; returns true if the
+    // graph changed
+    bool addArc(NodeIndex from, NodeIndex to, double weight, NodeIndex middle) {
+        for (Arc& arc : _out[from]) {
+            if (arc.node == to) {
+                if (weight >= arc.weight) {
+                    return false;
+                }
+                arc.weight = weight;
+                arc.middle = middle;
+                for (Arc& reverse : _in[to]) {
+                    if (reverse.node == from) {
+                        reverse.weight = weight;
+                        reverse.middle = middle;
+                    }
+                }
+                return true;
+            }
+        }
+        _out[from].push_back({to, weight, middle});
+        _in[to].push_back({from, weight, middle});
+        return true;
+    }
+
+    static void removeArc(std::vector<Arc>& arcs, NodeIndex node) {
+        arcs.erase(std::remove_if(arcs.begin(), arcs.end(),
+                                  [&](const Arc& arc) { return arc.node == node; }),
+                   arcs.end());
+    }
+
+    // Report every pair u -> w of neighbors of `node` whose shortest
+    // connection, as far as a bounded witness search can tell, is u -> node -> w
+    template <typename Visitor>
+    void forEachShortcut(NodeIndex node, int settleLimit, Visitor&& visit) {
+        for (const Arc& in : _in[node]) {
+            double limit = -1;
+            for (const Arc& out : _out[node]) {
+                if (out.node != in.node) {
+                    limit = std::max(limit, in.weight + out.weight);
+                }
+            }
+            if (limit < 0) {
+                continue;  // No outgoing arc other than back to in.node
+            }
+
+            size_t targets = 0;
+            for (const Arc& out : _out[node]) {
+                if (out.node != in.node && !_witnessTarget[out.node]) {
+                    _witnessTarget[out.node] = true;
+                    ++targets;
+                }
+            }
+            witnessSearch(in.node, node, limit, settleLimit, targets);
+            for (const Arc& out : _out[node]) {
+                _witnessTarget[out.node] = false;
+            }
+            for (const Arc& out : _out[node]) {
+                if (out.node == in.node) {
+                    continue;
+                }
+                double via = in.weight + out.weight;
+                if (_witnessDistance[out.node] > via) {
+                    visit(in.node, out.node, via);
+                }
+            }
+            clearWitnessSearch();
+        }
+    }
+
+    // Dijkstra from `source` that avoids `skip` and stops past `limit` or once
+    // all `targets` marked in _witnessTarget are settled
+    void witnessSearch(
+        NodeIndex source, NodeIndex skip, double limit, int settleLimit, size_t targets) {
+        _witnessDistance[source] = 0;
+        _witnessTouched.push_back(source);
+        _witnessQueue.pushOrDecrease(source, 0);
+
+        int settled = 0;
+        while (!_witnessQueue.empty() && settled < settleLimit) {
+            NodeIndex current = _witnessQueue.top();
+            double distance = _witnessQueue.topKey();
+            _witnessQueue.pop();
+            if (distance > limit) {
+                break;
+            }
+            ++settled;
+            if (_witnessTarget[current] && --targets == 0) {
+                break;
+            }
+
+            for (const Arc& arc : _out[current]) {
+                if (arc.node == skip) {
+                    continue;
+                }
+                double candidate = distance + arc.weight;
+                if (candidate < _witnessDistance[arc.node]) {
+                    if (_witnessDistance[arc.node] == kInfinity) {
+                        _witnessTouched.push_back(arc.node);
+                    }
+                    _witnessDistance[arc.node] = candidate;
+                    _witnessQueue.pushOrDecrease(arc.node, candidate);
+                }
+            }
+        }
+    }
+
+    void clearWitnessSearch() {
+        for (NodeIndex node : _witnessTouched) {
+            _witnessDistance[node] = kInfinity;
+        }
+        _witnessTouched.clear();
+        _witnessQueue.reset(nodeCount());
+    }
+
+    std::vector<std::vector<Arc>> _out;
+    std::vector<std::vector<Arc>> _in;
+    std::vector<int> _contractedNeighbors;
+
+    std::vector<double> _witnessDistance;
+    std::vector<bool> _witnessTarget;
+    std::vector<NodeIndex> _witnessTouched;
+    IndexedHeap<double> _witnessQueue;
+};
+
+template <typename T>
+void writeValue(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+} // namespace
+
+std::shared_ptr<const ContractionHierarchy> ContractionHierarchy::build(
+    const GraphSnapshot& graph) {
+
+    std::shared_ptr<ContractionHierarchy> hierarchy(new ContractionHierarchy());
+    HierarchyBuilder builder(graph);
+    size_t nodeCount = graph.nodeCount();
+
+    IndexedHeap<int> order(nodeCount);
+    for (NodeIndex node = 0; node < nodeCount; ++node) {
+        order.pushOrDecrease(node, builder.priority(node));
+    }
+
+    std::vector<ArcRecord> upArcs;
+    std::vector<ArcRecord> downArcs;
+    std::vector<bool> contracted(nodeCount, false);
+
+    while (!order.empty()) {
+        NodeIndex node = order.top();
+        order.pop();
+
+        // Lazy update: contract only if the node is still the cheapest
+        int current = builder.priority(node);
+        if (!order.empty() && current > order.topKey()) {
+            order.pushOrDecrease(node, current);
+            continue;
+        }
+
+        contracted[node] = true;
+        for (NodeIndex neighbor : builder.contract(
+                 node, upArcs, downArcs, hierarchy->_shortcutCount)) {
+            if (!contracted[neighbor]) {
+                order.pushOrUpdate(neighbor, builder.priority(neighbor));
+            }
+        }
+    }
+
+    hierarchy->buildIndex(nodeCount, upArcs, downArcs);
+    return hierarchy;
+}
+
+void ContractionHierarchy::buildIndex(
+    size_t nodeCount,
+    const std::vector<ArcRecord>& upArcs,
+    const std::vector<ArcRecord>& downArcs) {
+
+    auto group = [nodeCount](const std::vector<ArcRecord>& records,
+                             std::vector<ArcIndex>& offsets, std::vector<Arc>& arcs) {
+        offsets.assign(nodeCount + 1, 0);
+        for (const ArcRecord& record : records) {
+            ++offsets[record.owner + 1];
+        }
+        for (size_t i = 0; i < nodeCount; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+        arcs.resize(records.size());
+        std::vector<ArcIndex> cursor(offsets.begin(), offsets.end() - 1);
+        for (const ArcRecord& record : records) {
+            arcs[cursor[record.owner]++] = record.arc;
+        }
+    };
+
+    group(upArcs, _upOffsets, _upArcs);
+    group(downArcs, _downOffsets, _downArcs);
+
+    // Resolve shortcut halves once so unpacking a path never scans arc lists
+    _upHalves.assign(_upArcs.size(), {0, 0});
+    _downHalves.assign(_downArcs.size(), {0, 0});
+    for (NodeIndex owner = 0; owner < nodeCount; ++owner) {
+        for (ArcIndex i = upBegin(owner); i < upEnd(owner); ++i) {
+            const Arc& arc = _upArcs[i];
+            if (arc.middle != kNoMiddle) {
+                _upHalves[i] = findHalves(owner, arc.node, arc.middle);
+            }
+        }
+        for (ArcIndex i = downBegin(owner); i < downEnd(owner); ++i) {
+            const Arc& arc = _downArcs[i];
+            if (arc.middle != kNoMiddle) {
+                _downHalves[i] = findHalves(arc.node, owner, arc.middle);
+            }
+        }
+    }
+}
+
+std::pair<ContractionHierarchy::ArcIndex, ContractionHierarchy::ArcIndex>
+ContractionHierarchy::findHalves(NodeIndex from, NodeIndex to, NodeIndex middle) const {
+    // Both halves were stored at the bypassed node when it was contracted
+    std::pair<ArcIndex, ArcIndex> halves{downEnd(middle), upEnd(middle)};
+    for (ArcIndex i = downBegin(middle); i < downEnd(middle); ++i) {
+        if (_downArcs[i].node == from) {
+            halves.first = i;
+            break;
+        }
+    }
+    for (ArcIndex i = upBegin(middle); i < upEnd(middle); ++i) {
+        if (_upArcs[i].node == to) {
+            halves.second = i;
+            break;
+        }
+    }
+    return halves;
+}
+
+void ContractionHierarchy::unpackUpArc(
+    NodeIndex owner,
+    ArcIndex arc,
+    std::vector<std::pair<NodeIndex, double>>& edges) const {
+    unpack(true, owner, arc, edges);
+}
+
+void ContractionHierarchy::unpackDownArc(
+    NodeIndex owner,
+    ArcIndex arc,
+    std::vector<std::pair<NodeIndex, double>>& edges) const {
+    unpack(false, owner, arc, edges);
+}
+
+void ContractionHierarchy::unpack(
+    bool upward,
+    NodeIndex owner,
+    ArcIndex arc,
+    std::vector<std::pair<NodeIndex, double>>& edges) const {
+
+    struct Pending {
+        bool upward;
+        NodeIndex owner;
+        ArcIndex arc;
+    };
+    std::vector<Pending> stack{{upward, owner, arc}};
+
+    while (!stack.empty()) {
+        Pending current = stack.back();
+        stack.pop_back();
+
+        const Arc& data = current.upward ? _upArcs[current.arc] : _downArcs[current.arc];
+        if (data.middle == kNoMiddle) {
+            // An upward edge ends at its target, a downward one at its owner
+            edges.emplace_back(current.upward ? data.node : current.owner, data.weight);
+            continue;
+        }
+
+        const auto& halves = current.upward ? _upHalves[current.arc] : _downHalves[current.arc];
+        if (halves.first == downEnd(data.middle) || halves.second == upEnd(data.middle)) {
+            continue;  // Cannot happen for a hierarchy built by build()
+        }
+
+        // The stack is LIFO, so push the second half first
+        stack.push_back({true, data.middle, halves.second});
+        stack.push_back({false, data.middle, halves.first});
+    }
+}
+
+bool ContractionHierarchy::save(const std::string& path, const GraphSnapshot& graph) const {
+    size_t count = nodeCount();
+    if (graph.nodeCount() != count) {
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out.write(kFileMagic, sizeof(kFileMagic));
+    writeValue(out, kFileVersion);
+    writeValue(out, static_cast<uint64_t>(graph.edgeCount()));
+    writeValue(out, graph.fingerprint());
+    writeValue(out, static_cast<uint64_t>(count));
+    for (NodeIndex node = 0; node < count; ++node) {
+        std::string id = graph.nodeId(node);
+        writeValue(out, static_cast<uint32_t>(id.size()));
+        out.write(id.data(), static_cast<std::streamsize>(id.size()));
+    }
+    writeValue(out, static_cast<uint64_t>(_shortcutCount));
+
+    auto writeArcs = [&](const std::vector<ArcIndex>& offsets, const std::vector<Arc>& arcs) {
+        writeValue(out, static_cast<uint64_t>(arcs.size()));
+        for (NodeIndex owner = 0; owner < count; ++owner) {
+            for (ArcIndex i = offsets[owner]; i < offsets[owner + 1]; ++i) {
+                writeValue(out, owner);
+                writeValue(out, arcs[i].node);
+                writeValue(out, arcs[i].weight);
+                writeValue(out, arcs[i].middle);
+            }
+        }
+    };
+    writeArcs(_upOffsets, _upArcs);
+    writeArcs(_downOffsets, _downArcs);
+
+    return static_cast<bool>(out);
+}
+
+std::shared_ptr<const ContractionHierarchy> ContractionHierarchy::load(
+    const std::string& path,
+    const GraphSnapshot& graph) {
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+
+    char magic[sizeof(kFileMagic)];
+    uint32_t version = 0;
+    uint64_t edgeCount = 0;
+    uint64_t fingerprint = 0;
+    uint64_t count = 0;
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+        !readValue(in, version) || version != kFileVersion ||
+        !readValue(in, edgeCount) || !readValue(in, fingerprint) ||
+        !readValue(in, count) || count != graph.nodeCount()) {
+        return nullptr;
+    }
+    // Shortcuts summarize the edges they were built from; over any other
+    // edge set they would report wrong distances
+    if (edgeCount != graph.edgeCount() || fingerprint != graph.fingerprint()) {
+        return nullptr;
+    }
+
+    // The file's node indices map onto this snapshot through the node ids
+    std::vector<NodeIndex> toGraph(count);
+    std::vector<bool> seen(count, false);
+    std::string id;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t length = 0;
+        if (!readValue(in, length)) {
+            return nullptr;
+        }
+        id.resize(length);
+        if (!in.read(id.data(), length)) {
+            return nullptr;
+        }
+        NodeIndex node = graph.findNode(id);
+        if (node == GraphSnapshot::kInvalidNode || seen[node]) {
+            return nullptr;
+        }
+        seen[node] = true;
+        toGraph[i] = node;
+    }
+
+    std::shared_ptr<ContractionHierarchy> hierarchy(new ContractionHierarchy());
+    uint64_t shortcutCount = 0;
+    if (!readValue(in, shortcutCount)) {
+        return nullptr;
+    }
+    hierarchy->_shortcutCount = shortcutCount;
+
+    auto mapNode = [&](NodeIndex fileNode, NodeIndex& node) {
+        if (fileNode == kNoMiddle) {
+            node = kNoMiddle;
+            return true;
+        }
+        if (fileNode >= count) {
+            return false;
+        }
+        node = toGraph[fileNode];
+        return true;
+    };
+    auto readArcs = [&](std::vector<ArcRecord>& records) {
+        uint64_t arcCount = 0;
+        if (!readValue(in, arcCount)) {
+            return false;
+        }
+        records.resize(arcCount);
+        for (ArcRecord& record : records) {
+            NodeIndex owner, node, middle;
+            if (!readValue(in, owner) || !readValue(in, node) ||
+                !readValue(in, record.arc.weight) || !readValue(in, middle) ||
+                owner >= count || node >= count ||
+                !mapNode(owner, record.owner) || !mapNode(node, record.arc.node) ||
+                !mapNode(middle, record.arc.middle)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::vector<ArcRecord> upArcs;
+    std::vector<ArcRecord> downArcs;
+    if (!readArcs(upArcs) || !readArcs(downArcs)) {
+        return nullptr;
+    }
+
+    hierarchy->buildIndex(count, upArcs, downArcs);
+    return hierarchy;
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "graph_snapshot.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Contraction hierarchy over a GraphSnapshot for exact shortest-path queries
+ * on large, static road-like graphs.
+ *
+ * Preprocessing contracts the nodes one by one in order of importance (edge
+ * difference plus contracted neighbors, updated lazily). Contracting v adds a
+ * shortcut u -> w for every pair of neighbors whose only shortest connection
+ * runs through v, unless a bounded witness search finds another. Every edge
+ * and shortcut is kept at its lower-ranked endpoint: upward arcs lead to
+ * higher-ranked targets, downward arcs come from higher-ranked sources.
+ *
+ * A query is then a bidirectional Dijkstra that only climbs: forward over
+ * upward arcs from the start, backward over downward arcs from the target.
+ * Shortcuts remember the node they bypass so paths can be unpacked into the
+ * original edges.
+ *
+ * Node indices are those of the snapshot the hierarchy was built for.
+ */
+class ContractionHierarchy {
+public:
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using ArcIndex = uint32_t;
+
+    struct Arc {
+        NodeIndex node;    // Target of an upward arc, source of a downward arc
+        double weight;
+        NodeIndex middle;  // Bypassed node of a shortcut, kInvalidNode for an edge
+    };
+
+    // An arc together with the lower-ranked endpoint it is stored at
+    struct ArcRecord {
+        NodeIndex owner;
+        Arc arc;
+    };
+
+    /**
+     * Contract every node of the snapshot. Parallel edges are reduced to the
+     * cheapest one and self-loops are dropped.
+     */
+    static std::shared_ptr<const ContractionHierarchy> build(const GraphSnapshot& graph);
+
+    /**
+     * Write the hierarchy to a binary file, keyed by the node ids of `graph`
+     * (the snapshot it was built for) so it can be reloaded against a later
+     * snapshot of the same graph. Returns false if the file cannot be written.
+     */
+    bool save(const std::string& path, const GraphSnapshot& graph) const;
+
+    /**
+     * Read a hierarchy written by save() and map it onto `graph`. Returns
+     * nullptr if the file is missing or malformed, or if its nodes, edges or
+     * weights do not match the snapshot (the graph has changed and the
+     * hierarchy must be rebuilt).
+     */
+    static std::shared_ptr<const ContractionHierarchy> load(
+        const std::string& path,
+        const GraphSnapshot& graph);
+
+    size_t nodeCount() const { return _upOffsets.empty() ? 0 : _upOffsets.size() - 1; }
+    size_t shortcutCount() const { return _shortcutCount; }
+
+    ArcIndex upBegin(NodeIndex node) const { return _upOffsets[node]; }
+    ArcIndex upEnd(NodeIndex node) const { return _upOffsets[node + 1]; }
+    const Arc& upArc(ArcIndex arc) const { return _upArcs[arc]; }
+
+    ArcIndex downBegin(NodeIndex node) const { return _downOffsets[node]; }
+    ArcIndex downEnd(NodeIndex node) const { return _downOffsets[node + 1]; }
+    const Arc& downArc(ArcIndex arc) const { return _downArcs[arc]; }
+
+    /**
+     * Append the original edges behind an upward arc of `owner` (or a downward
+     * arc, which leads from arc.node to `owner`), in path order, as
+     * (edge target, edge weight) pairs
+     */
+    void unpackUpArc(
+        NodeIndex owner,
+        ArcIndex arc,
+        std::vector<std::pair<NodeIndex, double>>& edges) const;
+    void unpackDownArc(
+        NodeIndex owner,
+        ArcIndex arc,
+        std::vector<std::pair<NodeIndex, double>>& edges) const;
+
+private:
+    ContractionHierarchy() = default;
+
+    // Group upward and downward arc records by owner into the CSR arrays and
+    // resolve the two halves of every shortcut
+    void buildIndex(
+        size_t nodeCount,
+        const std::vector<ArcRecord>& upArcs,
+        const std::vector<ArcRecord>& downArcs);
+
+    // Halves of the shortcut from -> to via middle: the downward arc of
+    // middle from `from` and the upward arc of middle to `to`
+    std::pair<ArcIndex, ArcIndex> findHalves(
+        NodeIndex from, NodeIndex to, NodeIndex middle) const;
+
+    void unpack(
+        bool upward,
+        NodeIndex owner,
+        ArcIndex arc,
+        std::vector<std::pair<NodeIndex, double>>& edges) const;
+
+    std::vector<ArcIndex> _upOffsets;
+    std::vector<Arc> _upArcs;
+    std::vector<ArcIndex> _downOffsets;
+    std::vector<Arc> _downArcs;
+
+    // Shortcut halves, parallel to the arc arrays (unused for edges)
+    std::vector<std::pair<ArcIndex, ArcIndex>> _upHalves;
+    std::vector<std::pair<ArcIndex, ArcIndex>> _downHalves;
+    size_t _shortcutCount = 0;
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,349 @@
+#include "delta_stepping.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <bsoncxx/builder/stream/array.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/types.hpp>
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+using NodeIndex = GraphSnapshot::NodeIndex;
+using EdgeIndex = GraphSnapshot::EdgeIndex;
+
+constexpr size_t kRequestGrain = 256;  // Nodes per chunk when generating requests
+
+// Offer of a new tentative distance for `node`, reached over an edge from `from`
+struct Request {
+    NodeIndex node;
+    NodeIndex from;
+    double distance;
+    int32_t depth;
+};
+
+constexpr size_t kMaxBucketSlots = 4096;  // Cyclic bucket slots per worker at most
+
+// Buckets of the nodes owned by one worker, padded against false sharing.
+// Bucket b lives in slot b % buckets.size() while it is less than a full turn
+// of slots past the current bucket; so no two live buckets share a slot and
+// the array never grows with the distances. Buckets further ahead (only
+// reached over edges much heavier than delta) wait in an overflow list.
+struct alignas(64) OwnerState {
+    std::vector<std::vector<NodeIndex>> buckets;
+    std::vector<std::pair<size_t, NodeIndex>> overflow;  // (bucket, node)
+    size_t overflowMin = SIZE_MAX;                       // Lowest bucket in overflow
+    size_t current = 0;                                  // Bucket being settled
+    std::vector<NodeIndex> taken;    // Nodes taken from the current bucket this round
+    std::vector<NodeIndex> settled;  // Nodes taken from the current bucket so far
+
+    std::vector<NodeIndex>& slot(size_t bucket) {
+        return buckets[bucket % buckets.size()];
+    }
+
+    void insert(size_t bucket, NodeIndex node) {
+        if (bucket - current < buckets.size()) {
+            slot(bucket).push_back(node);
+        } else {
+            overflow.emplace_back(bucket, node);
+            overflowMin = std::min(overflowMin, bucket);
+        }
+    }
+
+    // Lowest non-empty bucket at or after the current one, or SIZE_MAX
+    size_t firstBucket() const {
+        for (size_t bucket = current; bucket < current + buckets.size(); ++bucket) {
+            if (bucket >= overflowMin) {
+                break;
+            }
+            if (!buckets[bucket % buckets.size()].empty()) {
+                return bucket;
+            }
+        }
+        return overflowMin;
+    }
+
+    // Make `bucket` current, moving the overflow entries that now fit a slot
+    void advance(size_t bucket) {
+        current = bucket;
+        if (overflowMin - current >= buckets.size()) {
+            return;
+        }
+        size_t kept = 0;
+        overflowMin = SIZE_MAX;
+        for (const auto& [entryBucket, node] : overflow) {
+            if (entryBucket - current < buckets.size()) {
+                slot(entryBucket).push_back(node);
+            } else {
+                overflow[kept++] = {entryBucket, node};
+                overflowMin = std::min(overflowMin, entryBucket);
+            }
+        }
+        overflow.resize(kept);
+    }
+};
+
+double maxEdgeWeight(const GraphSnapshot& graph) {
+    double heaviest = 0;
+    for (EdgeIndex edge = 0; edge < graph.edgeCount(); ++edge) {
+        heaviest = std::max(heaviest, graph.weight(edge));
+    }
+    return heaviest;
+}
+
+double meanEdgeWeight(const GraphSnapshot& graph) {
+    double total = 0;
+    for (EdgeIndex edge = 0; edge < graph.edgeCount(); ++edge) {
+        total += graph.weight(edge);
+    }
+    return graph.edgeCount() > 0 ? total / graph.edgeCount() : 0;
+}
+
+void appendNodeId(
+    bsoncxx::builder::stream::array& array,
+    const GraphSnapshot& graph,
+    NodeIndex node) {
+    if (graph.idType() == GraphSnapshot::IdType::kObjectId) {
+        array << graph.nodeOid(node);
+    } else {
+        array << graph.nodeId(node);
+    }
+}
+
+} // namespace
+
+bsoncxx::document::value DistanceMap::toBSON(const GraphSnapshot& graph) const {
+    using namespace bsoncxx::builder::stream;
+
+    array nodeArray;
+    array distanceArray;
+    array parentArray;
+    array depthArray;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        appendNodeId(nodeArray, graph, nodes[i]);
+        distanceArray << distances[i];
+        parentArray << parents[i];
+        depthArray << depths[i];
+    }
+
+    document doc;
+    if (source == GraphSnapshot::kInvalidNode) {
+        doc << "source" << bsoncxx::types::b_null{};
+    } else if (graph.idType() == GraphSnapshot::IdType::kObjectId) {
+        doc << "source" << graph.nodeOid(source);
+    } else {
+        doc << "source" << graph.nodeId(source);
+    }
+    doc << "reachedCount" << static_cast<int32_t>(nodes.size())
+        << "nodes" << nodeArray
+        << "distances" << distanceArray
+        << "parents" << parentArray
+        << "depths" << depthArray;
+    return doc << finalize;
+}
+
+DistanceMap deltaSteppingDistances(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    NodeIndex source,
+    double maxCost,
+    int maxDepth,
+    double delta) {
+
+    DistanceMap result;
+    if (source == GraphSnapshot::kInvalidNode || source >= graph.nodeCount() || maxCost < 0) {
+        return result;
+    }
+    result.source = source;
+
+    if (!(delta > 0) || !std::isfinite(delta)) {
+        delta = meanEdgeWeight(graph);
+        if (delta <= 0) {
+            delta = 1;
+        }
+    }
+    auto bucketOf = [delta](double distance) {
+        return static_cast<size_t>(distance / delta);
+    };
+
+    size_t nodeCount = graph.nodeCount();
+    size_t owners = pool.threadCount();
+    auto ownerOf = [owners](NodeIndex node) { return node % owners; };
+
+    // Only the owner of a node writes its entries, during the apply steps;
+    // the generate steps read them, separated by the end of each parallelFor
+    constexpr double kInfinity = std::numeric_limits<double>::infinity();
+    std::vector<double> distance(nodeCount, kInfinity);
+    std::vector<NodeIndex> parent(nodeCount, GraphSnapshot::kInvalidNode);
+    std::vector<int32_t> depth(nodeCount, 0);
+    std::vector<uint32_t> takenRound(nodeCount, 0);    // Last round that took the node
+    std::vector<uint32_t> settledBucket(nodeCount, 0);  // Last bucket that settled it
+
+    // Queued distances lie within the largest edge weight (and never beyond
+    // maxCost) of the current bucket; one spare slot covers rounding in
+    // bucketOf. Snapshots only hold finite weights, but one outlier edge can
+    // make the span huge, so it is capped and the rest overflows.
+    double span = std::ceil(maxEdgeWeight(graph) / delta);
+    if (maxCost < std::numeric_limits<double>::max()) {
+        span = std::min(span, std::ceil(maxCost / delta));
+    }
+    size_t slots = span + 2 < kMaxBucketSlots ? static_cast<size_t>(span) + 2 : kMaxBucketSlots;
+    std::vector<OwnerState> ownerStates(owners);
+    for (auto& state : ownerStates) {
+        state.buckets.resize(slots);
+    }
+    // requests[worker][owner], written by one worker, applied by one owner
+    std::vector<std::vector<std::vector<Request>>> requests(
+        owners, std::vector<std::vector<Request>>(owners));
+
+    distance[source] = 0;
+    ownerStates[ownerOf(source)].insert(0, source);
+
+    // Send a request for every light (or heavy) edge of `nodes` that could
+    // improve its target
+    auto generate = [&](const std::vector<NodeIndex>& nodes, bool light) {
+        pool.parallelFor(nodes.size(), kRequestGrain, [&](size_t begin, size_t end, size_t worker) {
+            auto& outbox = requests[worker];
+            for (size_t i = begin; i < end; ++i) {
+                NodeIndex current = nodes[i];
+                if (depth[current] >= maxDepth) {
+                    continue;
+                }
+                int32_t nextDepth = depth[current] + 1;
+                for (EdgeIndex edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+                    double weight = graph.weight(edge);
+                    if ((weight <= delta) != light) {
+                        continue;
+                    }
+                    double candidate = distance[current] + weight;
+                    NodeIndex next = graph.target(edge);
+                    if (candidate > maxCost || candidate > distance[next] ||
+                        (candidate == distance[next] && nextDepth >= depth[next])) {
+                        continue;
+                    }
+                    outbox[ownerOf(next)].push_back({next, current, candidate, nextDepth});
+                }
+            }
+        });
+    };
+
+    // Every owner applies the requests for its nodes, moving improved nodes
+    // to the bucket of their new distance
+    auto apply = [&]() {
+        pool.parallelFor(owners, 1, [&](size_t begin, size_t end, size_t) {
+            for (size_t owner = begin; owner < end; ++owner) {
+                for (auto& outbox : requests) {
+                    for (const Request& request : outbox[owner]) {
+                        NodeIndex node = request.node;
+                        if (request.distance < distance[node] ||
+                            (request.distance == distance[node] && request.depth < depth[node])) {
+                            distance[node] = request.distance;
+                            parent[node] = request.from;
+                            depth[node] = request.depth;
+                            ownerStates[owner].insert(bucketOf(request.distance), node);
+                        }
+                    }
+                    outbox[owner].clear();
+                }
+            }
+        });
+    };
+
+    std::vector<NodeIndex> frontier;
+    size_t bucket = 0;
+    uint32_t round = 0;
+    uint32_t bucketRound = 0;
+    while (true) {
+        size_t next = SIZE_MAX;
+        for (const auto& state : ownerStates) {
+            next = std::min(next, state.firstBucket());
+        }
+        if (next == SIZE_MAX) {
+            break;
+        }
+        bucket = next;
+        for (auto& state : ownerStates) {
+            state.advance(bucket);
+        }
+        ++bucketRound;
+
+        // Light edges can refill the current bucket, so it is emptied in rounds
+        while (true) {
+            ++round;
+            pool.parallelFor(owners, 1, [&](size_t begin, size_t end, size_t) {
+                for (size_t owner = begin; owner < end; ++owner) {
+                    OwnerState& state = ownerStates[owner];
+                    state.taken.clear();
+                    std::vector<NodeIndex>& queued = state.slot(bucket);
+                    for (NodeIndex node : queued) {
+                        // Skip entries left behind by a later improvement
+                        if (bucketOf(distance[node]) != bucket || takenRound[node] == round) {
+                            continue;
+                        }
+                        takenRound[node] = round;
+                        state.taken.push_back(node);
+                        if (settledBucket[node] != bucketRound) {
+                            settledBucket[node] = bucketRound;
+                            state.settled.push_back(node);
+                        }
+                    }
+                    queued.clear();
+                }
+            });
+
+            frontier.clear();
+            for (const auto& state : ownerStates) {
+                frontier.insert(frontier.end(), state.taken.begin(), state.taken.end());
+            }
+            if (frontier.empty()) {
+                break;
+            }
+            generate(frontier, true);
+            apply();
+        }
+
+        // Heavy edges leave the bucket, so they are relaxed once per node
+        frontier.clear();
+        for (auto& state : ownerStates) {
+            frontier.insert(frontier.end(), state.settled.begin(), state.settled.end());
+            state.settled.clear();
+        }
+        generate(frontier, false);
+        apply();
+    }
+
+    // Compact the reached nodes into arrays sorted by distance
+    for (NodeIndex node = 0; node < nodeCount; ++node) {
+        if (distance[node] != kInfinity) {
+            result.nodes.push_back(node);
+        }
+    }
+    std::sort(result.nodes.begin(), result.nodes.end(), [&](NodeIndex a, NodeIndex b) {
+        if (distance[a] != distance[b]) {
+            return distance[a] < distance[b];
+        }
+        if (depth[a] != depth[b]) {
+            return depth[a] < depth[b];
+        }
+        return a < b;
+    });
+
+    std::vector<int32_t> position(nodeCount, -1);
+    for (size_t i = 0; i < result.nodes.size(); ++i) {
+        position[result.nodes[i]] = static_cast<int32_t>(i);
+    }
+    for (NodeIndex node : result.nodes) {
+        result.distances.push_back(distance[node]);
+        result.parents.push_back(
+            parent[node] == GraphSnapshot::kInvalidNode ? -1 : position[parent[node]]);
+        result.depths.push_back(depth[node]);
+    }
+
+    return result;
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <bsoncxx/document/value.hpp>
+#include <limits>
+#include <vector>
+#include "graph_snapshot.h"
+#include "thread_pool.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Shortest distances from one source to every node within a radius, as
+ * parallel arrays sorted by distance (source first). parents[i] is the
+ * position in `nodes` of the node before nodes[i] on its shortest path, or
+ * -1 for the source, so the whole shortest-path tree fits in three arrays.
+ */
+struct DistanceMap {
+    GraphSnapshot::NodeIndex source = GraphSnapshot::kInvalidNode;
+    std::vector<GraphSnapshot::NodeIndex> nodes;
+    std::vector<double> distances;
+    std::vector<int32_t> parents;
+    std::vector<int32_t> depths;  // Edges on each shortest path
+
+    size_t size() const { return nodes.size(); }
+
+    /**
+     * {source, reachedCount, nodes: [ids], distances: [...], parents: [...],
+     * depths: [...]}, with node ids in the snapshot's id type
+     */
+    bsoncxx::document::value toBSON(const GraphSnapshot& graph) const;
+};
+
+/**
+ * Single-source shortest paths over a snapshot with parallel delta-stepping
+ * (Meyer and Sanders). Nodes are kept in buckets of width `delta` by
+ * tentative distance; the lowest bucket is settled in rounds that relax the
+ * light edges (weight <= delta) of all its nodes in parallel until it stays
+ * empty, then its heavy edges once. Every node is owned by one worker, which
+ * applies all relaxation requests for it, so distances, parents and hop
+ * counts are updated together without atomics.
+ *
+ * Only nodes at distance <= maxCost are reached. As in findWeightedPathImpl,
+ * a node whose shortest path already has maxDepth edges is not expanded.
+ * Ties in distance go to the path with fewer edges. delta == 0 uses the mean
+ * edge weight.
+ */
+DistanceMap deltaSteppingDistances(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    GraphSnapshot::NodeIndex source,
+    double maxCost = std::numeric_limits<double>::infinity(),
+    int maxDepth = std::numeric_limits<int>::max(),
+    double delta = 0);
+
+} // namespace graph_extension
+} // namespace mongo
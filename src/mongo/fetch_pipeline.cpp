@@ -0,0 +1,166 @@
+#include "fetch_pipeline.h"
+#include <utility>
+#include <mongocxx/client.hpp>
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+// Documents handed to the traversal at a time
+constexpr size_t kDocumentsPerBatch = 256;
+
+} // namespace
+
+FetchPipeline::FetchPipeline(
+    mongocxx::pool::entry client,
+    std::string dbName,
+    std::string collectionName,
+    size_t queueCapacity)
+    : _client(std::move(client)),
+      _dbName(std::move(dbName)),
+      _collectionName(std::move(collectionName)),
+      _queueCapacity(queueCapacity > 0 ? queueCapacity : kDefaultPrefetchQueueCapacity),
+      _worker(&FetchPipeline::workerLoop, this) {}
+
+FetchPipeline::~FetchPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _work.notify_all();
+    _space.notify_all();
+    _worker.join();
+}
+
+void FetchPipeline::submit(
+    bsoncxx::document::value filter,
+    const mongocxx::options::find& options) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queries.push_back(Query{std::move(filter), options});
+        ++_outstanding;
+    }
+    _work.notify_one();
+}
+
+bool FetchPipeline::nextBatch(std::vector<bsoncxx::document::value>& batch) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _ready.wait(lock, [&] { return !_results.empty() || _outstanding == 0 || _error; });
+    if (_error) {
+        std::exception_ptr error = std::move(_error);
+        _error = nullptr;
+        lock.unlock();
+        cancel();
+        std::rethrow_exception(error);
+    }
+    if (_results.empty()) {
+        return false;
+    }
+    batch = std::move(_results.front());
+    _results.pop_front();
+    lock.unlock();
+    _space.notify_one();
+    return true;
+}
+
+bool FetchPipeline::tryNextBatch(std::vector<bsoncxx::document::value>& batch) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_results.empty()) {
+        return false;
+    }
+    batch = std::move(_results.front());
+    _results.pop_front();
+    lock.unlock();
+    _space.notify_one();
+    return true;
+}
+
+void FetchPipeline::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_generation;
+        _queries.clear();
+        _results.clear();
+        _outstanding = 0;
+    }
+    _space.notify_all();
+}
+
+int FetchPipeline::takeRoundTrips() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    int roundTrips = _roundTrips;
+    _roundTrips = 0;
+    return roundTrips;
+}
+
+bool FetchPipeline::push(std::vector<bsoncxx::document::value>& batch, uint64_t generation) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _space.wait(lock, [&] {
+        return _stopping || generation != _generation || _results.size() < _queueCapacity;
+    });
+    if (_stopping || generation != _generation) {
+        return false;
+    }
+    _results.push_back(std::move(batch));
+    batch.clear();
+    lock.unlock();
+    _ready.notify_one();
+    return true;
+}
+
+void FetchPipeline::workerLoop() {
+    auto collection = (*_client)[_dbName][_collectionName];
+
+    while (true) {
+        Query query{bsoncxx::document::value(bsoncxx::document::view{}), {}};
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work.wait(lock, [&] { return _stopping || !_queries.empty(); });
+            if (_stopping) {
+                return;
+            }
+            query = std::move(_queries.front());
+            _queries.pop_front();
+            generation = _generation;
+        }
+
+        try {
+            auto cursor = collection.find(query.filter.view(), query.options);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                ++_roundTrips;
+            }
+
+            std::vector<bsoncxx::document::value> batch;
+            bool abandoned = false;
+            for (auto&& doc : cursor) {
+                batch.emplace_back(doc);
+                if (batch.size() == kDocumentsPerBatch && !push(batch, generation)) {
+                    abandoned = true;
+                    break;
+                }
+            }
+            if (!abandoned && !batch.empty()) {
+                push(batch, generation);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (generation == _generation) {
+                _error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (generation == _generation && _outstanding > 0) {
+                --_outstanding;
+            }
+        }
+        _ready.notify_one();
+    }
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/pool.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Default number of document batches the fetch stage may buffer before it
+ * waits for the traversal to catch up
+ */
+constexpr size_t kDefaultPrefetchQueueCapacity = 8;
+
+/**
+ * Background fetch stage for the driver-side searches.
+ *
+ * Queries submitted by the traversal run on a worker thread with a client of
+ * its own, a second entry of the caller's pool, so the server works on the
+ * next level while the caller is still expanding the current one. Their documents come
+ * back, in submission order, through a bounded queue of batches; the worker
+ * pauses while the queue is full.
+ */
+class FetchPipeline {
+public:
+    FetchPipeline(
+        mongocxx::pool::entry client,
+        std::string dbName,
+        std::string collectionName,
+        size_t queueCapacity = kDefaultPrefetchQueueCapacity);
+
+    // Abandons queued queries and joins the worker
+    ~FetchPipeline();
+
+    FetchPipeline(const FetchPipeline&) = delete;
+    FetchPipeline& operator=(const FetchPipeline&) = delete;
+
+    void submit(bsoncxx::document::value filter, const mongocxx::options::find& options);
+
+    /**
+     * Wait for the next batch of documents. Returns false once every
+     * submitted query has been read in full. Rethrows a driver error raised
+     * on the worker.
+     */
+    bool nextBatch(std::vector<bsoncxx::document::value>& batch);
+
+    /**
+     * Take a batch only if one is already buffered, so the caller can make
+     * room in the queue between units of its own work
+     */
+    bool tryNextBatch(std::vector<bsoncxx::document::value>& batch);
+
+    /**
+     * Drop queued queries and buffered documents, e.g. once the target has
+     * been found; the pipeline can be reused afterwards
+     */
+    void cancel();
+
+    /**
+     * Queries sent to the server since the last call
+     */
+    int takeRoundTrips();
+
+private:
+    struct Query {
+        bsoncxx::document::value filter;
+        mongocxx::options::find options;
+    };
+
+    void workerLoop();
+
+    // Queue a batch of the query started in `generation`; false if that
+    // query was cancelled or the pipeline is stopping
+    bool push(std::vector<bsoncxx::document::value>& batch, uint64_t generation);
+
+    mongocxx::pool::entry _client;  // Used by the worker only
+    std::string _dbName;
+    std::string _collectionName;
+    size_t _queueCapacity;
+
+    std::mutex _mutex;
+    std::condition_variable _work;   // Worker: a query was submitted
+    std::condition_variable _space;  // Worker: the result queue has room
+    std::condition_variable _ready;  // Caller: results or completion
+    std::deque<Query> _queries;
+    std::deque<std::vector<bsoncxx::document::value>> _results;
+    size_t _outstanding = 0;   // Submitted queries not yet read in full
+    uint64_t _generation = 0;  // Bumped by cancel() to orphan running queries
+    int _roundTrips = 0;
+    std::exception_ptr _error;
+    bool _stopping = false;
+
+    std::thread _worker;
+};
+
+} // namespace graph_extension
+} // namespace mongo
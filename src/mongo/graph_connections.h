@@ -0,0 +1,80 @@
+#pragma once
+
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <bsoncxx/types.hpp>
+#include <cmath>
+#include <string>
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Read a numeric edge weight; edges without one count as weight 1
+ */
+inline double readEdgeWeight(const bsoncxx::document::element& element) {
+    if (!element) {
+        return 1.0;
+    }
+    switch (element.type()) {
+        case bsoncxx::type::k_int32:
+            return element.get_int32().value;
+        case bsoncxx::type::k_int64:
+            return static_cast<double>(element.get_int64().value);
+        case bsoncxx::type::k_double:
+            return element.get_double().value;
+        default:
+            return 1.0;
+    }
+}
+
+/**
+ * Weights the searches can use: Dijkstra needs them non-negative, and an
+ * infinite or NaN weight breaks every distance sum through the edge
+ */
+inline bool isUsableEdgeWeight(double weight) {
+    return std::isfinite(weight) && weight >= 0;
+}
+
+/**
+ * Node ids of one snapshot must share a BSON type so their interned keys
+ * cannot collide
+ */
+inline bool isNodeIdType(bsoncxx::type type) {
+    return type == bsoncxx::type::k_string || type == bsoncxx::type::k_oid;
+}
+
+/**
+ * Visit the neighbor ids referenced by a node document's connection array.
+ * Handles both direct ObjectId references and embedded connection documents
+ * that hold the neighbor id in connectFromField; the visitor receives the
+ * neighbor id and the embedded document (empty for direct references).
+ */
+template <typename Visitor>
+void forEachConnection(
+    const bsoncxx::document::view& nodeDoc,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    Visitor&& visit) {
+
+    auto connections = nodeDoc[connectToField];
+    if (!connections || connections.type() != bsoncxx::type::k_array) {
+        return;
+    }
+
+    for (auto&& connValue : connections.get_array().value) {
+        if (connValue.type() == bsoncxx::type::k_oid) {
+            visit(connValue.get_oid().value, bsoncxx::document::view{});
+        } else if (connValue.type() == bsoncxx::type::k_document) {
+            auto embedded = connValue.get_document().view();
+            auto neighbor = embedded[connectFromField];
+            if (neighbor && neighbor.type() == bsoncxx::type::k_oid) {
+                visit(neighbor.get_oid().value, embedded);
+            }
+        }
+        // Anything else is an invalid connection and is skipped
+    }
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -1,11 +1,416 @@
 #include "graph_extension.h"
+#include "fetch_pipeline.h"
 #include "path_finding.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <bsoncxx/builder/stream/array.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/options/change_stream.hpp>
+#include <mongocxx/options/insert.hpp>
 
 namespace mongo {
 namespace graph_extension {
 
+namespace {
+
+// How long a change stream read waits for events, bounding how long
+// stopping a watcher takes
+constexpr std::chrono::milliseconds kChangeStreamAwait{500};
+
+// Pause before a failed change stream is reopened
+constexpr std::chrono::seconds kChangeStreamRetryDelay{1};
+
+bool isInvalidateEvent(const bsoncxx::document::view& event) {
+    auto operationType = event["operationType"];
+    return operationType && operationType.type() == bsoncxx::type::k_string &&
+           operationType.get_string().value == "invalidate";
+}
+
+} // namespace
+
+struct GraphExtension::ChangeWatcher {
+    // Called with the collection whenever a stream opens without a resume
+    // token, i.e. when earlier writes may have been missed
+    std::function<void(mongocxx::collection&)> onOpen;
+    // Returns false if the stream must be reopened from scratch
+    std::function<bool(const bsoncxx::document::view&)> onEvent;
+    // Called after every event and every read that returned none
+    std::function<void()> onTick;
+
+    mongocxx::pool::entry client;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+};
+
 GraphExtension::GraphExtension(mongocxx::client& client) 
-    : _client(client) {}
+    : _client(&client), _pool(nullptr), _fetchBatchSize(kDefaultFetchBatchSize) {}
+
+GraphExtension::GraphExtension(mongocxx::pool& pool)
+    : _client(nullptr), _pool(&pool), _fetchBatchSize(kDefaultFetchBatchSize) {}
+
+GraphExtension::~GraphExtension() {
+    std::lock_guard<std::mutex> lock(_watchersMutex);
+    for (auto& [ns, watcher] : _watchers) {
+        watcher->stop();
+    }
+}
+
+void GraphExtension::setFetchBatchSize(size_t batchSize) {
+    _fetchBatchSize = batchSize > 0 ? batchSize : kDefaultFetchBatchSize;
+}
+
+void GraphExtension::setThreadCount(size_t threadCount) {
+    auto pool = std::make_shared<ThreadPool>(threadCount);
+    std::lock_guard<std::mutex> lock(_threadPoolMutex);
+    _threadPool = std::move(pool);
+}
+
+std::shared_ptr<ThreadPool> GraphExtension::threadPool() {
+    std::lock_guard<std::mutex> lock(_threadPoolMutex);
+    if (!_threadPool) {
+        _threadPool = std::make_shared<ThreadPool>();
+    }
+    return _threadPool;
+}
+
+void GraphExtension::setResultCacheCapacity(size_t maxEntries) {
+    _resultCache.setCapacity(maxEntries);
+}
+
+ResultCacheStats GraphExtension::getResultCacheStats() const {
+    return _resultCache.stats();
+}
+
+void GraphExtension::clearResultCache() {
+    _resultCache.clear();
+}
+
+Path GraphExtension::cachedNodePath(
+    mongocxx::collection& collection,
+    const std::string& dbName,
+    const std::string& collectionName,
+    const char* algorithm,
+    const bsoncxx::oid& startNodeId,
+    const bsoncxx::oid& endNodeId,
+    int maxDepth,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    const std::function<Path()>& search) {
+    
+    std::string ns = namespaceKey(dbName, collectionName);
+    std::string key = PathResultCache::makeKey(
+        algorithm, startNodeId.to_string(), endNodeId.to_string(), maxDepth,
+        adjacencyKey(connectToField, connectFromField));
+    
+    CachedPath cached;
+    uint64_t version;
+    if (_resultCache.lookup(ns, key, cached, version)) {
+        if (!cached.found) {
+            Path path;
+            path.fromCache = true;
+            return path;
+        }
+        Path path = hydrateNodePath(collection, cached.nodeOids(), connectFromField);
+        if (!path.nodes.empty()) {
+            path.fromCache = true;
+            return path;
+        }
+        // A path document is gone; the change has not been reported yet
+    }
+    
+    Path path = search();
+    _resultCache.insert(ns, key, CachedPath::fromPath(path, connectFromField), version);
+    return path;
+}
+
+Path GraphExtension::cachedWeightedPath(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const char* algorithm,
+    const std::string& start,
+    const std::string& end,
+    int maxDepth,
+    const std::string& fields,
+    const std::function<Path()>& search) {
+    
+    std::string ns = namespaceKey(dbName, collectionName);
+    std::string key = PathResultCache::makeKey(algorithm, start, end, maxDepth, fields);
+    
+    CachedPath cached;
+    uint64_t version;
+    if (_resultCache.lookup(ns, key, cached, version)) {
+        Path path = cached.toWeightedPath();
+        path.fromCache = true;
+        return path;
+    }
+    
+    Path path = search();
+    _resultCache.insert(ns, key, CachedPath::fromPath(path, "nodeId"), version);
+    return path;
+}
+
+bool GraphExtension::watchChanges(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::vector<std::string>& nodeFields,
+    const std::string& weightField) {
+    
+    if (!_pool) {
+        return false;
+    }
+    
+    std::string ns = namespaceKey(dbName, collectionName);
+    auto watcher = std::make_unique<ChangeWatcher>();
+    watcher->onOpen = [this, ns](mongocxx::collection&) {
+        // Writes made before the stream opened were never seen
+        _resultCache.invalidateNamespace(ns);
+    };
+    watcher->onEvent = [this, dbName, collectionName, nodeFields, weightField](
+                           const bsoncxx::document::view& event) {
+        applyChangeEvent(dbName, collectionName, event, nodeFields, weightField);
+        return true;
+    };
+    startWatcher(ns, dbName, collectionName, std::move(watcher));
+    return true;
+}
+
+void GraphExtension::stopWatchingChanges(
+    const std::string& dbName,
+    const std::string& collectionName) {
+    stopWatchers(namespaceKey(dbName, collectionName), false);
+}
+
+bool GraphExtension::maintainSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField,
+    std::chrono::milliseconds compactInterval) {
+    return startMaintainer(
+        dbName, collectionName, fieldsKey(fromField, toField, weightField),
+        std::make_shared<SnapshotMaintainer>(
+            SnapshotMaintainer::Layout::kEdges, fromField, toField, weightField),
+        compactInterval);
+}
+
+bool GraphExtension::maintainAdjacencySnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    std::chrono::milliseconds compactInterval) {
+    return startMaintainer(
+        dbName, collectionName, adjacencyKey(connectToField, connectFromField),
+        std::make_shared<SnapshotMaintainer>(
+            SnapshotMaintainer::Layout::kAdjacency, connectToField, connectFromField, "weight"),
+        compactInterval);
+}
+
+void GraphExtension::stopMaintainingSnapshots(
+    const std::string& dbName,
+    const std::string& collectionName) {
+    stopWatchers(namespaceKey(dbName, collectionName) + "|", true);
+}
+
+bool GraphExtension::startMaintainer(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key,
+    std::shared_ptr<SnapshotMaintainer> maintainer,
+    std::chrono::milliseconds compactInterval) {
+    
+    if (!_pool) {
+        return false;
+    }
+    
+    // Only the watcher thread touches the maintainer and the clock
+    auto lastPublished = std::make_shared<std::chrono::steady_clock::time_point>();
+    auto publish = [this, dbName, collectionName, key, maintainer, lastPublished]() {
+        // Queries keep the snapshot they started with; new ones get this one
+        publishMaintainedSnapshot(dbName, collectionName, key, maintainer->compact());
+        *lastPublished = std::chrono::steady_clock::now();
+    };
+    
+    auto watcher = std::make_unique<ChangeWatcher>();
+    watcher->onOpen = [maintainer, publish](mongocxx::collection& collection) {
+        maintainer->load(collection);
+        publish();
+    };
+    watcher->onEvent = [maintainer](const bsoncxx::document::view& event) {
+        return maintainer->applyEvent(event);
+    };
+    watcher->onTick = [maintainer, publish, lastPublished, compactInterval]() {
+        if (maintainer->pendingChanges() > 0 &&
+            std::chrono::steady_clock::now() - *lastPublished >= compactInterval) {
+            publish();
+        }
+    };
+    startWatcher(namespaceKey(dbName, collectionName) + "|" + key,
+                 dbName, collectionName, std::move(watcher));
+    return true;
+}
+
+void GraphExtension::startWatcher(
+    const std::string& watcherKey,
+    const std::string& dbName,
+    const std::string& collectionName,
+    std::unique_ptr<ChangeWatcher> watcher) {
+    
+    watcher->client = _pool->acquire();
+    watcher->thread = std::thread(
+        &GraphExtension::watchLoop, this, std::ref(*watcher), dbName, collectionName);
+    
+    std::unique_ptr<ChangeWatcher> previous;
+    {
+        std::lock_guard<std::mutex> lock(_watchersMutex);
+        auto& slot = _watchers[watcherKey];
+        previous = std::move(slot);
+        slot = std::move(watcher);
+    }
+    if (previous) {
+        previous->stop();
+    }
+}
+
+void GraphExtension::stopWatchers(const std::string& watcherKey, bool prefix) {
+    std::vector<std::unique_ptr<ChangeWatcher>> stopped;
+    {
+        std::lock_guard<std::mutex> lock(_watchersMutex);
+        for (auto it = _watchers.begin(); it != _watchers.end();) {
+            bool matches = prefix ? it->first.compare(0, watcherKey.size(), watcherKey) == 0
+                                  : it->first == watcherKey;
+            if (matches) {
+                stopped.push_back(std::move(it->second));
+                it = _watchers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // Joined outside the lock: a maintainer may be publishing a snapshot
+    for (auto& watcher : stopped) {
+        watcher->stop();
+    }
+}
+
+size_t GraphExtension::applyChangeEvent(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const bsoncxx::document::view& event,
+    const std::vector<std::string>& nodeFields,
+    const std::string& weightField) {
+    
+    std::string ns = namespaceKey(dbName, collectionName);
+    std::vector<std::string> nodeIds;
+    if (!changedNodeIds(event, nodeFields, weightField, nodeIds)) {
+        return _resultCache.invalidateNamespace(ns);
+    }
+    return nodeIds.empty() ? 0 : _resultCache.invalidateNodes(ns, nodeIds);
+}
+
+void GraphExtension::watchLoop(
+    ChangeWatcher& watcher,
+    const std::string& dbName,
+    const std::string& collectionName) {
+    
+    auto collection = (*watcher.client)[dbName][collectionName];
+    
+    // Position of the last event read, so a failed stream resumes without
+    // losing events
+    std::optional<bsoncxx::document::value> resumeToken;
+    
+    while (!watcher.stopping) {
+        bool progressed = false;
+        try {
+            mongocxx::options::change_stream options;
+            options.full_document("updateLookup");
+            // Pre-images make deletes precise on collections that record them
+            options.full_document_before_change("whenAvailable");
+            options.max_await_time(kChangeStreamAwait);
+            if (resumeToken) {
+                options.resume_after(resumeToken->view());
+            }
+            
+            auto stream = collection.watch(options);
+            if (!resumeToken && watcher.onOpen) {
+                watcher.onOpen(collection);
+            }
+            
+            bool restart = false;
+            while (!watcher.stopping && !restart) {
+                for (auto&& event : stream) {
+                    // Nothing follows an invalidate event on the same stream
+                    restart = !watcher.onEvent(event) || isInvalidateEvent(event);
+                    if (watcher.onTick) {
+                        watcher.onTick();
+                    }
+                    if (restart || watcher.stopping) {
+                        break;
+                    }
+                }
+                progressed = true;
+                if (auto token = stream.get_resume_token()) {
+                    resumeToken.emplace(*token);
+                }
+                if (watcher.onTick) {
+                    watcher.onTick();
+                }
+            }
+            if (restart) {
+                resumeToken.reset();
+            }
+        } catch (const std::exception&) {
+            // A token the server can no longer resume from must not be
+            // retried forever; without one the next stream starts afresh
+            if (!progressed) {
+                resumeToken.reset();
+            }
+            std::unique_lock<std::mutex> lock(watcher.mutex);
+            watcher.wake.wait_for(lock, kChangeStreamRetryDelay,
+                                  [&] { return watcher.stopping.load(); });
+        }
+    }
+}
+
+std::unique_ptr<FetchPipeline> GraphExtension::makeFetchPipeline(
+    const std::string& dbName,
+    const std::string& collectionName) const {
+    if (!_pool) {
+        return nullptr;
+    }
+    // Never wait for the second connection: with the pool exhausted the
+    // search simply fetches on its own
+    auto client = _pool->try_acquire();
+    if (!client) {
+        return nullptr;
+    }
+    return std::make_unique<FetchPipeline>(std::move(*client), dbName, collectionName);
+}
+
+mongocxx::pool::entry GraphExtension::acquireClient() const {
+    if (_pool) {
+        return _pool->acquire();
+    }
+    // Borrow the caller's client; the entry must not delete it
+    return mongocxx::pool::entry(_client, [](mongocxx::client*) {});
+}
 
 bsoncxx::document::value GraphExtension::findPath(
     const std::string& dbName,
@@ -17,16 +422,34 @@ bsoncxx::document::value GraphExtension::findPath(
     int maxDepth) {
     
     // Get the collection
-    auto collection = _client[dbName][collectionName];
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
     
-    // Use path finding implementation
-    Path path = findBasicPath(
-        collection,
-        startNodeId,
-        endNodeId,
-        connectToField,
-        connectFromField,
-        maxDepth);
+    Path path = cachedNodePath(
+        collection, dbName, collectionName, "bfs", startNodeId, endNodeId, maxDepth,
+        connectToField, connectFromField, [&]() {
+            // With an adjacency snapshot loaded, search it in memory
+            auto adjacency = findSnapshot(
+                dbName, collectionName, adjacencyKey(connectToField, connectFromField));
+            if (adjacency) {
+                return findSnapshotPathImpl(
+                    collection, *adjacency, *threadPool(), startNodeId, endNodeId,
+                    connectFromField, maxDepth, false);
+            }
+            
+            std::unique_ptr<FetchPipeline> prefetch = makeFetchPipeline(dbName, collectionName);
+            
+            // Use path finding implementation
+            return findBasicPath(
+                collection,
+                startNodeId,
+                endNodeId,
+                connectToField,
+                connectFromField,
+                maxDepth,
+                _fetchBatchSize.load(),
+                prefetch.get());
+        });
     
     // Convert path to BSON
     return path.toBSON();
@@ -43,13 +466,302 @@ bsoncxx::document::value GraphExtension::findWeightedPath(
     const std::string& weight_field,
     int max_depth
 ) {
-    auto db = _client[db_name];
-    auto collection = db[collection_name];
-    Path path = findWeightedPathImpl(collection, start, end, connect_field, id_field, weight_field, max_depth);
+    Path path = cachedWeightedPath(
+        db_name, collection_name, "dijkstra", start, end, max_depth,
+        fieldsKey(connect_field, id_field, weight_field), [&]() {
+            auto graph = loadSnapshot(
+                db_name, collection_name, connect_field, id_field, weight_field);
+            return findWeightedPathImpl(*graph, start, end, max_depth);
+        });
+
+    return path.toBSON();
+}
+
+bsoncxx::document::value GraphExtension::findWeightedBidirectionalPath(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& start,
+    const std::string& end,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field,
+    int max_depth
+) {
+    Path path = cachedWeightedPath(
+        db_name, collection_name, "bidirectionalDijkstra", start, end, max_depth,
+        fieldsKey(connect_field, id_field, weight_field), [&]() {
+            auto graph = loadSnapshot(
+                db_name, collection_name, connect_field, id_field, weight_field);
+            return findWeightedBidirectionalPathImpl(*graph, start, end, max_depth);
+        });
+
+    return path.toBSON();
+}
+
+bsoncxx::document::value GraphExtension::findWeightedAltPath(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& start,
+    const std::string& end,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field,
+    int max_depth
+) {
+    Path path = cachedWeightedPath(
+        db_name, collection_name, "alt", start, end, max_depth,
+        fieldsKey(connect_field, id_field, weight_field), [&]() {
+            auto graph = loadSnapshot(
+                db_name, collection_name, connect_field, id_field, weight_field);
+            
+            auto landmarks = findOrBuildLandmarks(
+                db_name, collection_name, connect_field, id_field, weight_field, graph, false);
+            if (!landmarks) {
+                return findWeightedBidirectionalPathImpl(*graph, start, end, max_depth);
+            }
+            return findWeightedPathImpl(*graph, start, end, max_depth, landmarks.get());
+        });
+
+    return path.toBSON();
+}
+
+bsoncxx::document::value GraphExtension::findContractionHierarchyPath(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& start,
+    const std::string& end,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field
+) {
+    // Hierarchy queries have no hop limit, so every query shares depth 0
+    Path path = cachedWeightedPath(
+        db_name, collection_name, "contractionHierarchy", start, end, 0,
+        fieldsKey(connect_field, id_field, weight_field), [&]() {
+            auto graph = loadSnapshot(
+                db_name, collection_name, connect_field, id_field, weight_field);
+            auto hierarchy = findOrBuildContractionHierarchy(
+                db_name, collection_name, connect_field, id_field, weight_field, graph, false);
+            if (!hierarchy) {
+                return findWeightedBidirectionalPathImpl(
+                    *graph, start, end, std::numeric_limits<int>::max());
+            }
+            return findContractionHierarchyPathImpl(*graph, *hierarchy, start, end);
+        });
 
     return path.toBSON();
 }
 
+bsoncxx::document::value GraphExtension::findKShortestPaths(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& start,
+    const std::string& end,
+    size_t k,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field
+) {
+    using namespace bsoncxx::builder::stream;
+    
+    auto graph = loadSnapshot(db_name, collection_name, connect_field, id_field, weight_field);
+    std::vector<Path> paths = findKShortestPathsImpl(*graph, *threadPool(), start, end, k);
+    
+    array pathArray;
+    for (const auto& path : paths) {
+        pathArray << bsoncxx::types::b_document{path.toBSON().view()};
+    }
+    return document{}
+        << "pathCount" << static_cast<int32_t>(paths.size())
+        << "paths" << pathArray
+        << finalize;
+}
+
+namespace {
+
+// Document or filter value of a snapshot node id, in the snapshot's id type
+void appendNodeIdField(
+    bsoncxx::builder::stream::document& doc,
+    const std::string& field,
+    const GraphSnapshot& graph,
+    GraphSnapshot::NodeIndex node) {
+    if (graph.idType() == GraphSnapshot::IdType::kObjectId) {
+        doc << field << graph.nodeOid(node);
+    } else {
+        doc << field << graph.nodeId(node);
+    }
+}
+
+// Documents per insert_many call when writing distances back
+constexpr size_t kDistanceWriteBatchSize = 10000;
+
+} // namespace
+
+bsoncxx::document::value GraphExtension::findDistancesFrom(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& source,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field,
+    double max_cost,
+    int max_depth
+) {
+    auto graph = loadSnapshot(db_name, collection_name, connect_field, id_field, weight_field);
+    DistanceMap distances = deltaSteppingDistances(
+        *graph, *threadPool(), graph->findNode(source), max_cost, max_depth);
+
+    return distances.toBSON(*graph);
+}
+
+size_t GraphExtension::writeDistancesFrom(
+    const std::string& db_name,
+    const std::string& collection_name,
+    const std::string& source,
+    const std::string& output_collection_name,
+    const std::string& connect_field,
+    const std::string& id_field,
+    const std::string& weight_field,
+    double max_cost,
+    int max_depth
+) {
+    using bsoncxx::builder::stream::document;
+    using bsoncxx::builder::stream::finalize;
+    
+    auto graph = loadSnapshot(db_name, collection_name, connect_field, id_field, weight_field);
+    DistanceMap distances = deltaSteppingDistances(
+        *graph, *threadPool(), graph->findNode(source), max_cost, max_depth);
+    if (distances.source == GraphSnapshot::kInvalidNode) {
+        return 0;
+    }
+    
+    auto client = acquireClient();
+    auto output = (*client)[db_name][output_collection_name];
+    
+    document filter;
+    appendNodeIdField(filter, "source", *graph, distances.source);
+    output.delete_many((filter << finalize).view());
+    
+    mongocxx::options::insert opts;
+    opts.ordered(false);
+    
+    std::vector<bsoncxx::document::value> batch;
+    batch.reserve(std::min(distances.size(), kDistanceWriteBatchSize));
+    for (size_t i = 0; i < distances.size(); ++i) {
+        document doc;
+        appendNodeIdField(doc, "source", *graph, distances.source);
+        appendNodeIdField(doc, "node", *graph, distances.nodes[i]);
+        doc << "distance" << distances.distances[i]
+            << "depth" << distances.depths[i];
+        if (distances.parents[i] >= 0) {
+            appendNodeIdField(doc, "parent", *graph, distances.nodes[distances.parents[i]]);
+        }
+        batch.push_back(doc << finalize);
+        
+        if (batch.size() == kDistanceWriteBatchSize || i + 1 == distances.size()) {
+            output.insert_many(batch, opts);
+            batch.clear();
+        }
+    }
+    
+    return distances.size();
+}
+
+size_t GraphExtension::findPathsBatch(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::vector<std::pair<std::string, std::string>>& pairs,
+    PathAlgorithm algorithm,
+    const BatchOptions& options,
+    const BatchResultCallback& onResult) {
+    
+    // Everything the searches read is loaded up front, on this thread
+    auto graph = loadSnapshot(
+        dbName, collectionName, options.fromField, options.toField, options.weightField);
+    // Until preprocessing another thread is building is ready, bidirectional
+    // Dijkstra answers in its place (without a hop limit for hierarchies)
+    std::shared_ptr<const LandmarkTable> landmarks;
+    std::shared_ptr<const ContractionHierarchy> hierarchy;
+    int maxDepth = options.maxDepth;
+    if (algorithm == PathAlgorithm::kAlt) {
+        landmarks = findOrBuildLandmarks(
+            dbName, collectionName, options.fromField, options.toField, options.weightField,
+            graph, false);
+        if (!landmarks) {
+            algorithm = PathAlgorithm::kBidirectionalDijkstra;
+        }
+    } else if (algorithm == PathAlgorithm::kContractionHierarchy) {
+        hierarchy = findOrBuildContractionHierarchy(
+            dbName, collectionName, options.fromField, options.toField, options.weightField,
+            graph, false);
+        if (!hierarchy) {
+            algorithm = PathAlgorithm::kBidirectionalDijkstra;
+            maxDepth = std::numeric_limits<int>::max();
+        }
+    }
+    
+    // Group the pairs by start, in order of first appearance
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<std::string, size_t> groupOfStart;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        auto inserted = groupOfStart.emplace(pairs[i].first, groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+        }
+        groups[inserted.first->second].push_back(i);
+    }
+    
+    std::mutex resultMutex;
+    size_t found = 0;
+    auto deliver = [&](size_t pairIndex, const Path& path) {
+        auto result = path.toBSON();
+        std::lock_guard<std::mutex> lock(resultMutex);
+        found += path.found;
+        onResult(pairIndex, std::move(result));
+    };
+    
+    threadPool()->parallelFor(groups.size(), 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t g = begin; g < end; ++g) {
+            const auto& group = groups[g];
+            const std::string& start = pairs[group.front()].first;
+            
+            if (algorithm == PathAlgorithm::kDijkstra) {
+                // One search settles every end of the group
+                std::vector<std::string> ends;
+                for (size_t pairIndex : group) {
+                    ends.push_back(pairs[pairIndex].second);
+                }
+                auto paths = findWeightedPathsFromImpl(*graph, start, ends, maxDepth);
+                for (size_t i = 0; i < group.size(); ++i) {
+                    deliver(group[i], paths[i]);
+                }
+                continue;
+            }
+            
+            for (size_t pairIndex : group) {
+                const std::string& end = pairs[pairIndex].second;
+                Path path;
+                switch (algorithm) {
+                case PathAlgorithm::kBidirectionalDijkstra:
+                    path = findWeightedBidirectionalPathImpl(*graph, start, end, maxDepth);
+                    break;
+                case PathAlgorithm::kAlt:
+                    path = findWeightedPathImpl(*graph, start, end, maxDepth, landmarks.get());
+                    break;
+                case PathAlgorithm::kContractionHierarchy:
+                    path = findContractionHierarchyPathImpl(*graph, *hierarchy, start, end);
+                    break;
+                case PathAlgorithm::kDijkstra:
+                    break;
+                }
+                deliver(pairIndex, path);
+            }
+        }
+    });
+    
+    return found;
+}
+
 bsoncxx::document::value GraphExtension::findBidirectionalPath(
     const std::string& dbName,
     const std::string& collectionName,
@@ -60,20 +772,472 @@ bsoncxx::document::value GraphExtension::findBidirectionalPath(
     int maxDepth) {
     
     // Get the collection
-    auto collection = _client[dbName][collectionName];
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
     
-    // Use bidirectional path finding implementation
-    Path path = findBidirectionalPathImpl(
-        collection,
-        startNodeId,
-        endNodeId,
-        connectToField,
-        connectFromField,
-        maxDepth);
+    Path path = cachedNodePath(
+        collection, dbName, collectionName, "bidirectionalBfs", startNodeId, endNodeId,
+        maxDepth, connectToField, connectFromField, [&]() {
+            // Only use an adjacency snapshot that has been loaded explicitly
+            auto adjacency = findSnapshot(
+                dbName, collectionName, adjacencyKey(connectToField, connectFromField));
+            if (adjacency) {
+                return findSnapshotPathImpl(
+                    collection, *adjacency, *threadPool(), startNodeId, endNodeId,
+                    connectFromField, maxDepth, true);
+            }
+            
+            std::unique_ptr<FetchPipeline> prefetch = makeFetchPipeline(dbName, collectionName);
+            
+            // Use bidirectional path finding implementation
+            return findBidirectionalPathImpl(
+                collection,
+                startNodeId,
+                endNodeId,
+                connectToField,
+                connectFromField,
+                maxDepth,
+                _fetchBatchSize.load(),
+                prefetch.get());
+        });
     
     // Convert path to BSON
     return path.toBSON();
 }
 
+std::string GraphExtension::namespaceKey(
+    const std::string& dbName,
+    const std::string& collectionName) {
+    return dbName + "." + collectionName;
+}
+
+std::string GraphExtension::fieldsKey(
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    return fromField + "|" + toField + "|" + weightField;
+}
+
+std::string GraphExtension::adjacencyKey(
+    const std::string& connectToField,
+    const std::string& connectFromField) {
+    return "adjacency|" + connectToField + "|" + connectFromField;
+}
+
+GraphExtension::SnapshotEntry GraphExtension::findEntry(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key) const {
+    
+    std::shared_lock<std::shared_mutex> lock(_snapshotsMutex);
+    auto nsIt = _snapshots.find(namespaceKey(dbName, collectionName));
+    if (nsIt == _snapshots.end()) {
+        return {};
+    }
+    auto it = nsIt->second.find(key);
+    return it != nsIt->second.end() ? it->second : SnapshotEntry{};
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::findSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key) const {
+    return findEntry(dbName, collectionName, key).snapshot;
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::storeSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key,
+    std::shared_ptr<const GraphSnapshot> snapshot,
+    bool replace) {
+    
+    std::unique_lock<std::shared_mutex> lock(_snapshotsMutex);
+    SnapshotEntry& entry = _snapshots[namespaceKey(dbName, collectionName)][key];
+    if (entry.snapshot && !replace) {
+        // Another thread finished loading first; share its snapshot
+        return entry.snapshot;
+    }
+    // Landmark rows and hierarchy arcs use the old snapshot's node indices
+    entry = SnapshotEntry{std::move(snapshot), nullptr, nullptr};
+    // Cached results may come from the previous snapshot or the live collection
+    _resultCache.invalidateNamespace(namespaceKey(dbName, collectionName));
+    return entry.snapshot;
+}
+
+void GraphExtension::publishMaintainedSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key,
+    std::shared_ptr<const GraphSnapshot> snapshot) {
+    
+    // Landmark rows and hierarchy arcs use the old snapshot's node indices,
+    // so the new entry starts without them but marks them as coming
+    size_t landmarkCount = 0;
+    bool hierarchy = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(_snapshotsMutex);
+        SnapshotEntry& entry = _snapshots[namespaceKey(dbName, collectionName)][key];
+        if (entry.landmarks) {
+            landmarkCount = entry.landmarks->landmarkCount();
+        } else if (entry.landmarksPending) {
+            landmarkCount = kDefaultLandmarkCount;
+        }
+        hierarchy = entry.hierarchy || entry.hierarchyPending;
+        entry = SnapshotEntry{snapshot, nullptr, nullptr, landmarkCount > 0, hierarchy};
+        _resultCache.invalidateNamespace(namespaceKey(dbName, collectionName));
+    }
+    
+    // A swap that lands meanwhile carries the pending marks over, and its own
+    // rebuild follows this one on the same thread
+    if (landmarkCount > 0) {
+        std::shared_ptr<const LandmarkTable> landmarks =
+            LandmarkTable::build(*snapshot, landmarkCount, LandmarkSelection::kFarthest);
+        attachToSnapshot(dbName, collectionName, key, snapshot, [&](SnapshotEntry& entry) {
+            if (!entry.landmarks) {
+                entry.landmarks = landmarks;
+            }
+            entry.landmarksPending = false;
+        });
+    }
+    if (hierarchy) {
+        std::shared_ptr<const ContractionHierarchy> built = ContractionHierarchy::build(*snapshot);
+        attachToSnapshot(dbName, collectionName, key, snapshot, [&](SnapshotEntry& entry) {
+            if (!entry.hierarchy) {
+                entry.hierarchy = built;
+            }
+            entry.hierarchyPending = false;
+        });
+    }
+}
+
+bool GraphExtension::attachToSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& key,
+    const std::shared_ptr<const GraphSnapshot>& graph,
+    const std::function<void(SnapshotEntry&)>& attach) {
+    
+    std::unique_lock<std::shared_mutex> lock(_snapshotsMutex);
+    auto nsIt = _snapshots.find(namespaceKey(dbName, collectionName));
+    if (nsIt == _snapshots.end()) {
+        return false;
+    }
+    auto it = nsIt->second.find(key);
+    if (it == nsIt->second.end() || it->second.snapshot != graph) {
+        return false;  // Reloaded or dropped while the preprocessing ran
+    }
+    attach(it->second);
+    return true;
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::loadSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    std::string key = fieldsKey(fromField, toField, weightField);
+    if (auto snapshot = findSnapshot(dbName, collectionName, key)) {
+        return snapshot;
+    }
+    
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
+    return storeSnapshot(dbName, collectionName, key,
+        GraphSnapshot::load(collection, fromField, toField, weightField), false);
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::reloadSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
+    return storeSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField),
+        GraphSnapshot::load(collection, fromField, toField, weightField), true);
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::loadAdjacencySnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& connectToField,
+    const std::string& connectFromField) {
+    
+    std::string key = adjacencyKey(connectToField, connectFromField);
+    if (auto snapshot = findSnapshot(dbName, collectionName, key)) {
+        return snapshot;
+    }
+    
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
+    return storeSnapshot(dbName, collectionName, key,
+        GraphSnapshot::loadAdjacency(collection, connectToField, connectFromField), false);
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::reloadAdjacencySnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& connectToField,
+    const std::string& connectFromField) {
+    
+    auto client = acquireClient();
+    auto collection = (*client)[dbName][collectionName];
+    return storeSnapshot(dbName, collectionName, adjacencyKey(connectToField, connectFromField),
+        GraphSnapshot::loadAdjacency(collection, connectToField, connectFromField), true);
+}
+
+bool GraphExtension::exportSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    return graph->save(path);
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::mapSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField,
+    bool verifyChecksums) {
+    
+    auto graph = GraphSnapshot::map(path, verifyChecksums);
+    if (!graph) {
+        return nullptr;
+    }
+    return storeSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField),
+        std::move(graph), true);
+}
+
+bool GraphExtension::exportAdjacencySnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& connectToField,
+    const std::string& connectFromField) {
+    
+    auto graph = loadAdjacencySnapshot(dbName, collectionName, connectToField, connectFromField);
+    return graph->save(path);
+}
+
+std::shared_ptr<const GraphSnapshot> GraphExtension::mapAdjacencySnapshot(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    bool verifyChecksums) {
+    
+    auto graph = GraphSnapshot::map(path, verifyChecksums);
+    // Traversals look adjacency snapshots up by ObjectId
+    if (!graph || graph->idType() != GraphSnapshot::IdType::kObjectId) {
+        return nullptr;
+    }
+    return storeSnapshot(dbName, collectionName, adjacencyKey(connectToField, connectFromField),
+        std::move(graph), true);
+}
+
+std::shared_ptr<const LandmarkTable> GraphExtension::buildLandmarks(
+    const std::string& dbName,
+    const std::string& collectionName,
+    size_t landmarkCount,
+    LandmarkSelection selection,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    std::shared_ptr<const LandmarkTable> landmarks =
+        LandmarkTable::build(*graph, landmarkCount, selection);
+    attachToSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField), graph,
+        [&](SnapshotEntry& entry) { entry.landmarks = landmarks; });
+    return landmarks;
+}
+
+bool GraphExtension::saveLandmarks(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    
+    auto landmarks = findOrBuildLandmarks(
+        dbName, collectionName, fromField, toField, weightField, graph, true);
+    return landmarks->save(path, *graph);
+}
+
+std::shared_ptr<const LandmarkTable> GraphExtension::findOrBuildLandmarks(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField,
+    const std::shared_ptr<const GraphSnapshot>& graph,
+    bool buildWhilePending) {
+    
+    std::string key = fieldsKey(fromField, toField, weightField);
+    SnapshotEntry entry = findEntry(dbName, collectionName, key);
+    if (entry.snapshot == graph && entry.landmarks) {
+        return entry.landmarks;
+    }
+    
+    // The first thread to find none builds them; the others fall back
+    std::shared_ptr<const LandmarkTable> landmarks;
+    bool build = true;
+    attachToSnapshot(dbName, collectionName, key, graph, [&](SnapshotEntry& current) {
+        if (current.landmarks) {
+            landmarks = current.landmarks;
+        } else if (current.landmarksPending) {
+            build = buildWhilePending;
+        } else {
+            current.landmarksPending = true;
+        }
+    });
+    if (landmarks || !build) {
+        return landmarks;
+    }
+    
+    landmarks = LandmarkTable::build(*graph, kDefaultLandmarkCount, LandmarkSelection::kFarthest);
+    attachToSnapshot(dbName, collectionName, key, graph, [&](SnapshotEntry& current) {
+        if (current.landmarks) {
+            landmarks = current.landmarks;  // Built concurrently; keep the first
+        } else {
+            current.landmarks = landmarks;
+        }
+        current.landmarksPending = false;
+    });
+    return landmarks;
+}
+
+std::shared_ptr<const LandmarkTable> GraphExtension::loadLandmarks(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    std::shared_ptr<const LandmarkTable> landmarks = LandmarkTable::load(path, *graph);
+    if (landmarks) {
+        attachToSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField), graph,
+            [&](SnapshotEntry& entry) { entry.landmarks = landmarks; });
+    }
+    return landmarks;
+}
+
+std::shared_ptr<const ContractionHierarchy> GraphExtension::buildContractionHierarchy(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    std::shared_ptr<const ContractionHierarchy> hierarchy = ContractionHierarchy::build(*graph);
+    attachToSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField), graph,
+        [&](SnapshotEntry& entry) { entry.hierarchy = hierarchy; });
+    return hierarchy;
+}
+
+bool GraphExtension::saveContractionHierarchy(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    auto hierarchy = findOrBuildContractionHierarchy(
+        dbName, collectionName, fromField, toField, weightField, graph, true);
+    return hierarchy->save(path, *graph);
+}
+
+std::shared_ptr<const ContractionHierarchy> GraphExtension::loadContractionHierarchy(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& path,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+    
+    auto graph = loadSnapshot(dbName, collectionName, fromField, toField, weightField);
+    std::shared_ptr<const ContractionHierarchy> hierarchy = ContractionHierarchy::load(path, *graph);
+    if (hierarchy) {
+        attachToSnapshot(dbName, collectionName, fieldsKey(fromField, toField, weightField), graph,
+            [&](SnapshotEntry& entry) { entry.hierarchy = hierarchy; });
+    }
+    return hierarchy;
+}
+
+std::shared_ptr<const ContractionHierarchy> GraphExtension::findOrBuildContractionHierarchy(
+    const std::string& dbName,
+    const std::string& collectionName,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField,
+    const std::shared_ptr<const GraphSnapshot>& graph,
+    bool buildWhilePending) {
+    
+    std::string key = fieldsKey(fromField, toField, weightField);
+    SnapshotEntry entry = findEntry(dbName, collectionName, key);
+    if (entry.snapshot == graph && entry.hierarchy) {
+        return entry.hierarchy;
+    }
+    
+    // The first thread to find none contracts the graph; the others fall back
+    std::shared_ptr<const ContractionHierarchy> hierarchy;
+    bool build = true;
+    attachToSnapshot(dbName, collectionName, key, graph, [&](SnapshotEntry& current) {
+        if (current.hierarchy) {
+            hierarchy = current.hierarchy;
+        } else if (current.hierarchyPending) {
+            build = buildWhilePending;
+        } else {
+            current.hierarchyPending = true;
+        }
+    });
+    if (hierarchy || !build) {
+        return hierarchy;
+    }
+    
+    hierarchy = ContractionHierarchy::build(*graph);
+    attachToSnapshot(dbName, collectionName, key, graph, [&](SnapshotEntry& current) {
+        if (current.hierarchy) {
+            hierarchy = current.hierarchy;  // Built concurrently; keep the first
+        } else {
+            current.hierarchy = hierarchy;
+        }
+        current.hierarchyPending = false;
+    });
+    return hierarchy;
+}
+
+void GraphExtension::dropSnapshot(
+    const std::string& dbName,
+    const std::string& collectionName) {
+    // A maintainer would publish the snapshot again
+    stopMaintainingSnapshots(dbName, collectionName);
+    
+    std::unique_lock<std::shared_mutex> lock(_snapshotsMutex);
+    _snapshots.erase(namespaceKey(dbName, collectionName));
+    _resultCache.invalidateNamespace(namespaceKey(dbName, collectionName));
+}
+
 } // namespace graph_extension
-} // namespace mongo
\ No newline at end of file
+} // namespace mongo
@@ -2,23 +2,91 @@
 
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/pool.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
 #include <bsoncxx/json.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+#include "contraction_hierarchy.h"
+#include "delta_stepping.h"
+#include "graph_snapshot.h"
+#include "landmark_table.h"
+#include "result_cache.h"
+#include "snapshot_maintainer.h"
 
 namespace mongo {
 namespace graph_extension {
 
+class FetchPipeline;
+class ThreadPool;
+
+/**
+ * Weighted search run by findPathsBatch for every pair
+ */
+enum class PathAlgorithm {
+    kDijkstra,
+    kBidirectionalDijkstra,
+    kAlt,
+    kContractionHierarchy
+};
+
+/**
+ * Edge collection layout and limits shared by every pair of a batch
+ */
+struct BatchOptions {
+    std::string fromField = "from";
+    std::string toField = "to";
+    std::string weightField = "weight";
+    int maxDepth = 1000;  // Ignored by kContractionHierarchy, which has no hop limit
+};
+
+/**
+ * Receives the result of one pair of a batch, identified by its position in
+ * the input. Calls are serialized but arrive in completion order.
+ */
+using BatchResultCallback =
+    std::function<void(size_t pairIndex, bsoncxx::document::value result)>;
+
 /**
  * Main interface for MongoDB Graph Extension
+ *
+ * Snapshots, landmarks and hierarchies are immutable once built and shared
+ * between queries; the caches that hold them, the thread pool and the
+ * settings may be used from any number of threads at once. A reload swaps in
+ * a new snapshot while queries already running keep the one they started
+ * with.
  */
 class GraphExtension {
 public:
+    /**
+     * Run every operation on `client`. A client must not be used by two
+     * threads at once, so neither may this extension.
+     */
     GraphExtension(mongocxx::client& client);
 
+    /**
+     * Acquire a client from `pool` for each operation, so one extension can
+     * serve concurrent queries from many threads over shared snapshots
+     */
+    explicit GraphExtension(mongocxx::pool& pool);
+
+    ~GraphExtension();
+
     /**
      * Find paths between nodes using enhanced algorithms
+     * If an adjacency snapshot of the collection is loaded, the search runs
+     * over it in memory with the parallel BFS and only the path documents are
+     * fetched.
      */
     bsoncxx::document::value findPath(
         const std::string& dbName,
@@ -29,6 +97,13 @@ public:
         const std::string& connectFromField,
         int maxDepth = 10);
 
+    /**
+     * Find the cheapest path between two nodes of an edge collection.
+     * Each edge document holds its source node in connect_field, its target
+     * node in id_field and a numeric (int or double) weight in weight_field.
+     * The collection is loaded into a GraphSnapshot on first use and the
+     * snapshot is reused by later queries until it is reloaded or dropped.
+     */
     bsoncxx::document::value findWeightedPath(
         const std::string& db_name,
         const std::string& collection_name,
@@ -39,9 +114,133 @@ public:
         const std::string& weight_field,
         int max_depth
     );
+    /**
+     * Find the cheapest path between two nodes of an edge collection by
+     * running forward and reverse Dijkstra together over the snapshot.
+     * Takes the same arguments and returns the same cost as findWeightedPath.
+     */
+    bsoncxx::document::value findWeightedBidirectionalPath(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& start,
+        const std::string& end,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field,
+        int max_depth
+    );
+
+    /**
+     * Find the cheapest path between two nodes of an edge collection with A*
+     * guided by landmark distances (ALT). Takes the same arguments and returns
+     * the same cost as findWeightedPath while settling far fewer nodes.
+     * Uses the landmarks built or loaded for the collection, building the
+     * default set on first use.
+     */
+    bsoncxx::document::value findWeightedAltPath(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& start,
+        const std::string& end,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field,
+        int max_depth
+    );
+
+    /**
+     * Find the cheapest path between two nodes of an edge collection with a
+     * contraction hierarchy query. Exact like findWeightedPath, and fast
+     * enough for interactive routing on road networks, but without a hop
+     * limit. Uses the hierarchy built or loaded for the collection, building
+     * it on first use (slow: prefer loadContractionHierarchy at startup).
+     */
+    bsoncxx::document::value findContractionHierarchyPath(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& start,
+        const std::string& end,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field
+    );
+
+    /**
+     * Find up to k cheapest loopless paths between two nodes of an edge
+     * collection, cheapest first, for alternate routes. Returns
+     * {pathCount, paths: [...]} where every path has the findWeightedPath
+     * format, per-edge weights included.
+     */
+    bsoncxx::document::value findKShortestPaths(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& start,
+        const std::string& end,
+        size_t k,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field
+    );
+
+    /**
+     * Shortest distances from one node of an edge collection to every node
+     * within max_cost, computed in one parallel delta-stepping pass over the
+     * snapshot. As in findWeightedPath, paths are not extended past max_depth
+     * edges. Returns {source, reachedCount, nodes, distances, parents,
+     * depths}: parallel arrays sorted by distance, where parents[i] is the
+     * position in `nodes` of the previous node on the path (-1 for the source).
+     */
+    bsoncxx::document::value findDistancesFrom(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& source,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field,
+        double max_cost,
+        int max_depth = std::numeric_limits<int>::max()
+    );
+
+    /**
+     * Compute the same distances and store them in output_collection_name
+     * (same database), one {source, node, distance, depth, parent} document
+     * per reached node, with bulk unordered inserts. Earlier results for this
+     * source are replaced. Returns the number of documents written.
+     */
+    size_t writeDistancesFrom(
+        const std::string& db_name,
+        const std::string& collection_name,
+        const std::string& source,
+        const std::string& output_collection_name,
+        const std::string& connect_field,
+        const std::string& id_field,
+        const std::string& weight_field,
+        double max_cost,
+        int max_depth = std::numeric_limits<int>::max()
+    );
+
+    /**
+     * Answer many (start, end) queries on an edge collection at once. The
+     * snapshot (and the landmarks or hierarchy the algorithm needs) is loaded
+     * once, then the pairs are spread over the thread pool; pairs sharing a
+     * start are handled together, and with kDijkstra by a single search.
+     * Each result is the document the matching single-pair method returns,
+     * passed to onResult as soon as it is ready. Returns the number of pairs
+     * for which a path was found.
+     */
+    size_t findPathsBatch(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        PathAlgorithm algorithm,
+        const BatchOptions& options,
+        const BatchResultCallback& onResult);
+
     /**
      * Find paths between nodes using bidirectional search algorithm
      * This significantly improves performance for large graphs compared to the basic BFS approach
+     * If an adjacency snapshot of the collection is loaded, both sides search
+     * it in memory with the parallel BFS and only the path documents are fetched.
      */
     bsoncxx::document::value findBidirectionalPath(
         const std::string& dbName,
@@ -52,8 +251,452 @@ public:
         const std::string& connectFromField,
         int maxDepth = 10);
 
+    /**
+     * Number of node ids fetched per `$in` query when a traversal loads a BFS level
+     */
+    void setFetchBatchSize(size_t batchSize);
+    size_t getFetchBatchSize() const { return _fetchBatchSize.load(); }
+
+    /**
+     * Number of threads used by in-memory searches; 0 uses one per hardware
+     * core, which is also the default
+     */
+    void setThreadCount(size_t threadCount);
+
+    /**
+     * Remember up to maxEntries single-pair path results (findPath,
+     * findBidirectionalPath and the weighted searches), least recently used
+     * first out. Results are keyed by collection, ends, algorithm, hop limit
+     * and graph fields, and kept as node id lists: a repeated weighted query
+     * is answered from memory, a repeated BFS query with one `$in` query for
+     * the path documents. Reloading or dropping a snapshot clears the
+     * collection's results; writes are only seen through watchChanges or
+     * applyChangeEvent. 0, the default, disables the cache.
+     */
+    void setResultCacheCapacity(size_t maxEntries);
+    ResultCacheStats getResultCacheStats() const;
+    void clearResultCache();
+
+    /**
+     * Follow the change stream of a collection on a background thread and
+     * keep its cached results correct. Inserts, replaces, and updates that
+     * move an edge or may lower its weight can shorten a path anywhere, so
+     * they clear the collection's results. Deletes and weight raises only
+     * drop the results whose path contains a node they touch, plus the
+     * collection's cached "no path" results. nodeFields name the fields
+     * holding the edge ends: {"from", "to"} for an edge collection, e.g.
+     * {"_id", "connections"} for a node collection. Deletes and weight
+     * updates without pre-images, drops and stream errors also clear the
+     * whole collection.
+     * Needs a pool (the stream holds a client of its own) and a replica set.
+     * Returns false when constructed from a client.
+     */
+    bool watchChanges(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::vector<std::string>& nodeFields,
+        const std::string& weightField = "weight");
+
+    void stopWatchingChanges(
+        const std::string& dbName,
+        const std::string& collectionName);
+
+    /**
+     * Apply one change stream event read by the caller, for applications that
+     * run their own stream. Returns the number of cached results dropped.
+     */
+    size_t applyChangeEvent(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const bsoncxx::document::view& event,
+        const std::vector<std::string>& nodeFields,
+        const std::string& weightField = "weight");
+
+    /**
+     * Return the in-memory snapshot of an edge collection, scanning the
+     * collection only if no snapshot has been loaded for these fields yet
+     */
+    std::shared_ptr<const GraphSnapshot> loadSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Rescan an edge collection and replace its snapshot. Queries already
+     * running keep using the snapshot they started with.
+     */
+    std::shared_ptr<const GraphSnapshot> reloadSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Return the in-memory adjacency snapshot of a node collection, built from
+     * each document's connection array. While it is loaded, findPath and
+     * findBidirectionalPath search it instead of querying the server per level.
+     */
+    std::shared_ptr<const GraphSnapshot> loadAdjacencySnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& connectToField,
+        const std::string& connectFromField);
+
+    /**
+     * Rescan a node collection and replace its adjacency snapshot, e.g. after
+     * connections have changed
+     */
+    std::shared_ptr<const GraphSnapshot> reloadAdjacencySnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& connectToField,
+        const std::string& connectFromField);
+
+    /**
+     * Write the snapshot of an edge collection to a binary file (see
+     * GraphSnapshot::save), scanning the collection first if no snapshot is
+     * loaded. Returns false if the file cannot be written.
+     */
+    bool exportSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Use a file written by exportSnapshot as the snapshot of an edge
+     * collection, replacing the current one without touching the server.
+     * The file is mapped, not read, so startup costs the same for any graph
+     * size. Returns nullptr, keeping the current snapshot, if the file is
+     * unreadable.
+     */
+    std::shared_ptr<const GraphSnapshot> mapSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight",
+        bool verifyChecksums = false);
+
+    /**
+     * exportSnapshot for the adjacency snapshot of a node collection
+     */
+    bool exportAdjacencySnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& connectToField,
+        const std::string& connectFromField);
+
+    /**
+     * mapSnapshot for the adjacency snapshot of a node collection; the file
+     * must hold ObjectId node ids
+     */
+    std::shared_ptr<const GraphSnapshot> mapAdjacencySnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& connectToField,
+        const std::string& connectFromField,
+        bool verifyChecksums = false);
+
+    /**
+     * Keep the snapshot of an edge collection current instead of reloading
+     * it. A background thread scans the collection once, then follows its
+     * change stream: every edge insert, update and delete is applied to
+     * per-node edge lists in memory, and while changes are pending a fresh
+     * snapshot is built from those lists, without a rescan, at most every
+     * compactInterval. Publishing swaps the snapshot like reloadSnapshot, so
+     * queries are never blocked and keep the one they started with. Landmarks
+     * and hierarchies the previous snapshot had are rebuilt once by the
+     * background thread after each swap (delaying the next one); until they
+     * are ready, ALT and hierarchy queries answer with bidirectional Dijkstra.
+     * Needs a pool (the stream holds a client of its own) and a replica set.
+     * Returns false when constructed from a client.
+     */
+    bool maintainSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight",
+        std::chrono::milliseconds compactInterval = kDefaultCompactInterval);
+
+    /**
+     * Keep the adjacency snapshot of a node collection current the same way;
+     * each written node document replaces that node's out-edges
+     */
+    bool maintainAdjacencySnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& connectToField,
+        const std::string& connectFromField,
+        std::chrono::milliseconds compactInterval = kDefaultCompactInterval);
+
+    /**
+     * Stop following a collection's changes; its snapshots stay as they are
+     */
+    void stopMaintainingSnapshots(
+        const std::string& dbName,
+        const std::string& collectionName);
+
+    /**
+     * Select landmarks on the snapshot of an edge collection and compute their
+     * distance tables, replacing any landmarks the collection already has.
+     * Reloading the snapshot discards its landmarks.
+     */
+    std::shared_ptr<const LandmarkTable> buildLandmarks(
+        const std::string& dbName,
+        const std::string& collectionName,
+        size_t landmarkCount = kDefaultLandmarkCount,
+        LandmarkSelection selection = LandmarkSelection::kFarthest,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Write the landmark tables of an edge collection to a file, building
+     * them first if needed. Returns false if the file cannot be written.
+     */
+    bool saveLandmarks(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Read landmark tables written by saveLandmarks so preprocessing is not
+     * repeated at startup. Returns nullptr, keeping the current landmarks, if
+     * the file is unreadable or no longer matches the collection's snapshot.
+     */
+    std::shared_ptr<const LandmarkTable> loadLandmarks(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Contract the snapshot of an edge collection into a hierarchy, replacing
+     * any hierarchy the collection already has. Reloading the snapshot
+     * discards its hierarchy.
+     */
+    std::shared_ptr<const ContractionHierarchy> buildContractionHierarchy(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Write the hierarchy of an edge collection to a file, building it first
+     * if needed. Returns false if the file cannot be written.
+     */
+    bool saveContractionHierarchy(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Read a hierarchy written by saveContractionHierarchy. Returns nullptr,
+     * keeping the current hierarchy, if the file is unreadable or no longer
+     * matches the collection's snapshot.
+     */
+    std::shared_ptr<const ContractionHierarchy> loadContractionHierarchy(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& path,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Release every snapshot of a collection, with its landmarks and hierarchies
+     */
+    void dropSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName);
+
 private:
-    mongocxx::client& _client;
+    static std::string namespaceKey(
+        const std::string& dbName,
+        const std::string& collectionName);
+    static std::string fieldsKey(
+        const std::string& fromField,
+        const std::string& toField,
+        const std::string& weightField);
+    static std::string adjacencyKey(
+        const std::string& connectToField,
+        const std::string& connectFromField);
+
+    // A snapshot together with the preprocessing built for it. Replacing the
+    // snapshot replaces the whole entry, so landmarks and hierarchies never
+    // outlive the node indices they refer to.
+    struct SnapshotEntry {
+        std::shared_ptr<const GraphSnapshot> snapshot;
+        std::shared_ptr<const LandmarkTable> landmarks;
+        std::shared_ptr<const ContractionHierarchy> hierarchy;
+        // Set while one thread builds the missing landmarks or hierarchy, so
+        // queries fall back instead of building copies of their own
+        bool landmarksPending = false;
+        bool hierarchyPending = false;
+    };
+
+    // Background change stream reader of one collection
+    struct ChangeWatcher;
+
+    void watchLoop(
+        ChangeWatcher& watcher,
+        const std::string& dbName,
+        const std::string& collectionName);
+
+    // Run a watcher under `watcherKey`, replacing any watcher already there
+    void startWatcher(
+        const std::string& watcherKey,
+        const std::string& dbName,
+        const std::string& collectionName,
+        std::unique_ptr<ChangeWatcher> watcher);
+
+    // Stop the watcher with this key, or with keys starting with it
+    void stopWatchers(const std::string& watcherKey, bool prefix);
+
+    // Swap in a maintained snapshot, then rebuild on the calling (watcher)
+    // thread the landmarks and hierarchy the previous snapshot had
+    void publishMaintainedSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key,
+        std::shared_ptr<const GraphSnapshot> snapshot);
+
+    bool startMaintainer(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key,
+        std::shared_ptr<SnapshotMaintainer> maintainer,
+        std::chrono::milliseconds compactInterval);
+
+    // Serve a BFS query from the result cache, hydrating its documents, or
+    // run `search` and remember the result
+    Path cachedNodePath(
+        mongocxx::collection& collection,
+        const std::string& dbName,
+        const std::string& collectionName,
+        const char* algorithm,
+        const bsoncxx::oid& startNodeId,
+        const bsoncxx::oid& endNodeId,
+        int maxDepth,
+        const std::string& connectToField,
+        const std::string& connectFromField,
+        const std::function<Path()>& search);
+
+    // Serve a weighted query from the result cache, or run `search` and
+    // remember the result
+    Path cachedWeightedPath(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const char* algorithm,
+        const std::string& start,
+        const std::string& end,
+        int maxDepth,
+        const std::string& fields,
+        const std::function<Path()>& search);
+
+    // Landmarks of `graph`, building the default set if there are none.
+    // Returns nullptr while another thread builds them, unless
+    // `buildWhilePending`; queries then fall back to bidirectional Dijkstra.
+    std::shared_ptr<const LandmarkTable> findOrBuildLandmarks(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField,
+        const std::string& toField,
+        const std::string& weightField,
+        const std::shared_ptr<const GraphSnapshot>& graph,
+        bool buildWhilePending);
+
+    // Hierarchy of `graph`, contracting it if there is none; nullptr while
+    // another thread contracts it, as for findOrBuildLandmarks
+    std::shared_ptr<const ContractionHierarchy> findOrBuildContractionHierarchy(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& fromField,
+        const std::string& toField,
+        const std::string& weightField,
+        const std::shared_ptr<const GraphSnapshot>& graph,
+        bool buildWhilePending);
+
+    // Worker threads for in-memory searches, started on first use
+    std::shared_ptr<ThreadPool> threadPool();
+
+    // A client for one operation: from the pool, or the borrowed client
+    mongocxx::pool::entry acquireClient() const;
+
+    // Background fetch stage on a second pooled client for the driver-side
+    // BFS searches; null without a pool or when no client is free
+    std::unique_ptr<FetchPipeline> makeFetchPipeline(
+        const std::string& dbName,
+        const std::string& collectionName) const;
+
+    // Copy of a cache entry, empty if nothing is loaded; never scans the collection
+    SnapshotEntry findEntry(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key) const;
+
+    // Cached snapshot or nullptr; never scans the collection
+    std::shared_ptr<const GraphSnapshot> findSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key) const;
+
+    // Cache a freshly loaded snapshot, dropping the entry's preprocessing.
+    // Without `replace`, a snapshot another thread stored first wins.
+    // Returns the cached snapshot.
+    std::shared_ptr<const GraphSnapshot> storeSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key,
+        std::shared_ptr<const GraphSnapshot> snapshot,
+        bool replace);
+
+    // Run `attach` on the entry under the write lock if `graph` is still its
+    // snapshot; returns false if it was reloaded or dropped meanwhile
+    bool attachToSnapshot(
+        const std::string& dbName,
+        const std::string& collectionName,
+        const std::string& key,
+        const std::shared_ptr<const GraphSnapshot>& graph,
+        const std::function<void(SnapshotEntry&)>& attach);
+
+    mongocxx::client* _client;  // Set when constructed from a client
+    mongocxx::pool* _pool;      // Set when constructed from a pool
+    std::atomic<size_t> _fetchBatchSize;
+
+    std::mutex _threadPoolMutex;
+    std::shared_ptr<ThreadPool> _threadPool;
+
+    // Snapshots keyed by "<db>.<collection>", then by the field names they were built from
+    mutable std::shared_mutex _snapshotsMutex;
+    std::unordered_map<std::string,
+        std::unordered_map<std::string, SnapshotEntry>> _snapshots;
+
+    PathResultCache _resultCache;
+
+    // Change stream readers keyed by "<db>.<collection>" for the result
+    // cache, and by "<db>.<collection>|<snapshot key>" for maintained snapshots
+    std::mutex _watchersMutex;
+    std::unordered_map<std::string, std::unique_ptr<ChangeWatcher>> _watchers;
 };
 
 } // namespace graph_extension
@@ -0,0 +1,537 @@
+#include "graph_snapshot.h"
+#include "graph_connections.h"
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/options/find.hpp>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+IdInterner::Index internNodeId(IdInterner& ids, const bsoncxx::document::element& element) {
+    if (element.type() == bsoncxx::type::k_oid) {
+        return ids.intern(element.get_oid().value);
+    }
+    return ids.intern(element.get_string().value);
+}
+
+// File layout (host byte order): FileHeader, then the sections in
+// SectionId order, each starting on a kSectionAlignment boundary so the
+// mapped arrays are aligned for their element types.
+constexpr char kFileMagic[8] = {'G', 'X', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t kFileVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr uint64_t kSectionAlignment = 64;
+
+enum SectionId : uint32_t {
+    kOffsetsSection,
+    kTargetsSection,
+    kWeightsSection,
+    kReverseOffsetsSection,
+    kReverseSourcesSection,
+    kReverseEdgesSection,
+    kIdArenaSection,
+    kIdOffsetsSection,
+    kIdHashesSection,
+    kIdSlotsSection,
+    kSectionCount
+};
+
+struct FileSection {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t idType;
+    uint32_t sectionCount;
+    uint64_t nodeCount;
+    uint64_t edgeCount;
+    uint64_t slotCount;
+    FileSection sections[kSectionCount];
+    uint64_t headerChecksum;  // Of every byte before it
+};
+
+// FNV-1a over 64-bit words: each step is a bijection, so any single changed
+// word changes the result. Meant to catch corruption, not tampering.
+uint64_t checksum(const char* data, size_t bytes) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < bytes; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t headerChecksum(const FileHeader& header) {
+    return checksum(reinterpret_cast<const char*>(&header), offsetof(FileHeader, headerChecksum));
+}
+
+// Write all of `bytes`, retrying short writes; false on any error
+bool writeAll(int fd, const char* data, uint64_t bytes) {
+    while (bytes > 0) {
+        ssize_t count = ::write(fd, data, bytes);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        bytes -= static_cast<uint64_t>(count);
+    }
+    return true;
+}
+
+// splitmix64 finalizer: spreads every input bit over the whole result
+uint64_t mixBits(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+bool isHexObjectId(std::string_view text) {
+    if (text.size() != 24) {
+        return false;
+    }
+    for (char c : text) {
+        if (!std::isxdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::shared_ptr<const GraphSnapshot> GraphSnapshot::load(
+    mongocxx::collection& collection,
+    const std::string& fromField,
+    const std::string& toField,
+    const std::string& weightField) {
+
+    std::shared_ptr<GraphSnapshot> snapshot(new GraphSnapshot());
+
+    // Only the edge fields are needed, so keep the rest of each document off the wire
+    mongocxx::options::find opts;
+    opts.projection(document{}
+        << "_id" << 0
+        << fromField << 1
+        << toField << 1
+        << weightField << 1
+        << finalize);
+
+    // --- Single scan into an edge list ---
+    std::vector<NodeIndex> sources;
+    std::vector<NodeIndex> targets;
+    std::vector<double> weights;
+    std::optional<bsoncxx::type> idType;
+
+    for (auto&& doc : collection.find({}, opts)) {
+        auto fromElement = doc[fromField];
+        auto toElement = doc[toField];
+        if (!fromElement || !toElement || !isNodeIdType(fromElement.type())) {
+            continue; // Not an edge document
+        }
+        if (!idType) {
+            idType = fromElement.type();
+        }
+        if (fromElement.type() != *idType || toElement.type() != *idType) {
+            continue; // Mixed id types cannot share one dictionary
+        }
+
+        double weight = readEdgeWeight(doc[weightField]);
+        if (!isUsableEdgeWeight(weight)) {
+            continue; // Dijkstra requires finite, non-negative weights
+        }
+
+        sources.push_back(internNodeId(snapshot->_nodeIds, fromElement));
+        targets.push_back(internNodeId(snapshot->_nodeIds, toElement));
+        weights.push_back(weight);
+    }
+
+    if (idType == bsoncxx::type::k_oid) {
+        snapshot->_idType = IdType::kObjectId;
+    }
+    snapshot->buildFromEdgeList(sources, targets, weights);
+    return snapshot;
+}
+
+std::shared_ptr<const GraphSnapshot> GraphSnapshot::loadAdjacency(
+    mongocxx::collection& collection,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    const std::string& weightField) {
+
+    std::shared_ptr<GraphSnapshot> snapshot(new GraphSnapshot());
+    snapshot->_idType = IdType::kObjectId;
+
+    // The connection array is all a traversal reads from a node document
+    mongocxx::options::find opts;
+    opts.projection(document{}
+        << connectFromField << 1
+        << connectToField << 1
+        << finalize);
+
+    std::vector<NodeIndex> sources;
+    std::vector<NodeIndex> targets;
+    std::vector<double> weights;
+
+    for (auto&& doc : collection.find({}, opts)) {
+        auto idElement = doc[connectFromField];
+        if (!idElement || idElement.type() != bsoncxx::type::k_oid) {
+            continue; // Traversals only follow ObjectId references
+        }
+        NodeIndex source = snapshot->_nodeIds.intern(idElement.get_oid().value);
+
+        forEachConnection(doc, connectToField, connectFromField,
+            [&](const bsoncxx::oid& neighbor, const bsoncxx::document::view& embedded) {
+                double weight = embedded.empty() ? 1.0 : readEdgeWeight(embedded[weightField]);
+                if (!isUsableEdgeWeight(weight)) {
+                    return;
+                }
+                sources.push_back(source);
+                targets.push_back(snapshot->_nodeIds.intern(neighbor));
+                weights.push_back(weight);
+            });
+    }
+
+    snapshot->buildFromEdgeList(sources, targets, weights);
+    return snapshot;
+}
+
+std::shared_ptr<const GraphSnapshot> GraphSnapshot::fromCsr(
+    IdInterner nodeIds,
+    IdType idType,
+    std::vector<EdgeIndex> offsets,
+    std::vector<NodeIndex> targets,
+    std::vector<double> weights) {
+
+    std::shared_ptr<GraphSnapshot> snapshot(new GraphSnapshot());
+    snapshot->_idType = idType;
+    snapshot->_nodeIds = std::move(nodeIds);
+    snapshot->_ids = snapshot->_nodeIds.dictionary();
+    snapshot->_offsets.own(std::move(offsets));
+    snapshot->_targets.own(std::move(targets));
+    snapshot->_weights.own(std::move(weights));
+    snapshot->buildReverseIndex();
+    return snapshot;
+}
+
+bool GraphSnapshot::save(const std::string& path) const {
+    // The interner's own tables; a mapped snapshot writes its mapped ones
+    const char* arena = _ids.size() > 0 ? _ids.key(0).data() : nullptr;
+    uint64_t arenaBytes = 0;
+    std::vector<uint64_t> keyOffsets(nodeCount() + 1, 0);
+    std::vector<uint64_t> hashes(nodeCount());
+    for (NodeIndex node = 0; node < nodeCount(); ++node) {
+        std::string_view key = _ids.key(node);
+        arenaBytes += key.size();
+        keyOffsets[node + 1] = arenaBytes;
+        hashes[node] = IdInterner::hashKey(key);
+    }
+
+    // A fresh power-of-two table at most half full, as IdInterner keeps it
+    size_t slotCount = 16;
+    while (slotCount < nodeCount() * 2) {
+        slotCount *= 2;
+    }
+    std::vector<NodeIndex> slots(slotCount, kInvalidNode);
+    for (NodeIndex node = 0; node < nodeCount(); ++node) {
+        size_t slot = hashes[node] & (slotCount - 1);
+        while (slots[slot] != kInvalidNode) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = node;
+    }
+
+    struct Source {
+        const void* data;
+        uint64_t bytes;
+    };
+    const Source sources[kSectionCount] = {
+        {_offsets.data(), _offsets.size() * sizeof(EdgeIndex)},
+        {_targets.data(), _targets.size() * sizeof(NodeIndex)},
+        {_weights.data(), _weights.size() * sizeof(double)},
+        {_reverseOffsets.data(), _reverseOffsets.size() * sizeof(EdgeIndex)},
+        {_reverseSources.data(), _reverseSources.size() * sizeof(NodeIndex)},
+        {_reverseEdges.data(), _reverseEdges.size() * sizeof(EdgeIndex)},
+        {arena, arenaBytes},
+        {keyOffsets.data(), keyOffsets.size() * sizeof(uint64_t)},
+        {hashes.data(), hashes.size() * sizeof(uint64_t)},
+        {slots.data(), slots.size() * sizeof(NodeIndex)},
+    };
+
+    FileHeader header{};
+    std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.byteOrderMark = kByteOrderMark;
+    header.idType = static_cast<uint32_t>(_idType);
+    header.sectionCount = kSectionCount;
+    header.nodeCount = nodeCount();
+    header.edgeCount = edgeCount();
+    header.slotCount = slotCount;
+
+    uint64_t offset = sizeof(FileHeader);
+    for (uint32_t i = 0; i < kSectionCount; ++i) {
+        offset = (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+        header.sections[i].offset = offset;
+        header.sections[i].bytes = sources[i].bytes;
+        header.sections[i].checksum =
+            checksum(static_cast<const char*>(sources[i].data), sources[i].bytes);
+        offset += sources[i].bytes;
+    }
+    header.headerChecksum = headerChecksum(header);
+
+    // A temp file of its own, so concurrent saves to one path never write
+    // into the same file; the last rename wins with a complete file
+    std::string tempPath = path + ".XXXXXX";
+    int fd = ::mkstemp(tempPath.data());
+    if (fd < 0) {
+        return false;
+    }
+    // mkstemp creates the file private; give it the mode a plain create would
+    mode_t mask = ::umask(0);
+    ::umask(mask);
+    bool ok = ::fchmod(fd, 0666 & ~mask) == 0 &&
+        writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    const char padding[kSectionAlignment] = {};
+    for (uint32_t i = 0; ok && i < kSectionCount; ++i) {
+        ok = writeAll(fd, padding, header.sections[i].offset - written) &&
+            writeAll(fd, static_cast<const char*>(sources[i].data), sources[i].bytes);
+        written = header.sections[i].offset + sources[i].bytes;
+    }
+    if (::close(fd) != 0 || !ok) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    // Replacing the file instead of truncating it leaves existing mappings intact
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const GraphSnapshot> GraphSnapshot::map(
+    const std::string& path,
+    bool verifyChecksums) {
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t fileBytes = static_cast<size_t>(status.st_size);
+    void* base = ::mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // The mapping keeps the file open
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    std::shared_ptr<const void> mapping(base, [fileBytes](const void* data) {
+        ::munmap(const_cast<void*>(data), fileBytes);
+    });
+    const char* bytes = static_cast<const char*>(base);
+
+    FileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+        header.version != kFileVersion || header.byteOrderMark != kByteOrderMark ||
+        header.sectionCount != kSectionCount || header.headerChecksum != headerChecksum(header) ||
+        header.idType > static_cast<uint32_t>(IdType::kObjectId) ||
+        header.nodeCount >= kInvalidNode || header.edgeCount > UINT32_MAX) {
+        return nullptr;
+    }
+
+    // Section sizes follow from the counts; a mismatch means a damaged file
+    uint64_t nodes = header.nodeCount;
+    uint64_t edges = header.edgeCount;
+    const uint64_t expectedBytes[kSectionCount] = {
+        (nodes + 1) * sizeof(EdgeIndex),
+        edges * sizeof(NodeIndex),
+        edges * sizeof(double),
+        (nodes + 1) * sizeof(EdgeIndex),
+        edges * sizeof(NodeIndex),
+        edges * sizeof(EdgeIndex),
+        header.sections[kIdArenaSection].bytes,
+        (nodes + 1) * sizeof(uint64_t),
+        nodes * sizeof(uint64_t),
+        header.slotCount * sizeof(NodeIndex),
+    };
+    for (uint32_t i = 0; i < kSectionCount; ++i) {
+        const FileSection& section = header.sections[i];
+        if (section.bytes != expectedBytes[i] || section.offset % kSectionAlignment != 0 ||
+            section.offset > fileBytes || section.bytes > fileBytes - section.offset) {
+            return nullptr;
+        }
+        if (verifyChecksums && checksum(bytes + section.offset, section.bytes) != section.checksum) {
+            return nullptr;
+        }
+    }
+    // Lookups stop at the first free slot, so the table must have one
+    if (header.slotCount == 0 || (header.slotCount & (header.slotCount - 1)) != 0 ||
+        header.slotCount <= nodes) {
+        return nullptr;
+    }
+
+    auto section = [&](SectionId id) { return bytes + header.sections[id].offset; };
+    auto keyOffsets = reinterpret_cast<const uint64_t*>(section(kIdOffsetsSection));
+    auto offsets = reinterpret_cast<const EdgeIndex*>(section(kOffsetsSection));
+    if (keyOffsets[nodes] != header.sections[kIdArenaSection].bytes ||
+        offsets[nodes] != edges) {
+        return nullptr;
+    }
+
+    std::shared_ptr<GraphSnapshot> snapshot(new GraphSnapshot());
+    snapshot->_idType = static_cast<IdType>(header.idType);
+    snapshot->_ids = IdDictionary(
+        section(kIdArenaSection),
+        keyOffsets,
+        reinterpret_cast<const uint64_t*>(section(kIdHashesSection)),
+        reinterpret_cast<const NodeIndex*>(section(kIdSlotsSection)),
+        nodes,
+        header.slotCount);
+    snapshot->_offsets.borrow(offsets, nodes + 1);
+    snapshot->_targets.borrow(
+        reinterpret_cast<const NodeIndex*>(section(kTargetsSection)), edges);
+    snapshot->_weights.borrow(
+        reinterpret_cast<const double*>(section(kWeightsSection)), edges);
+    snapshot->_reverseOffsets.borrow(
+        reinterpret_cast<const EdgeIndex*>(section(kReverseOffsetsSection)), nodes + 1);
+    snapshot->_reverseSources.borrow(
+        reinterpret_cast<const NodeIndex*>(section(kReverseSourcesSection)), edges);
+    snapshot->_reverseEdges.borrow(
+        reinterpret_cast<const EdgeIndex*>(section(kReverseEdgesSection)), edges);
+    snapshot->_mapping = std::move(mapping);
+    return snapshot;
+}
+
+uint64_t GraphSnapshot::fingerprint() const {
+    std::vector<uint64_t> idHashes(nodeCount());
+    for (NodeIndex node = 0; node < nodeCount(); ++node) {
+        idHashes[node] = IdInterner::hashKey(_ids.key(node));
+    }
+
+    // A sum is blind to edge order, but counts parallel edges
+    uint64_t sum = 0;
+    for (NodeIndex source = 0; source < nodeCount(); ++source) {
+        for (EdgeIndex edge = edgeBegin(source); edge < edgeEnd(source); ++edge) {
+            uint64_t weightBits;
+            double edgeWeight = weight(edge);
+            std::memcpy(&weightBits, &edgeWeight, sizeof(weightBits));
+            sum += mixBits(idHashes[source] ^
+                           mixBits(idHashes[target(edge)] ^ mixBits(weightBits)));
+        }
+    }
+    return mixBits(sum ^ edgeCount());
+}
+
+GraphSnapshot::NodeIndex GraphSnapshot::findNode(std::string_view nodeId) const {
+    if (_idType == IdType::kString) {
+        return _ids.find(nodeId);
+    }
+    if (!isHexObjectId(nodeId)) {
+        return kInvalidNode;
+    }
+    return _ids.find(bsoncxx::oid(bsoncxx::stdx::string_view(nodeId.data(), nodeId.size())));
+}
+
+GraphSnapshot::NodeIndex GraphSnapshot::findNode(const bsoncxx::oid& nodeId) const {
+    if (_idType != IdType::kObjectId) {
+        return kInvalidNode;
+    }
+    return _ids.find(nodeId);
+}
+
+std::string GraphSnapshot::nodeId(NodeIndex node) const {
+    if (_idType == IdType::kObjectId) {
+        return _ids.oid(node).to_string();
+    }
+    return std::string(_ids.key(node));
+}
+
+void GraphSnapshot::buildFromEdgeList(
+    const std::vector<NodeIndex>& sources,
+    const std::vector<NodeIndex>& targets,
+    const std::vector<double>& weights) {
+
+    _ids = _nodeIds.dictionary();
+    size_t count = nodeCount();
+    std::vector<EdgeIndex> offsets(count + 1, 0);
+    for (NodeIndex source : sources) {
+        ++offsets[source + 1];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<NodeIndex> sortedTargets(targets.size());
+    std::vector<double> sortedWeights(weights.size());
+    std::vector<EdgeIndex> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        EdgeIndex slot = cursor[sources[i]]++;
+        sortedTargets[slot] = targets[i];
+        sortedWeights[slot] = weights[i];
+    }
+
+    _offsets.own(std::move(offsets));
+    _targets.own(std::move(sortedTargets));
+    _weights.own(std::move(sortedWeights));
+    buildReverseIndex();
+}
+
+void GraphSnapshot::buildReverseIndex() {
+    size_t count = nodeCount();
+    std::vector<EdgeIndex> reverseOffsets(count + 1, 0);
+    for (EdgeIndex edge = 0; edge < edgeCount(); ++edge) {
+        ++reverseOffsets[_targets[edge] + 1];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        reverseOffsets[i + 1] += reverseOffsets[i];
+    }
+
+    std::vector<NodeIndex> reverseSources(edgeCount());
+    std::vector<EdgeIndex> reverseEdges(edgeCount());
+    std::vector<EdgeIndex> cursor(reverseOffsets.begin(), reverseOffsets.end() - 1);
+    for (NodeIndex source = 0; source < count; ++source) {
+        for (EdgeIndex edge = edgeBegin(source); edge < edgeEnd(source); ++edge) {
+            EdgeIndex slot = cursor[_targets[edge]]++;
+            reverseSources[slot] = source;
+            reverseEdges[slot] = edge;
+        }
+    }
+
+    _reverseOffsets.own(std::move(reverseOffsets));
+    _reverseSources.own(std::move(reverseSources));
+    _reverseEdges.own(std::move(reverseEdges));
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <mongocxx/collection.hpp>
+#include <bsoncxx/oid.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "id_interner.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Immutable in-memory copy of a graph collection in compressed-sparse-row form.
+ *
+ * Every node id is mapped to a dense index. The outgoing edges of node `u`
+ * occupy the range [edgeBegin(u), edgeEnd(u)) of the targets/weights arrays,
+ * so a traversal touches contiguous memory and never goes back to the server.
+ * A second, reverse CSR lists the incoming edges of every node so backward
+ * searches cost the same as forward ones.
+ *
+ * A snapshot is built either from an edge collection ({from, to, weight}
+ * documents) or from a node collection whose documents list their
+ * connections, or mapped from a file written by save(). The node ids of one
+ * snapshot are all strings or all ObjectIds.
+ */
+class GraphSnapshot {
+public:
+    using NodeIndex = uint32_t;
+    using EdgeIndex = uint32_t;
+
+    static constexpr NodeIndex kInvalidNode = IdInterner::kNotFound;
+
+    enum class IdType { kString, kObjectId };
+
+    /**
+     * Scan the whole edge collection once and build the adjacency arrays.
+     * Node ids may be strings or ObjectIds, whichever the first edge uses.
+     * Weights may be int32, int64 or double; edges without a numeric weight
+     * count as weight 1 and edges with a negative, infinite or NaN weight
+     * are skipped.
+     */
+    static std::shared_ptr<const GraphSnapshot> load(
+        mongocxx::collection& collection,
+        const std::string& fromField = "from",
+        const std::string& toField = "to",
+        const std::string& weightField = "weight");
+
+    /**
+     * Scan a node collection once and build the adjacency arrays from each
+     * document's connection array, the layout findBasicPath traverses.
+     * Embedded connection documents may carry a weight in weightField.
+     */
+    static std::shared_ptr<const GraphSnapshot> loadAdjacency(
+        mongocxx::collection& collection,
+        const std::string& connectToField,
+        const std::string& connectFromField,
+        const std::string& weightField = "weight");
+
+    /**
+     * Take over adjacency arrays that are already in CSR form (`offsets` has
+     * one entry per node of `nodeIds` plus one) and add the reverse CSR. Used
+     * to publish an adjacency maintained in memory without a rescan.
+     */
+    static std::shared_ptr<const GraphSnapshot> fromCsr(
+        IdInterner nodeIds,
+        IdType idType,
+        std::vector<EdgeIndex> offsets,
+        std::vector<NodeIndex> targets,
+        std::vector<double> weights);
+
+    /**
+     * Write the snapshot to a binary file: a versioned header, then the
+     * forward and reverse CSR arrays and the id dictionary, each section
+     * checksummed and laid out exactly as in memory. The file is written
+     * to a uniquely named temp file next to `path` and renamed over it, so
+     * processes that have the old file mapped keep reading it and
+     * concurrent saves to one path never mix their contents. Returns false
+     * if the file cannot be written.
+     */
+    bool save(const std::string& path) const;
+
+    /**
+     * Map a file written by save() read-only and read the snapshot straight
+     * from it: nothing is parsed or copied, pages are loaded as searches
+     * touch them, and processes mapping the same file share them in the page
+     * cache. The header is always validated; the section checksums only if
+     * `verifyChecksums` is set, since that reads the whole file. Returns
+     * nullptr if the file is missing, truncated or of another version or
+     * byte order.
+     */
+    static std::shared_ptr<const GraphSnapshot> map(
+        const std::string& path,
+        bool verifyChecksums = false);
+
+    size_t nodeCount() const { return _ids.size(); }
+    size_t edgeCount() const { return _targets.size(); }
+    IdType idType() const { return _idType; }
+
+    /**
+     * Hash of every edge by the ids of its ends and its weight, summed so it
+     * does not depend on node numbering: two loads of an unchanged graph
+     * agree, and adding, removing or reweighting an edge changes it. Files
+     * derived from a snapshot store it to notice a changed graph.
+     * O(nodes + edges).
+     */
+    uint64_t fingerprint() const;
+
+    /**
+     * Dense index of a node id, or kInvalidNode if the id is not in the graph.
+     * ObjectId snapshots also accept the 24-character hex form of an id.
+     */
+    NodeIndex findNode(std::string_view nodeId) const;
+    NodeIndex findNode(const bsoncxx::oid& nodeId) const;
+
+    /**
+     * Printable id of a node: the string itself, or the ObjectId in hex
+     */
+    std::string nodeId(NodeIndex node) const;
+    bsoncxx::oid nodeOid(NodeIndex node) const { return _ids.oid(node); }
+
+    EdgeIndex edgeBegin(NodeIndex node) const { return _offsets[node]; }
+    EdgeIndex edgeEnd(NodeIndex node) const { return _offsets[node + 1]; }
+    NodeIndex target(EdgeIndex edge) const { return _targets[edge]; }
+    double weight(EdgeIndex edge) const { return _weights[edge]; }
+
+    /**
+     * Incoming edges of `node` occupy [inEdgeBegin(node), inEdgeEnd(node)).
+     * inSource() is the node the edge leaves from and inEdge() the matching
+     * forward edge, which carries the weight.
+     */
+    EdgeIndex inEdgeBegin(NodeIndex node) const { return _reverseOffsets[node]; }
+    EdgeIndex inEdgeEnd(NodeIndex node) const { return _reverseOffsets[node + 1]; }
+    NodeIndex inSource(EdgeIndex reverseEdge) const { return _reverseSources[reverseEdge]; }
+    EdgeIndex inEdge(EdgeIndex reverseEdge) const { return _reverseEdges[reverseEdge]; }
+
+private:
+    // Array read through a pointer, so it can live in the snapshot itself or
+    // in a mapped file
+    template <typename T>
+    class Array {
+    public:
+        Array() = default;
+        Array(const Array&) = delete;
+        Array& operator=(const Array&) = delete;
+
+        void own(std::vector<T> values) {
+            _owned = std::move(values);
+            _data = _owned.data();
+            _size = _owned.size();
+        }
+        void borrow(const T* data, size_t size) {
+            _owned = std::vector<T>();
+            _data = data;
+            _size = size;
+        }
+
+        const T& operator[](size_t index) const { return _data[index]; }
+        const T* data() const { return _data; }
+        size_t size() const { return _size; }
+
+    private:
+        std::vector<T> _owned;
+        const T* _data = nullptr;
+        size_t _size = 0;
+    };
+
+    GraphSnapshot() = default;
+
+    // Counting sort of an edge list by source into CSR, then the reverse CSR
+    void buildFromEdgeList(
+        const std::vector<NodeIndex>& sources,
+        const std::vector<NodeIndex>& targets,
+        const std::vector<double>& weights);
+    void buildReverseIndex();
+
+    IdType _idType = IdType::kString;
+
+    // CSR arrays: _offsets has nodeCount() + 1 entries
+    Array<EdgeIndex> _offsets;
+    Array<NodeIndex> _targets;
+    Array<double> _weights;
+
+    // Reverse CSR arrays, grouped by edge target
+    Array<EdgeIndex> _reverseOffsets;
+    Array<NodeIndex> _reverseSources;
+    Array<EdgeIndex> _reverseEdges;
+
+    // Node id dictionary; ObjectIds are keyed by their 12 raw bytes. _ids
+    // reads _nodeIds, or the dictionary of a mapped file.
+    IdInterner _nodeIds;
+    IdDictionary _ids;
+
+    // Keeps the file of a mapped snapshot mapped
+    std::shared_ptr<const void> _mapping;
+};
+
+} // namespace graph_extension
+} // namespace mongo
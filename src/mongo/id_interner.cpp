@@ -0,0 +1,101 @@
+#include "id_interner.h"
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+constexpr size_t kInitialSlotCount = 16;
+} // namespace
+
+IdDictionary::Index IdDictionary::find(std::string_view key) const {
+    if (_slotCount == 0) {
+        return kNotFound;
+    }
+    uint64_t hash = IdInterner::hashKey(key);
+    size_t mask = _slotCount - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        Index index = _slots[slot];
+        if (index == kNotFound || (_hashes[index] == hash && this->key(index) == key)) {
+            return index;
+        }
+    }
+}
+
+IdInterner::IdInterner()
+    : _keyOffsets(1, 0), _slots(kInitialSlotCount, kNotFound) {}
+
+size_t IdInterner::probe(std::string_view key, uint64_t hash) const {
+    size_t mask = _slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        Index index = _slots[slot];
+        if (index == kNotFound || (_hashes[index] == hash && this->key(index) == key)) {
+            return slot;
+        }
+    }
+}
+
+IdInterner::Index IdInterner::intern(std::string_view key) {
+    uint64_t hash = hashKey(key);
+    size_t slot = probe(key, hash);
+    if (_slots[slot] != kNotFound) {
+        return _slots[slot];
+    }
+
+    Index index = static_cast<Index>(_hashes.size());
+    _arena.insert(_arena.end(), key.begin(), key.end());
+    _keyOffsets.push_back(_arena.size());
+    _hashes.push_back(hash);
+    _slots[slot] = index;
+
+    // Keep the load factor at or below one half so probe chains stay short
+    if (_hashes.size() * 2 > _slots.size()) {
+        rehash(_slots.size() * 2);
+    }
+    return index;
+}
+
+IdInterner::Index IdInterner::find(std::string_view key) const {
+    return _slots[probe(key, hashKey(key))];
+}
+
+void IdInterner::reserve(size_t keyCount) {
+    _hashes.reserve(keyCount);
+    _keyOffsets.reserve(keyCount + 1);
+
+    size_t slotCount = _slots.size();
+    while (slotCount < keyCount * 2) {
+        slotCount *= 2;
+    }
+    if (slotCount != _slots.size()) {
+        rehash(slotCount);
+    }
+}
+
+void IdInterner::clear() {
+    _arena.clear();
+    _keyOffsets.assign(1, 0);
+    _hashes.clear();
+    _slots.assign(kInitialSlotCount, kNotFound);
+}
+
+void IdInterner::rehash(size_t slotCount) {
+    _slots.assign(slotCount, kNotFound);
+    size_t mask = slotCount - 1;
+    for (Index index = 0; index < _hashes.size(); ++index) {
+        size_t slot = _hashes[index] & mask;
+        while (_slots[slot] != kNotFound) {
+            slot = (slot + 1) & mask;
+        }
+        _slots[slot] = index;
+    }
+}
+
+size_t IdInterner::memoryUsageBytes() const {
+    return _arena.capacity() +
+           _keyOffsets.capacity() * sizeof(uint64_t) +
+           _hashes.capacity() * sizeof(uint64_t) +
+           _slots.capacity() * sizeof(Index);
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <bsoncxx/oid.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Read-only view of the tables of an IdInterner, wherever they live: in the
+ * interner itself or in a mapped snapshot file. Indices and lookups are the
+ * same as in the interner the tables came from.
+ */
+class IdDictionary {
+public:
+    using Index = uint32_t;
+
+    static constexpr Index kNotFound = UINT32_MAX;
+
+    IdDictionary() = default;
+
+    /**
+     * `keyOffsets` has size + 1 entries into `arena`, `hashes` one
+     * IdInterner::hashKey() per key and `slots` is a power-of-two table
+     */
+    IdDictionary(
+        const char* arena,
+        const uint64_t* keyOffsets,
+        const uint64_t* hashes,
+        const Index* slots,
+        size_t size,
+        size_t slotCount)
+        : _arena(arena),
+          _keyOffsets(keyOffsets),
+          _hashes(hashes),
+          _slots(slots),
+          _size(size),
+          _slotCount(slotCount) {}
+
+    Index find(std::string_view key) const;
+    Index find(const bsoncxx::oid& oid) const {
+        return find(std::string_view(oid.bytes(), oid.size()));
+    }
+
+    std::string_view key(Index index) const {
+        return std::string_view(_arena + _keyOffsets[index],
+                                _keyOffsets[index + 1] - _keyOffsets[index]);
+    }
+    bsoncxx::oid oid(Index index) const {
+        auto raw = key(index);
+        return bsoncxx::oid(raw.data(), raw.size());
+    }
+
+    size_t size() const { return _size; }
+
+private:
+    const char* _arena = nullptr;
+    const uint64_t* _keyOffsets = nullptr;
+    const uint64_t* _hashes = nullptr;
+    const Index* _slots = nullptr;
+    size_t _size = 0;
+    size_t _slotCount = 0;
+};
+
+/**
+ * Maps node ids to dense uint32_t indices in discovery order.
+ *
+ * Keys are copied once into a flat byte arena and looked up through an
+ * open-addressing table, so neither interning a known id nor a failed lookup
+ * allocates. ObjectIds are keyed by their 12 raw bytes; a single interner
+ * should hold either ObjectIds or strings, not both.
+ *
+ * Traversals use the indices to keep visited/parent/distance state in flat
+ * arrays instead of node-based hash maps.
+ */
+class IdInterner {
+public:
+    using Index = uint32_t;
+
+    static constexpr Index kNotFound = UINT32_MAX;
+
+    IdInterner();
+
+    /**
+     * Index of a key, assigning the next free index if it is new
+     */
+    Index intern(std::string_view key);
+    Index intern(const bsoncxx::oid& oid) { return intern(oidKey(oid)); }
+
+    /**
+     * Index of a key, or kNotFound if it was never interned
+     */
+    Index find(std::string_view key) const;
+    Index find(const bsoncxx::oid& oid) const { return find(oidKey(oid)); }
+
+    std::string_view key(Index index) const {
+        return std::string_view(_arena.data() + _keyOffsets[index],
+                                _keyOffsets[index + 1] - _keyOffsets[index]);
+    }
+    bsoncxx::oid oid(Index index) const {
+        auto raw = key(index);
+        return bsoncxx::oid(raw.data(), raw.size());
+    }
+
+    size_t size() const { return _hashes.size(); }
+    bool empty() const { return _hashes.empty(); }
+
+    void reserve(size_t keyCount);
+    void clear();
+
+    /**
+     * Bytes held by the arena and the lookup table
+     */
+    size_t memoryUsageBytes() const;
+
+    /**
+     * View of the current tables; invalidated by intern(), reserve() and
+     * clear()
+     */
+    IdDictionary dictionary() const {
+        return IdDictionary(_arena.data(), _keyOffsets.data(), _hashes.data(),
+                            _slots.data(), _hashes.size(), _slots.size());
+    }
+
+    // The tables themselves, to write them where an IdDictionary can read them
+    const std::vector<char>& arena() const { return _arena; }
+    const std::vector<uint64_t>& keyOffsets() const { return _keyOffsets; }
+    const std::vector<uint64_t>& hashes() const { return _hashes; }
+    const std::vector<Index>& slots() const { return _slots; }
+
+    /**
+     * FNV-1a hash of a key. Fixed rather than std::hash so tables written to
+     * disk by one build stay valid for another.
+     */
+    static uint64_t hashKey(std::string_view key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    static std::string_view oidKey(const bsoncxx::oid& oid) {
+        return std::string_view(oid.bytes(), oid.size());
+    }
+
+    size_t probe(std::string_view key, uint64_t hash) const;
+    void rehash(size_t slotCount);
+
+    std::vector<char> _arena;
+    std::vector<uint64_t> _keyOffsets;  // size() + 1 entries into _arena
+    std::vector<uint64_t> _hashes;      // Cached key hashes, one per index
+    std::vector<Index> _slots;          // Power-of-two table of indices
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Min-heap of items 0..capacity-1 with a position index, so every item is in
+ * the heap at most once and its key can be lowered in place (decrease-key).
+ *
+ * A d-ary layout keeps the tree shallow and the children of a slot adjacent
+ * in memory; Arity = 4 is a good default for graph searches where pushes and
+ * decrease-keys outnumber pops.
+ */
+template <typename Key, unsigned Arity = 4>
+class IndexedHeap {
+public:
+    using Item = uint32_t;
+
+    explicit IndexedHeap(size_t capacity = 0)
+        : _position(capacity, kNotInHeap) {}
+
+    bool empty() const { return _heap.empty(); }
+    size_t size() const { return _heap.size(); }
+
+    bool contains(Item item) const { return _position[item] != kNotInHeap; }
+
+    Item top() const { return _heap.front().second; }
+    const Key& topKey() const { return _heap.front().first; }
+
+    /**
+     * Insert an item, or lower its key if it is already queued with a larger
+     * one. Returns false if the existing key is already smaller or equal.
+     */
+    bool pushOrDecrease(Item item, const Key& key) {
+        uint32_t slot = _position[item];
+        if (slot == kNotInHeap) {
+            slot = static_cast<uint32_t>(_heap.size());
+            _heap.emplace_back(key, item);
+            _position[item] = slot;
+        } else if (key < _heap[slot].first) {
+            _heap[slot].first = key;
+        } else {
+            return false;
+        }
+        siftUp(slot);
+        return true;
+    }
+
+    /**
+     * Insert an item or move it to a new key, higher or lower
+     */
+    void pushOrUpdate(Item item, const Key& key) {
+        uint32_t slot = _position[item];
+        if (slot == kNotInHeap || key < _heap[slot].first) {
+            pushOrDecrease(item, key);
+        } else {
+            _heap[slot].first = key;
+            siftDown(slot);
+        }
+    }
+
+    void pop() {
+        _position[_heap.front().second] = kNotInHeap;
+        if (_heap.size() > 1) {
+            _heap.front() = _heap.back();
+            _heap.pop_back();
+            _position[_heap.front().second] = 0;
+            siftDown(0);
+        } else {
+            _heap.pop_back();
+        }
+    }
+
+    /**
+     * Empty the heap in O(size) and make room for `capacity` items
+     */
+    void reset(size_t capacity) {
+        for (const auto& entry : _heap) {
+            _position[entry.second] = kNotInHeap;
+        }
+        _heap.clear();
+        if (_position.size() < capacity) {
+            _position.resize(capacity, kNotInHeap);
+        }
+    }
+
+private:
+    static constexpr uint32_t kNotInHeap = UINT32_MAX;
+
+    void place(uint32_t slot, std::pair<Key, Item> entry) {
+        _position[entry.second] = slot;
+        _heap[slot] = std::move(entry);
+    }
+
+    void siftUp(uint32_t slot) {
+        auto entry = std::move(_heap[slot]);
+        while (slot > 0) {
+            uint32_t parent = (slot - 1) / Arity;
+            if (!(entry.first < _heap[parent].first)) {
+                break;
+            }
+            place(slot, std::move(_heap[parent]));
+            slot = parent;
+        }
+        place(slot, std::move(entry));
+    }
+
+    void siftDown(uint32_t slot) {
+        auto entry = std::move(_heap[slot]);
+        size_t count = _heap.size();
+        while (true) {
+            size_t first = static_cast<size_t>(slot) * Arity + 1;
+            if (first >= count) {
+                break;
+            }
+            size_t last = first + Arity < count ? first + Arity : count;
+            size_t best = first;
+            for (size_t child = first + 1; child < last; ++child) {
+                if (_heap[child].first < _heap[best].first) {
+                    best = child;
+                }
+            }
+            if (!(_heap[best].first < entry.first)) {
+                break;
+            }
+            place(slot, std::move(_heap[best]));
+            slot = static_cast<uint32_t>(best);
+        }
+        place(slot, std::move(entry));
+    }
+
+    std::vector<std::pair<Key, Item>> _heap;
+    std::vector<uint32_t> _position;  // Heap slot of each item, or kNotInHeap
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,288 @@
+#include "landmark_table.h"
+#include "indexed_heap.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+using NodeIndex = GraphSnapshot::NodeIndex;
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+// File layout (host byte order):
+//   magic, version, node count, edge count, graph fingerprint, landmark count,
+//   landmark ids, then one (id, fromLandmark row, toLandmark row) per node.
+// Ids are length-prefixed strings as returned by GraphSnapshot::nodeId().
+constexpr char kFileMagic[8] = {'G', 'X', 'A', 'L', 'T', 'B', 'L', '\0'};
+constexpr uint32_t kFileVersion = 2;
+
+// Single-source Dijkstra over the whole snapshot, following edges backwards
+// when `reverse` is set so distance[v] becomes dist(v, source)
+void shortestDistances(
+    const GraphSnapshot& graph,
+    NodeIndex source,
+    bool reverse,
+    IndexedHeap<double>& queue,
+    std::vector<double>& distance) {
+
+    distance.assign(graph.nodeCount(), kInfinity);
+    queue.reset(graph.nodeCount());
+
+    distance[source] = 0;
+    queue.pushOrDecrease(source, 0);
+
+    while (!queue.empty()) {
+        NodeIndex current = queue.top();
+        double currentDistance = queue.topKey();
+        queue.pop();
+
+        auto relax = [&](NodeIndex next, double weight) {
+            double candidate = currentDistance + weight;
+            if (candidate < distance[next]) {
+                distance[next] = candidate;
+                queue.pushOrDecrease(next, candidate);
+            }
+        };
+
+        if (reverse) {
+            for (auto edge = graph.inEdgeBegin(current); edge < graph.inEdgeEnd(current); ++edge) {
+                relax(graph.inSource(edge), graph.weight(graph.inEdge(edge)));
+            }
+        } else {
+            for (auto edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+                relax(graph.target(edge), graph.weight(edge));
+            }
+        }
+    }
+}
+
+size_t degree(const GraphSnapshot& graph, NodeIndex node) {
+    return (graph.edgeEnd(node) - graph.edgeBegin(node)) +
+           (graph.inEdgeEnd(node) - graph.inEdgeBegin(node));
+}
+
+template <typename T>
+void writeValue(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void writeId(std::ofstream& out, const std::string& id) {
+    writeValue(out, static_cast<uint32_t>(id.size()));
+    out.write(id.data(), static_cast<std::streamsize>(id.size()));
+}
+
+bool readId(std::ifstream& in, std::string& id) {
+    uint32_t length = 0;
+    if (!readValue(in, length)) {
+        return false;
+    }
+    id.resize(length);
+    return static_cast<bool>(in.read(id.data(), length));
+}
+
+} // namespace
+
+std::shared_ptr<const LandmarkTable> LandmarkTable::build(
+    const GraphSnapshot& graph,
+    size_t landmarkCount,
+    LandmarkSelection selection) {
+
+    std::shared_ptr<LandmarkTable> table(new LandmarkTable());
+    size_t nodeCount = graph.nodeCount();
+    size_t count = std::min(landmarkCount, nodeCount);
+    table->_nodeCount = nodeCount;
+    table->_landmarks.reserve(count);
+    table->_fromLandmark.assign(nodeCount * count, kInfinity);
+    table->_toLandmark.assign(nodeCount * count, kInfinity);
+
+    if (selection == LandmarkSelection::kDegree) {
+        std::vector<NodeIndex> nodes(nodeCount);
+        for (NodeIndex node = 0; node < nodeCount; ++node) {
+            nodes[node] = node;
+        }
+        std::partial_sort(nodes.begin(), nodes.begin() + count, nodes.end(),
+            [&](NodeIndex a, NodeIndex b) { return degree(graph, a) > degree(graph, b); });
+        table->_landmarks.assign(nodes.begin(), nodes.begin() + count);
+    }
+
+    IndexedHeap<double> queue(nodeCount);
+    std::vector<double> distance;
+
+    // Distance from each node to the nearest landmark chosen so far, used by
+    // farthest-first selection; nodes no landmark reaches stay at infinity
+    std::vector<double> nearestLandmark(nodeCount, kInfinity);
+
+    for (size_t i = 0; i < count; ++i) {
+        NodeIndex landmark;
+        if (selection == LandmarkSelection::kDegree) {
+            landmark = table->_landmarks[i];
+        } else {
+            // Start from the best connected node, then keep picking the node
+            // farthest from every landmark so far (ties go to higher degree)
+            landmark = 0;
+            for (NodeIndex node = 1; node < nodeCount; ++node) {
+                if (nearestLandmark[node] > nearestLandmark[landmark] ||
+                    (nearestLandmark[node] == nearestLandmark[landmark] &&
+                     degree(graph, node) > degree(graph, landmark))) {
+                    landmark = node;
+                }
+            }
+            table->_landmarks.push_back(landmark);
+        }
+
+        shortestDistances(graph, landmark, false, queue, distance);
+        for (NodeIndex node = 0; node < nodeCount; ++node) {
+            table->_fromLandmark[node * count + i] = distance[node];
+            nearestLandmark[node] = std::min(nearestLandmark[node], distance[node]);
+        }
+
+        shortestDistances(graph, landmark, true, queue, distance);
+        for (NodeIndex node = 0; node < nodeCount; ++node) {
+            table->_toLandmark[node * count + i] = distance[node];
+        }
+    }
+
+    return table;
+}
+
+double LandmarkTable::lowerBound(NodeIndex node, NodeIndex target) const {
+    size_t count = _landmarks.size();
+    const double* fromNode = &_fromLandmark[node * count];
+    const double* fromTarget = &_fromLandmark[target * count];
+    const double* toNode = &_toLandmark[node * count];
+    const double* toTarget = &_toLandmark[target * count];
+
+    double bound = 0;
+    for (size_t i = 0; i < count; ++i) {
+        // dist(v, t) >= dist(L, t) - dist(L, v)
+        if (fromNode[i] != kInfinity) {
+            if (fromTarget[i] == kInfinity) {
+                return kInfinity;  // L reaches v but not t, so v cannot reach t
+            }
+            bound = std::max(bound, fromTarget[i] - fromNode[i]);
+        }
+        // dist(v, t) >= dist(v, L) - dist(t, L)
+        if (toTarget[i] != kInfinity) {
+            if (toNode[i] == kInfinity) {
+                return kInfinity;  // t reaches L but v does not, so v cannot reach t
+            }
+            bound = std::max(bound, toNode[i] - toTarget[i]);
+        }
+    }
+    return bound;
+}
+
+bool LandmarkTable::save(const std::string& path, const GraphSnapshot& graph) const {
+    if (graph.nodeCount() != _nodeCount) {
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    size_t count = _landmarks.size();
+    out.write(kFileMagic, sizeof(kFileMagic));
+    writeValue(out, kFileVersion);
+    writeValue(out, static_cast<uint64_t>(_nodeCount));
+    writeValue(out, static_cast<uint64_t>(graph.edgeCount()));
+    writeValue(out, graph.fingerprint());
+    writeValue(out, static_cast<uint32_t>(count));
+
+    for (NodeIndex landmark : _landmarks) {
+        writeId(out, graph.nodeId(landmark));
+    }
+    for (NodeIndex node = 0; node < _nodeCount; ++node) {
+        writeId(out, graph.nodeId(node));
+        out.write(reinterpret_cast<const char*>(&_fromLandmark[node * count]),
+                  static_cast<std::streamsize>(count * sizeof(double)));
+        out.write(reinterpret_cast<const char*>(&_toLandmark[node * count]),
+                  static_cast<std::streamsize>(count * sizeof(double)));
+    }
+
+    return static_cast<bool>(out);
+}
+
+std::shared_ptr<const LandmarkTable> LandmarkTable::load(
+    const std::string& path,
+    const GraphSnapshot& graph) {
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+
+    char magic[sizeof(kFileMagic)];
+    uint32_t version = 0;
+    uint64_t nodeCount = 0;
+    uint64_t edgeCount = 0;
+    uint64_t fingerprint = 0;
+    uint32_t count = 0;
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+        !readValue(in, version) || version != kFileVersion ||
+        !readValue(in, nodeCount) || !readValue(in, edgeCount) ||
+        !readValue(in, fingerprint) || !readValue(in, count) ||
+        nodeCount != graph.nodeCount() || count > nodeCount) {
+        return nullptr;
+    }
+    // Distances over other edges may overestimate, and A* would then miss
+    // shortest paths
+    if (edgeCount != graph.edgeCount() || fingerprint != graph.fingerprint()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<LandmarkTable> table(new LandmarkTable());
+    table->_nodeCount = graph.nodeCount();
+    table->_fromLandmark.assign(nodeCount * count, kInfinity);
+    table->_toLandmark.assign(nodeCount * count, kInfinity);
+
+    std::string id;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!readId(in, id)) {
+            return nullptr;
+        }
+        NodeIndex landmark = graph.findNode(id);
+        if (landmark == GraphSnapshot::kInvalidNode) {
+            return nullptr;
+        }
+        table->_landmarks.push_back(landmark);
+    }
+
+    // Rows are stored by id, so map each one onto this snapshot's index and
+    // make sure every node of the snapshot gets exactly one
+    std::vector<bool> seen(nodeCount, false);
+    for (uint64_t row = 0; row < nodeCount; ++row) {
+        if (!readId(in, id)) {
+            return nullptr;
+        }
+        NodeIndex node = graph.findNode(id);
+        if (node == GraphSnapshot::kInvalidNode || seen[node]) {
+            return nullptr;
+        }
+        seen[node] = true;
+        if (!in.read(reinterpret_cast<char*>(&table->_fromLandmark[node * count]),
+                     static_cast<std::streamsize>(count * sizeof(double))) ||
+            !in.read(reinterpret_cast<char*>(&table->_toLandmark[node * count]),
+                     static_cast<std::streamsize>(count * sizeof(double)))) {
+            return nullptr;
+        }
+    }
+
+    return table;
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "graph_snapshot.h"
+
+namespace mongo {
+namespace graph_extension {
+
+constexpr size_t kDefaultLandmarkCount = 16;
+
+enum class LandmarkSelection {
+    kFarthest,  // Each landmark is the node farthest from those already chosen
+    kDegree     // The nodes with the most incoming plus outgoing edges
+};
+
+/**
+ * Shortest-path distances from and to a small set of landmark nodes of a
+ * GraphSnapshot, used as an A* heuristic (ALT).
+ *
+ * By the triangle inequality, for every landmark L
+ *   dist(v, t) >= dist(L, t) - dist(L, v)  and  dist(v, t) >= dist(v, L) - dist(t, L),
+ * so the largest of these differences is a lower bound on the remaining cost
+ * that never overestimates and is consistent, which keeps A* exact.
+ *
+ * Rows are indexed by the snapshot's node indices, so a table is only valid
+ * for the snapshot it was built for (or loaded against).
+ */
+class LandmarkTable {
+public:
+    using NodeIndex = GraphSnapshot::NodeIndex;
+
+    /**
+     * Pick `landmarkCount` landmarks and run a forward and a reverse Dijkstra
+     * from each of them over the whole snapshot
+     */
+    static std::shared_ptr<const LandmarkTable> build(
+        const GraphSnapshot& graph,
+        size_t landmarkCount = kDefaultLandmarkCount,
+        LandmarkSelection selection = LandmarkSelection::kFarthest);
+
+    /**
+     * Write the table to a binary file, keyed by the node ids of `graph` (the
+     * snapshot it was built for) rather than by index, so it can be reloaded
+     * against a later snapshot of the same graph.
+     * Returns false if the file cannot be written.
+     */
+    bool save(const std::string& path, const GraphSnapshot& graph) const;
+
+    /**
+     * Read a table written by save() and map its rows onto `graph`. Returns
+     * nullptr if the file is missing or malformed, or if its nodes, edges or
+     * weights do not match the snapshot (the graph has changed and the table
+     * must be rebuilt).
+     */
+    static std::shared_ptr<const LandmarkTable> load(
+        const std::string& path,
+        const GraphSnapshot& graph);
+
+    size_t landmarkCount() const { return _landmarks.size(); }
+    size_t nodeCount() const { return _nodeCount; }
+    const std::vector<NodeIndex>& landmarks() const { return _landmarks; }
+
+    /**
+     * Lower bound on the cost of any path from `node` to `target`; infinity
+     * if the landmarks prove there is none
+     */
+    double lowerBound(NodeIndex node, NodeIndex target) const;
+
+private:
+    LandmarkTable() = default;
+
+    size_t _nodeCount = 0;
+    std::vector<NodeIndex> _landmarks;
+
+    // Node-major rows of landmarkCount() entries, so one bound reads two
+    // contiguous rows per node; unreachable pairs hold infinity
+    std::vector<double> _fromLandmark;  // dist(L, v)
+    std::vector<double> _toLandmark;    // dist(v, L)
+};
+
+} // namespace graph_extension
+} // namespace mongo
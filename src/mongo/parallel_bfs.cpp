@@ -0,0 +1,302 @@
+#include "parallel_bfs.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+using NodeIndex = GraphSnapshot::NodeIndex;
+using EdgeIndex = GraphSnapshot::EdgeIndex;
+
+// Beamer's thresholds: go bottom-up once the frontier's edges exceed
+// 1/kAlpha of the unexplored edges, back to top-down once the frontier
+// holds fewer than 1/kBeta of the nodes
+constexpr size_t kAlpha = 14;
+constexpr size_t kBeta = 24;
+
+constexpr size_t kFrontierGrain = 256;  // Frontier nodes per top-down chunk
+constexpr size_t kNodeGrain = 4096;     // Nodes per bottom-up chunk
+
+class AtomicBitmap {
+public:
+    explicit AtomicBitmap(size_t bitCount) : _words((bitCount + 63) / 64) {}
+
+    bool test(size_t bit) const {
+        return (_words[bit >> 6].load(std::memory_order_relaxed) & mask(bit)) != 0;
+    }
+
+    // Set a bit; true only for the one caller that changed it
+    bool claim(size_t bit) {
+        uint64_t bitMask = mask(bit);
+        return (_words[bit >> 6].fetch_or(bitMask, std::memory_order_relaxed) & bitMask) == 0;
+    }
+
+    void clear(ThreadPool& pool) {
+        pool.parallelFor(_words.size(), kNodeGrain, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                _words[i].store(0, std::memory_order_relaxed);
+            }
+        });
+    }
+
+private:
+    static uint64_t mask(size_t bit) { return uint64_t{1} << (bit & 63); }
+
+    std::vector<std::atomic<uint64_t>> _words;
+};
+
+// One direction of a search. The forward side pushes along outgoing edges
+// and pulls from incoming ones; the backward side does the opposite.
+struct SearchSide {
+    SearchSide(const GraphSnapshot& graph, bool isForward, NodeIndex root)
+        : forward(isForward),
+          visited(graph.nodeCount()),
+          parent(graph.nodeCount(), GraphSnapshot::kInvalidNode),
+          depth(graph.nodeCount(), 0),
+          frontier{root},
+          unexploredEdges(graph.edgeCount()) {
+        visited.claim(root);
+        frontierEdges = pushDegree(graph, root);
+    }
+
+    size_t pushDegree(const GraphSnapshot& graph, NodeIndex node) const {
+        return forward ? graph.edgeEnd(node) - graph.edgeBegin(node)
+                       : graph.inEdgeEnd(node) - graph.inEdgeBegin(node);
+    }
+
+    template <typename Visitor>
+    void forEachPushNeighbor(const GraphSnapshot& graph, NodeIndex node, Visitor&& visit) const {
+        if (forward) {
+            for (EdgeIndex e = graph.edgeBegin(node); e < graph.edgeEnd(node); ++e) {
+                visit(graph.target(e));
+            }
+        } else {
+            for (EdgeIndex e = graph.inEdgeBegin(node); e < graph.inEdgeEnd(node); ++e) {
+                visit(graph.inSource(e));
+            }
+        }
+    }
+
+    // Visit pull neighbors until visit() returns false
+    template <typename Visitor>
+    void forEachPullNeighbor(const GraphSnapshot& graph, NodeIndex node, Visitor&& visit) const {
+        if (forward) {
+            for (EdgeIndex e = graph.inEdgeBegin(node); e < graph.inEdgeEnd(node); ++e) {
+                if (!visit(graph.inSource(e))) {
+                    return;
+                }
+            }
+        } else {
+            for (EdgeIndex e = graph.edgeBegin(node); e < graph.edgeEnd(node); ++e) {
+                if (!visit(graph.target(e))) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Pick the direction of the next level from the frontier's size
+    void chooseDirection(size_t nodeCount) {
+        if (!bottomUp && frontierEdges > unexploredEdges / kAlpha) {
+            bottomUp = true;
+        } else if (bottomUp && frontier.size() < nodeCount / kBeta) {
+            bottomUp = false;
+        }
+    }
+
+    bool forward;
+    AtomicBitmap visited;
+    std::vector<NodeIndex> parent;  // Written once, by the thread that claims the node
+    std::vector<int> depth;
+    std::vector<NodeIndex> frontier;
+    std::unique_ptr<AtomicBitmap> inFrontier;  // Frontier as a bitmap, for bottom-up levels
+    int level = 0;
+    bool bottomUp = false;
+    size_t frontierEdges = 0;    // Push-direction edges leaving the frontier
+    size_t unexploredEdges = 0;  // Edges not yet leaving any expanded level
+};
+
+// Shortest meeting seen by a worker: total path length through `node`
+struct Meeting {
+    int length = std::numeric_limits<int>::max();
+    NodeIndex node = GraphSnapshot::kInvalidNode;
+};
+
+// Per-worker results of a level, padded against false sharing
+struct alignas(64) LevelOutput {
+    std::vector<NodeIndex> next;
+    size_t nextEdges = 0;
+    Meeting meeting;
+};
+
+// Expand the whole frontier of `side` by one level with the chosen direction.
+// If `other` is given, nodes it has already visited are reported as meetings;
+// returns the shortest one found in this level.
+Meeting expandLevel(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    SearchSide& side,
+    const SearchSide* other) {
+
+    std::vector<LevelOutput> outputs(pool.threadCount());
+    int nextDepth = side.level + 1;
+    side.unexploredEdges -= std::min(side.frontierEdges, side.unexploredEdges);
+
+    auto discover = [&](NodeIndex node, NodeIndex from, LevelOutput& output) {
+        side.parent[node] = from;
+        side.depth[node] = nextDepth;
+        output.next.push_back(node);
+        output.nextEdges += side.pushDegree(graph, node);
+        if (other && other->visited.test(node)) {
+            int length = nextDepth + other->depth[node];
+            if (length < output.meeting.length) {
+                output.meeting = {length, node};
+            }
+        }
+    };
+
+    if (!side.bottomUp) {
+        // Top-down: frontier nodes race to claim their unvisited neighbors
+        pool.parallelFor(side.frontier.size(), kFrontierGrain,
+            [&](size_t begin, size_t end, size_t worker) {
+                LevelOutput& output = outputs[worker];
+                for (size_t i = begin; i < end; ++i) {
+                    NodeIndex current = side.frontier[i];
+                    side.forEachPushNeighbor(graph, current, [&](NodeIndex neighbor) {
+                        if (side.visited.claim(neighbor)) {
+                            discover(neighbor, current, output);
+                        }
+                    });
+                }
+            });
+    } else {
+        // Bottom-up: every unvisited node looks for one parent in the frontier.
+        // Each node is handled by a single chunk, so no claim can be contended.
+        if (!side.inFrontier) {
+            side.inFrontier = std::make_unique<AtomicBitmap>(graph.nodeCount());
+        } else {
+            side.inFrontier->clear(pool);
+        }
+        pool.parallelFor(side.frontier.size(), kFrontierGrain,
+            [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i) {
+                    side.inFrontier->claim(side.frontier[i]);
+                }
+            });
+
+        pool.parallelFor(graph.nodeCount(), kNodeGrain,
+            [&](size_t begin, size_t end, size_t worker) {
+                LevelOutput& output = outputs[worker];
+                for (NodeIndex node = static_cast<NodeIndex>(begin); node < end; ++node) {
+                    if (side.visited.test(node)) {
+                        continue;
+                    }
+                    side.forEachPullNeighbor(graph, node, [&](NodeIndex neighbor) {
+                        if (!side.inFrontier->test(neighbor)) {
+                            return true;
+                        }
+                        side.visited.claim(node);
+                        discover(node, neighbor, output);
+                        return false;
+                    });
+                }
+            });
+    }
+
+    side.frontier.clear();
+    side.frontierEdges = 0;
+    Meeting best;
+    for (const auto& output : outputs) {
+        side.frontier.insert(side.frontier.end(), output.next.begin(), output.next.end());
+        side.frontierEdges += output.nextEdges;
+        if (output.meeting.length < best.length) {
+            best = output.meeting;
+        }
+    }
+    side.level = nextDepth;
+    return best;
+}
+
+// Path from the root of `side` to `node`, root first
+std::vector<NodeIndex> tracePath(const SearchSide& side, NodeIndex node) {
+    std::vector<NodeIndex> path;
+    for (NodeIndex current = node; current != GraphSnapshot::kInvalidNode;
+         current = side.parent[current]) {
+        path.push_back(current);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+} // namespace
+
+std::vector<GraphSnapshot::NodeIndex> parallelBfsPath(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    GraphSnapshot::NodeIndex start,
+    GraphSnapshot::NodeIndex end,
+    int maxDepth,
+    std::vector<LevelStats>& levels) {
+
+    if (start == end) {
+        return {start};
+    }
+
+    SearchSide side(graph, true, start);
+    while (!side.frontier.empty() && side.level < maxDepth) {
+        side.chooseDirection(graph.nodeCount());
+        levels.push_back({true, side.level, static_cast<int>(side.frontier.size()), side.bottomUp});
+        expandLevel(graph, pool, side, nullptr);
+
+        if (side.visited.test(end)) {
+            return tracePath(side, end);
+        }
+    }
+    return {};
+}
+
+std::vector<GraphSnapshot::NodeIndex> parallelBidirectionalBfsPath(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    GraphSnapshot::NodeIndex start,
+    GraphSnapshot::NodeIndex end,
+    int maxDepth,
+    std::vector<LevelStats>& levels) {
+
+    if (start == end) {
+        return {start};
+    }
+
+    SearchSide forward(graph, true, start);
+    SearchSide backward(graph, false, end);
+
+    while (!forward.frontier.empty() && !backward.frontier.empty() &&
+           forward.level + backward.level < maxDepth) {
+        bool expandForward = forward.frontier.size() <= backward.frontier.size();
+        SearchSide& side = expandForward ? forward : backward;
+        const SearchSide& other = expandForward ? backward : forward;
+
+        side.chooseDirection(graph.nodeCount());
+        levels.push_back({side.forward, side.level,
+                          static_cast<int>(side.frontier.size()), side.bottomUp});
+        Meeting meeting = expandLevel(graph, pool, side, &other);
+
+        if (meeting.node != GraphSnapshot::kInvalidNode) {
+            std::vector<NodeIndex> path = tracePath(forward, meeting.node);
+            for (NodeIndex current = backward.parent[meeting.node];
+                 current != GraphSnapshot::kInvalidNode; current = backward.parent[current]) {
+                path.push_back(current);
+            }
+            return path;
+        }
+    }
+    return {};
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "graph_snapshot.h"
+#include "path_finding.h"
+#include "thread_pool.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Direction-optimizing BFS over a GraphSnapshot, run level by level on a
+ * ThreadPool.
+ *
+ * A level is expanded either top-down (every frontier node pushes to its
+ * unvisited neighbors) or bottom-up (every unvisited node pulls from the
+ * first neighbor it finds in the frontier), following Beamer et al.: switch
+ * to bottom-up once the frontier's edges exceed 1/14 of the edges not yet
+ * explored, and back to top-down once the frontier drops below 1/24 of the
+ * nodes. On low-diameter graphs the few huge middle levels then cost a scan
+ * of the nodes instead of a scan of every edge. Visited nodes are claimed in
+ * an atomic bitmap, so each node gets exactly one parent.
+ *
+ * Both functions return the snapshot nodes of a shortest path, start first,
+ * or an empty vector if end is not reachable within maxDepth edges, and
+ * append one LevelStats per expanded level.
+ */
+std::vector<GraphSnapshot::NodeIndex> parallelBfsPath(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    GraphSnapshot::NodeIndex start,
+    GraphSnapshot::NodeIndex end,
+    int maxDepth,
+    std::vector<LevelStats>& levels);
+
+/**
+ * Same, searching from both ends: each round expands a whole level on the
+ * side with the smaller frontier (the backward side over the reverse CSR),
+ * and the search stops at the first level in which the two sides meet.
+ */
+std::vector<GraphSnapshot::NodeIndex> parallelBidirectionalBfsPath(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    GraphSnapshot::NodeIndex start,
+    GraphSnapshot::NodeIndex end,
+    int maxDepth,
+    std::vector<LevelStats>& levels);
+
+} // namespace graph_extension
+} // namespace mongo
@@ -1,11 +1,23 @@
 #include "path_finding.h"
+#include "fetch_pipeline.h"
+#include "graph_connections.h"
+#include "id_interner.h"
+#include "indexed_heap.h"
+#include "parallel_bfs.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <limits>
+#include <optional>
 #include <queue>
+#include <set>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <bsoncxx/builder/stream/document.hpp>
 #include <bsoncxx/builder/stream/array.hpp>
 #include <mongocxx/client.hpp>
 #include <mongocxx/uri.hpp>
+#include <mongocxx/options/find.hpp>
 
 using bsoncxx::builder::stream::document;
 using bsoncxx::builder::stream::finalize;
@@ -13,10 +25,10 @@ using bsoncxx::builder::stream::finalize;
 namespace mongo {
 namespace graph_extension {
 
-// Custom hasher for bsoncxx::oid
+// Custom hasher for bsoncxx::oid, hashing the raw 12 bytes without allocating
 struct OidHasher {
     std::size_t operator()(const bsoncxx::oid& oid) const {
-        return std::hash<std::string>{}(oid.to_string());
+        return std::hash<std::string_view>{}(std::string_view(oid.bytes(), oid.size()));
     }
 };
 
@@ -27,6 +39,44 @@ struct OidEqual {
     }
 };
 
+using NodeIndex = IdInterner::Index;
+constexpr NodeIndex kNoNode = IdInterner::kNotFound;
+
+/**
+ * Per-query traversal state for the driver-side searches.
+ * Node ids are interned when first discovered, so "visited" simply means
+ * "has an index" and everything else lives in flat arrays indexed by it.
+ */
+struct TraversalState {
+    IdInterner ids;
+    std::vector<NodeIndex> parent;          // Parent on the forward side
+    std::vector<NodeIndex> backwardParent;  // Parent on the backward side
+    std::vector<int> depth;
+    std::vector<int8_t> direction;          // 1 forward, -1 backward
+    std::vector<std::optional<bsoncxx::document::value>> documents;
+
+    bool isVisited(const bsoncxx::oid& id) const {
+        return ids.find(id) != kNoNode;
+    }
+
+    // Intern a newly discovered node; returns its index
+    NodeIndex visit(const bsoncxx::oid& id, NodeIndex from, int nodeDepth, int8_t nodeDirection) {
+        NodeIndex index = ids.intern(id);
+        if (index == parent.size()) {
+            parent.push_back(nodeDirection > 0 ? from : kNoNode);
+            backwardParent.push_back(nodeDirection < 0 ? from : kNoNode);
+            depth.push_back(nodeDepth);
+            direction.push_back(nodeDirection);
+            documents.emplace_back();
+        }
+        return index;
+    }
+
+    bool hasDocument(NodeIndex index) const {
+        return index != kNoNode && documents[index].has_value();
+    }
+};
+
 bsoncxx::document::value Path::toBSON() const {
         using namespace bsoncxx::builder::stream;
         
@@ -47,7 +97,17 @@ bsoncxx::document::value Path::toBSON() const {
         doc << "pathFound" << !nodes.empty()
             << "depth" << depth
             << "nodes" << nodeArray
-            << "nodeCount" << static_cast<int32_t>(nodes.size());
+            << "nodeCount" << static_cast<int32_t>(nodes.size())
+            << "roundTrips" << roundTrips;
+        
+        if (fromCache) {
+            doc << "fromCache" << true;
+        }
+        
+        // Weighted searches report how many nodes they settled
+        if (settledNodes > 0) {
+            doc << "settledNodes" << settledNodes;
+        }
         
         // Add weight information if it exists
         if (!edgeWeights.empty()) {
@@ -55,155 +115,323 @@ bsoncxx::document::value Path::toBSON() const {
                 << "totalWeight" << totalWeight;
         }
         
+        // Add per-level frontier sizes for BFS searches
+        if (!levels.empty()) {
+            array levelArray;
+            for (const auto& level : levels) {
+                levelArray << open_document
+                    << "direction" << (level.forward ? "forward" : "backward")
+                    << "depth" << level.depth
+                    << "frontierSize" << level.frontierSize;
+                if (level.bottomUp) {
+                    levelArray << "bottomUp" << true;
+                }
+                levelArray << close_document;
+            }
+            doc << "levels" << levelArray;
+        }
+        
         return doc << finalize;
 }
 
+// Collect the neighbor ids referenced by a node's connection array
+template <typename Visitor>
+static void forEachNeighbor(
+    const bsoncxx::document::view& nodeDoc,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    Visitor&& visit) {
+    
+    forEachConnection(nodeDoc, connectToField, connectFromField,
+        [&](const bsoncxx::oid& neighbor, const bsoncxx::document::view&) {
+            visit(neighbor);
+        });
+}
+
+// Traversals only read a node's id and its connection array, so the rest of
+// each document is left on the server until the path is known
+static bsoncxx::document::value makeTraversalProjection(
+    const std::string& connectToField,
+    const std::string& connectFromField) {
+    return document{} << connectFromField << 1 << connectToField << 1 << finalize;
+}
+
+// `{connectFromField: {$in: [ids of nodes[begin, end)]}}`
+static bsoncxx::document::value makeIdInFilter(
+    const std::vector<NodeIndex>& nodes,
+    size_t begin,
+    size_t end,
+    const std::string& connectFromField,
+    const TraversalState& state) {
+    
+    using namespace bsoncxx::builder::stream;
+    
+    array idArray;
+    for (size_t i = begin; i < end; ++i) {
+        idArray << state.ids.oid(nodes[i]);
+    }
+    
+    return document{} 
+        << connectFromField << open_document
+            << "$in" << bsoncxx::types::b_array{idArray.view()}
+        << close_document
+        << finalize;
+}
+
+// Ask for a whole chunk in the first reply so a chunk costs one round trip.
+// An empty projection fetches whole documents.
+static mongocxx::options::find makeFetchOptions(
+    size_t batchSize,
+    const bsoncxx::document::view& projection) {
+    mongocxx::options::find opts;
+    opts.batch_size(static_cast<int32_t>(batchSize));
+    if (!projection.empty()) {
+        opts.projection(projection);
+    }
+    return opts;
+}
+
+// Keep a fetched document if it belongs to an interned node
+static void storeNodeDocument(
+    const bsoncxx::document::view& doc,
+    const std::string& connectFromField,
+    TraversalState& state) {
+    auto idElement = doc[connectFromField];
+    if (!idElement || idElement.type() != bsoncxx::type::k_oid) {
+        return;
+    }
+    NodeIndex index = state.ids.find(idElement.get_oid().value);
+    if (index != kNoNode) {
+        state.documents[index] = bsoncxx::document::value(doc);
+    }
+}
+
+// Fetch the documents for a set of interned nodes using `$in` queries of at
+// most `batchSize` ids each, streaming every cursor into `state.documents`.
+// An empty projection fetches whole documents.
+// Returns the number of queries sent to the server.
+static int fetchNodeDocuments(
+    mongocxx::collection& collection,
+    const std::vector<NodeIndex>& nodes,
+    const std::string& connectFromField,
+    size_t batchSize,
+    TraversalState& state,
+    const bsoncxx::document::view& projection = bsoncxx::document::view{}) {
+    
+    if (batchSize == 0) {
+        batchSize = kDefaultFetchBatchSize;
+    }
+    auto opts = makeFetchOptions(batchSize, projection);
+    
+    int roundTrips = 0;
+    for (size_t offset = 0; offset < nodes.size(); offset += batchSize) {
+        size_t chunkEnd = std::min(nodes.size(), offset + batchSize);
+        auto filter = makeIdInFilter(nodes, offset, chunkEnd, connectFromField, state);
+        
+        auto cursor = collection.find(filter.view(), opts);
+        ++roundTrips;
+        
+        for (auto&& doc : cursor) {
+            storeNodeDocument(doc, connectFromField, state);
+        }
+    }
+    
+    return roundTrips;
+}
+
+// Send the ids of nodes[submitted, end) to the fetch pipeline in chunks of
+// `batchSize` while the level that discovers them is still being expanded.
+// A partial chunk is only sent when `flush` is set, at the end of the level.
+static void submitNodeChunks(
+    FetchPipeline& prefetch,
+    const std::vector<NodeIndex>& nodes,
+    size_t& submitted,
+    size_t batchSize,
+    bool flush,
+    const std::string& connectFromField,
+    const mongocxx::options::find& opts,
+    const TraversalState& state) {
+    while (nodes.size() - submitted >= batchSize ||
+           (flush && submitted < nodes.size())) {
+        size_t chunkEnd = std::min(nodes.size(), submitted + batchSize);
+        prefetch.submit(makeIdInFilter(nodes, submitted, chunkEnd, connectFromField, state), opts);
+        submitted = chunkEnd;
+    }
+}
+
+// Store the documents the pipeline has already buffered, without waiting
+static void receiveReadyDocuments(
+    FetchPipeline& prefetch,
+    const std::string& connectFromField,
+    TraversalState& state) {
+    std::vector<bsoncxx::document::value> batch;
+    while (prefetch.tryNextBatch(batch)) {
+        for (const auto& doc : batch) {
+            storeNodeDocument(doc.view(), connectFromField, state);
+        }
+    }
+}
+
+// Store every document of the submitted chunks as it arrives.
+// Returns the number of queries the pipeline sent to the server.
+static int receiveNodeDocuments(
+    FetchPipeline& prefetch,
+    const std::string& connectFromField,
+    TraversalState& state) {
+    std::vector<bsoncxx::document::value> batch;
+    while (prefetch.nextBatch(batch)) {
+        for (const auto& doc : batch) {
+            storeNodeDocument(doc.view(), connectFromField, state);
+        }
+    }
+    return prefetch.takeRoundTrips();
+}
+
+// Replace the projected documents of the path nodes with full documents
+// fetched by a single `$in` query, then append them to the result in order.
+// Returns the number of queries sent to the server.
+static int hydratePath(
+    mongocxx::collection& collection,
+    const std::vector<NodeIndex>& path,
+    const std::string& connectFromField,
+    TraversalState& state,
+    Path& result) {
+    
+    for (NodeIndex node : path) {
+        state.documents[node].reset();
+    }
+    int roundTrips = fetchNodeDocuments(
+        collection, path, connectFromField, path.size(), state);
+    
+    for (NodeIndex node : path) {
+        if (state.hasDocument(node)) {
+            result.nodes.push_back(*state.documents[node]);
+        }
+    }
+    return roundTrips;
+}
+
 Path findBasicPath(
     mongocxx::collection& collection,
     const bsoncxx::oid& startNodeId,
     const bsoncxx::oid& endNodeId,
     const std::string& connectToField,
     const std::string& connectFromField,
-    int maxDepth) {
+    int maxDepth,
+    size_t fetchBatchSize,
+    FetchPipeline* prefetch) {
     
     Path resultPath;
     
-    // Track visited nodes to avoid cycles
-    std::unordered_set<bsoncxx::oid, OidHasher, OidEqual> visited;
-    
-    // Queue for BFS: (nodeId, depth)
-    std::queue<std::pair<bsoncxx::oid, int>> queue;
-    
-    // Track parent nodes to reconstruct the path
-    std::unordered_map<bsoncxx::oid, bsoncxx::oid, OidHasher, OidEqual> parent;
-    
-    // Track node documents for path reconstruction
-    std::unordered_map<bsoncxx::oid, bsoncxx::document::value, OidHasher, OidEqual> nodeDocuments;
+    if (fetchBatchSize == 0) {
+        fetchBatchSize = kDefaultFetchBatchSize;
+    }
     
-    // Start BFS from the start node
-    queue.push(std::make_pair(startNodeId, 0));
-    visited.insert(startNodeId);
+    // Visited set, parent pointers and projected node documents, indexed by interned id
+    TraversalState state;
+    auto projection = makeTraversalProjection(connectToField, connectFromField);
+    auto fetchOptions = makeFetchOptions(fetchBatchSize, projection.view());
     
     // Find the start node document
-    {
-        using namespace bsoncxx::builder::stream;
-        auto filter = document{} << connectFromField << startNodeId << finalize;
-        auto startNodeDoc = collection.find_one(filter.view());
-        if (startNodeDoc) {
-            nodeDocuments.insert(std::make_pair(
-                startNodeId, 
-                std::move(startNodeDoc.value())
-            ));
-        } else {
-            // Start node not found
-            return resultPath;
-        }
+    NodeIndex startNode = state.visit(startNodeId, kNoNode, 0, 1);
+    resultPath.roundTrips += fetchNodeDocuments(
+        collection, {startNode}, connectFromField, fetchBatchSize, state, projection.view());
+    if (!state.hasDocument(startNode)) {
+        // Start node not found
+        return resultPath;
     }
     
-    bool pathFound = false;
+    NodeIndex endNode = (startNodeId == endNodeId) ? startNode : kNoNode;
     
-    // BFS traversal
-    while (!queue.empty()) {
-        auto current = queue.front();
-        auto currentId = current.first;
-        auto depth = current.second;
-        queue.pop();
+    // Level-synchronous BFS: every node of the current level is expanded from
+    // memory, then all newly discovered ids are fetched together, so the number
+    // of round trips grows with the depth rather than the number of nodes.
+    std::vector<NodeIndex> frontier{startNode};
+    int depth = 0;
+    
+    while (endNode == kNoNode && !frontier.empty() && depth < maxDepth) {
+        std::vector<NodeIndex> nextNodes;
+        size_t submitted = 0;  // nextNodes already sent to the prefetch pipeline
+        resultPath.levels.push_back({true, depth, static_cast<int>(frontier.size())});
         
-        // Check if we've reached the target
-        if (currentId == endNodeId) {
-            resultPath.depth = depth;
-            pathFound = true;
-            break;
+        for (NodeIndex current : frontier) {
+            if (!state.hasDocument(current)) {
+                continue; // Skip if document not found
+            }
+            
+            forEachNeighbor(state.documents[current]->view(), connectToField, connectFromField,
+                [&](const bsoncxx::oid& neighborId) {
+                    // Skip if already visited
+                    if (state.isVisited(neighborId)) {
+                        return;
+                    }
+                    
+                    // Mark as visited and record parent for path reconstruction
+                    nextNodes.push_back(state.visit(neighborId, current, depth + 1, 1));
+                });
+            
+            // An expanded node only needs its parent pointer from now on
+            state.documents[current].reset();
+            
+            // Full chunks of the next level are fetched in the background
+            // while the rest of this level is expanded
+            if (prefetch) {
+                submitNodeChunks(*prefetch, nextNodes, submitted, fetchBatchSize, false,
+                                 connectFromField, fetchOptions, state);
+                receiveReadyDocuments(*prefetch, connectFromField, state);
+            }
         }
+        ++depth;
         
-        // Skip if we've reached maximum depth
-        if (depth >= maxDepth) {
-            continue;
+        // Once the target is discovered the path is known; its documents are
+        // hydrated below
+        endNode = state.ids.find(endNodeId);
+        if (endNode != kNoNode) {
+            if (prefetch) {
+                prefetch->cancel();
+                resultPath.roundTrips += prefetch->takeRoundTrips();
+            }
+            break;
         }
         
-        // Get current node document
-        auto currentDocIt = nodeDocuments.find(currentId);
-        if (currentDocIt == nodeDocuments.end()) {
-            continue; // Skip if document not found
+        if (prefetch) {
+            submitNodeChunks(*prefetch, nextNodes, submitted, fetchBatchSize, true,
+                             connectFromField, fetchOptions, state);
+            resultPath.roundTrips += receiveNodeDocuments(*prefetch, connectFromField, state);
+        } else {
+            resultPath.roundTrips += fetchNodeDocuments(
+                collection, nextNodes, connectFromField, fetchBatchSize, state, projection.view());
         }
         
-        bsoncxx::document::view currentDoc = currentDocIt->second.view();
-        
-        // Check if the node has connections
-        if (currentDoc[connectToField] && currentDoc[connectToField].type() == bsoncxx::type::k_array) {
-            // Iterate through connections
-            for (auto&& connValue : currentDoc[connectToField].get_array().value) {
-                bsoncxx::oid neighborId;
-                
-                // Handle different connection formats (direct OID or embedded document)
-                if (connValue.type() == bsoncxx::type::k_oid) {
-                    neighborId = connValue.get_oid().value;
-                } else if (connValue.type() == bsoncxx::type::k_document && 
-                           connValue.get_document().view()[connectFromField]) {
-                    neighborId = connValue.get_document().view()[connectFromField].get_oid().value;
-                } else {
-                    continue; // Skip invalid connections
-                }
-                
-                // Skip if already visited
-                if (visited.find(neighborId) != visited.end()) {
-                    continue;
-                }
-                
-                // Mark as visited
-                visited.insert(neighborId);
-                
-                // Record parent for path reconstruction
-                parent[neighborId] = currentId;
-                
-                // Fetch the neighbor document
-                using namespace bsoncxx::builder::stream;
-                auto filter = document{} << connectFromField << neighborId << finalize;
-                auto neighborDoc = collection.find_one(filter.view());
-                
-                if (neighborDoc) {
-                    // Store the document for path reconstruction
-                    nodeDocuments.insert(std::make_pair(
-                        neighborId, 
-                        std::move(neighborDoc.value())
-                    ));
-                    
-                    // Add to the queue
-                    queue.push(std::make_pair(neighborId, depth + 1));
-                }
+        // Only nodes whose documents exist continue the search
+        frontier.clear();
+        for (NodeIndex node : nextNodes) {
+            if (state.hasDocument(node)) {
+                frontier.push_back(node);
             }
         }
     }
     
-    // If path found, reconstruct it
-    if (pathFound) {
+    // If the target was reached, reconstruct the path
+    if (endNode != kNoNode) {
         // Start from end node and work backwards
-        std::vector<bsoncxx::oid> path;
-        bsoncxx::oid current = endNodeId;
-        
-        while (true) {
+        std::vector<NodeIndex> path;
+        for (NodeIndex current = endNode; current != kNoNode; current = state.parent[current]) {
             path.push_back(current);
-            if (current == startNodeId) {
-                break;
-            }
-            
-            auto parentIt = parent.find(current);
-            if (parentIt == parent.end()) {
-                // Something went wrong with our path tracking
-                return resultPath;
-            }
-            current = parentIt->second;
         }
         
         // Reverse the path (start to end)
         std::reverse(path.begin(), path.end());
         
-        // Add node documents to the result path
-        for (const auto& nodeId : path) {
-            auto docIt = nodeDocuments.find(nodeId);
-            if (docIt != nodeDocuments.end()) {
-                resultPath.nodes.push_back(docIt->second);
-            }
+        // Fetch the full documents of the path nodes only
+        resultPath.roundTrips += hydratePath(
+            collection, path, connectFromField, state, resultPath);
+        
+        if (state.hasDocument(endNode)) {
+            resultPath.depth = depth;
+        } else {
+            // The target id is referenced but its document does not exist
+            resultPath.nodes.clear();
         }
     }
     
@@ -211,390 +439,1175 @@ Path findBasicPath(
 }
 
 
-struct Edge {
-    std::string to;
-    int weight;
-};
+static bsoncxx::document::value makeNodeIdDocument(std::string_view nodeId) {
+    return document{} << "nodeId" << std::string(nodeId) << finalize;
+}
 
-struct PathStep {
-    std::string node;
-    int cost;
-    std::vector<std::string> path;
+// Fill a result from a path given as the sequence of snapshot edges leading
+// away from `startNode`: one {nodeId} document per node plus per-edge weights
+static void fillWeightedPath(
+    const GraphSnapshot& graph,
+    GraphSnapshot::NodeIndex startNode,
+    const std::vector<GraphSnapshot::EdgeIndex>& edges,
+    Path& result) {
+    
+    result.found = true;
+    result.nodes.push_back(makeNodeIdDocument(graph.nodeId(startNode)));
+    result.totalWeight = 0;
+    for (auto edge : edges) {
+        result.nodes.push_back(makeNodeIdDocument(graph.nodeId(graph.target(edge))));
+        result.edgeWeights.push_back(graph.weight(edge));
+        result.totalWeight += graph.weight(edge);
+    }
+    result.depth = static_cast<int>(edges.size());
+    result.cost = static_cast<int>(result.totalWeight);
+}
+
+namespace {
 
-    bool operator>(const PathStep& other) const {
-        return cost > other.cost;
+// Per-thread state of a Dijkstra search, sized to the graph once and reset by
+// bumping a stamp, so a query only pays for the nodes it touches
+struct DijkstraSearch {
+    std::vector<double> distance;
+    std::vector<GraphSnapshot::NodeIndex> parent;
+    std::vector<GraphSnapshot::EdgeIndex> parentEdge;
+    std::vector<int> hops;
+    std::vector<uint32_t> stamp;       // distance, parents and hops are valid when == epoch
+    std::vector<uint32_t> settled;     // Node is settled when == epoch
+    std::vector<double> lowerBound;    // Landmark bound to the target
+    std::vector<uint32_t> boundStamp;  // lowerBound is valid when == epoch
+    std::vector<int> targets;          // Targets still to settle; zero between searches
+    IndexedHeap<double> queue;
+    uint32_t epoch = 0;
+    
+    void prepare(size_t nodeCount) {
+        if (++epoch == 0 || stamp.size() != nodeCount) {
+            distance.assign(nodeCount, 0);
+            parent.assign(nodeCount, GraphSnapshot::kInvalidNode);
+            parentEdge.assign(nodeCount, 0);
+            hops.assign(nodeCount, 0);
+            stamp.assign(nodeCount, 0);
+            settled.assign(nodeCount, 0);
+            lowerBound.assign(nodeCount, 0);
+            boundStamp.assign(nodeCount, 0);
+            targets.assign(nodeCount, 0);
+            epoch = 1;
+        }
+        queue.reset(nodeCount);
+    }
+    
+    double distanceOf(GraphSnapshot::NodeIndex node) const {
+        return stamp[node] == epoch ? distance[node] : std::numeric_limits<double>::infinity();
+    }
+    
+    bool isSettled(GraphSnapshot::NodeIndex node) const { return settled[node] == epoch; }
+    
+    void reach(GraphSnapshot::NodeIndex node,
+               double nodeDistance,
+               GraphSnapshot::NodeIndex from,
+               GraphSnapshot::EdgeIndex edge,
+               int nodeHops) {
+        distance[node] = nodeDistance;
+        parent[node] = from;
+        parentEdge[node] = edge;
+        hops[node] = nodeHops;
+        stamp[node] = epoch;
     }
 };
 
+// The calling thread's search state: side 0 serves the one-directional
+// searches and the forward side of the bidirectional one, side 1 its backward
+// side. Searches never nest, so one thread never needs a side twice.
+DijkstraSearch& threadDijkstraSearch(size_t side) {
+    thread_local DijkstraSearch searches[2];
+    return searches[side];
+}
+
+} // namespace
 
 Path findWeightedPathImpl(
-    mongocxx::collection& collection,
+    const GraphSnapshot& graph,
     const std::string& start,
     const std::string& end,
-    const std::string& connect_field,
-    const std::string& id_field,
-    const std::string& weight_field,
-    int max_depth
+    int max_depth,
+    const LandmarkTable* landmarks
 ) {
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using EdgeIndex = GraphSnapshot::EdgeIndex;
+    
     Path result;
 
-    // --- Build graph in memory ---
-    std::unordered_map<std::string, std::vector<Edge>> graph;
-    for (auto&& doc : collection.find({})) {
-        std::string from = std::string(doc["from"].get_string().value);
-        std::string to = std::string(doc["to"].get_string().value);
-        int weight = doc["weight"].get_int32();
-
-        graph[from].push_back({to, weight});
+    if (start == end) {
+        result.found = true;
+        result.nodes.push_back(makeNodeIdDocument(start));
+        return result;
     }
 
-    // --- Dijkstra-like search ---
-    std::priority_queue<PathStep, std::vector<PathStep>, std::greater<>> pq;
-    std::unordered_map<std::string, int> visited;
+    NodeIndex startNode = graph.findNode(start);
+    NodeIndex endNode = graph.findNode(end);
+    if (startNode == GraphSnapshot::kInvalidNode || endNode == GraphSnapshot::kInvalidNode) {
+        result.found = false;
+        return result;
+    }
 
-    pq.push({start, 0, {start}});
+    // --- Dijkstra (A* with landmarks) over the snapshot ---
+    // Each node keeps its tentative distance, the edge it was reached by and
+    // its hop count; the path is only materialized once the target is settled.
+    constexpr double kInfinity = std::numeric_limits<double>::infinity();
+    DijkstraSearch& search = threadDijkstraSearch(0);
+    search.prepare(graph.nodeCount());
+    
+    // The indexed heap holds every node at most once, so relaxing an edge
+    // lowers the queued key instead of pushing a dominated duplicate
+    auto& queue = search.queue;
+    
+    // With landmarks the queue is ordered by distance + lower bound to the
+    // target. The bound is consistent, so a settled node is still final; it is
+    // computed once per reached node
+    auto remaining = [&](NodeIndex node) {
+        if (!landmarks) {
+            return 0.0;
+        }
+        if (search.boundStamp[node] != search.epoch) {
+            search.lowerBound[node] = landmarks->lowerBound(node, endNode);
+            search.boundStamp[node] = search.epoch;
+        }
+        return search.lowerBound[node];
+    };
 
-    while (!pq.empty()) {
-        auto current = pq.top(); pq.pop();
+    search.reach(startNode, 0, GraphSnapshot::kInvalidNode, 0, 0);
+    queue.pushOrDecrease(startNode, remaining(startNode));
 
-        if (visited.count(current.node)) continue;
-        visited[current.node] = current.cost;
+    while (!queue.empty()) {
+        NodeIndex current = queue.top();
+        queue.pop();
+        search.settled[current] = search.epoch;
+        ++result.settledNodes;
 
-        if (current.node == end) {
-            result.found = true;
-            for (const auto& node : current.path) {
-                auto node_doc = document{} << "nodeId" << node << finalize;
-                result.nodes.push_back(bsoncxx::document::value(node_doc));
-            }
-            result.depth = current.path.size() - 1;
-            result.cost = current.cost;
-            return result;
+        if (current == endNode) {
+            break;
         }
 
-        if (current.path.size() > static_cast<size_t>(max_depth)) continue;
+        if (search.hops[current] >= max_depth) continue;
 
-        for (const auto& edge : graph[current.node]) {
-            if (!visited.count(edge.to)) {
-                auto newPath = current.path;
-                newPath.push_back(edge.to);
-                pq.push({edge.to, current.cost + edge.weight, newPath});
+        for (auto edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+            NodeIndex next = graph.target(edge);
+            if (search.isSettled(next)) continue;
+
+            double candidate = search.distance[current] + graph.weight(edge);
+            if (candidate < search.distanceOf(next)) {
+                double bound = remaining(next);
+                if (bound == kInfinity) continue;  // The target is unreachable from next
+                
+                search.reach(next, candidate, current, edge, search.hops[current] + 1);
+                queue.pushOrDecrease(next, candidate + bound);
             }
         }
     }
 
-    // No path found
-    result.found = false;
+    if (!search.isSettled(endNode)) {
+        // No path found
+        result.found = false;
+        return result;
+    }
+
+    // Walk the parent pointers back from the target
+    std::vector<EdgeIndex> pathEdges;
+    for (NodeIndex node = endNode; node != startNode; node = search.parent[node]) {
+        pathEdges.push_back(search.parentEdge[node]);
+    }
+    std::reverse(pathEdges.begin(), pathEdges.end());
+
+    fillWeightedPath(graph, startNode, pathEdges, result);
     return result;
 }
 
-/**
- * Bidirectional Search Implementation
- */
-Path mongo::graph_extension::findBidirectionalPathImpl(
-    mongocxx::collection& collection,
-    const bsoncxx::oid& startNodeId,
-    const bsoncxx::oid& endNodeId,
-    const std::string& connectToField,
-    const std::string& connectFromField,
-    int maxDepth) {
+std::vector<Path> findWeightedPathsFromImpl(
+    const GraphSnapshot& graph,
+    const std::string& start,
+    const std::vector<std::string>& ends,
+    int max_depth
+) {
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using EdgeIndex = GraphSnapshot::EdgeIndex;
     
-    Path resultPath;
+    std::vector<Path> results(ends.size());
     
-    // Early exit check - if start and end are the same
-    if (startNodeId == endNodeId) {
-        // Fetch the single node and return
-        using namespace bsoncxx::builder::stream;
-        auto filter = document{} << connectFromField << startNodeId << finalize;
-        auto nodeDoc = collection.find_one(filter.view());
-        if (nodeDoc) {
-            resultPath.nodes.push_back(std::move(nodeDoc.value()));
-            resultPath.depth = 0;
+    NodeIndex startNode = graph.findNode(start);
+    std::vector<NodeIndex> endNodes(ends.size(), GraphSnapshot::kInvalidNode);
+    size_t pending = 0;
+    for (size_t i = 0; i < ends.size(); ++i) {
+        if (ends[i] == start) {
+            results[i].found = true;
+            results[i].nodes.push_back(makeNodeIdDocument(start));
+        } else if (startNode != GraphSnapshot::kInvalidNode) {
+            endNodes[i] = graph.findNode(ends[i]);
+            pending += endNodes[i] != GraphSnapshot::kInvalidNode;
         }
-        return resultPath;
+    }
+    if (pending == 0) {
+        return results;
     }
     
-    // Track visited nodes and their depths
-    // Using unordered_map instead of unordered_set to also track depth and direction
-    // Value: pair of (depth, direction) where direction is 1 for forward, -1 for backward
-    std::unordered_map<bsoncxx::oid, std::pair<int, int>, OidHasher, OidEqual> visited;
+    // Same search as findWeightedPathImpl without landmarks, stopping once
+    // every target is settled instead of the first one
+    DijkstraSearch& search = threadDijkstraSearch(0);
+    search.prepare(graph.nodeCount());
+    auto& queue = search.queue;
     
-    // Track parent nodes to reconstruct the path
-    std::unordered_map<bsoncxx::oid, bsoncxx::oid, OidHasher, OidEqual> forwardParent;
-    std::unordered_map<bsoncxx::oid, bsoncxx::oid, OidHasher, OidEqual> backwardParent;
+    // A target listed twice counts twice
+    auto& unsettledTargets = search.targets;
+    for (NodeIndex endNode : endNodes) {
+        if (endNode != GraphSnapshot::kInvalidNode) {
+            ++unsettledTargets[endNode];
+        }
+    }
     
-    // Track node documents for path reconstruction
-    std::unordered_map<bsoncxx::oid, bsoncxx::document::value, OidHasher, OidEqual> nodeDocuments;
+    search.reach(startNode, 0, GraphSnapshot::kInvalidNode, 0, 0);
+    queue.pushOrDecrease(startNode, 0);
+    int settledNodes = 0;
     
-    // Queues for bidirectional BFS: (nodeId, depth)
-    std::queue<std::pair<bsoncxx::oid, int>> forwardQueue;
-    std::queue<std::pair<bsoncxx::oid, int>> backwardQueue;
+    while (!queue.empty() && pending > 0) {
+        NodeIndex current = queue.top();
+        queue.pop();
+        search.settled[current] = search.epoch;
+        ++settledNodes;
+        
+        pending -= unsettledTargets[current];
+        unsettledTargets[current] = 0;
+        
+        if (search.hops[current] >= max_depth) continue;
+        
+        for (auto edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+            NodeIndex next = graph.target(edge);
+            if (search.isSettled(next)) continue;
+            
+            double candidate = search.distance[current] + graph.weight(edge);
+            if (candidate < search.distanceOf(next)) {
+                search.reach(next, candidate, current, edge, search.hops[current] + 1);
+                queue.pushOrDecrease(next, candidate);
+            }
+        }
+    }
     
-    // Initialize forward search (from start node)
-    forwardQueue.push(std::make_pair(startNodeId, 0));
-    visited[startNodeId] = std::make_pair(0, 1); // depth 0, forward direction
+    for (size_t i = 0; i < ends.size(); ++i) {
+        NodeIndex endNode = endNodes[i];
+        if (endNode == GraphSnapshot::kInvalidNode) {
+            continue;
+        }
+        unsettledTargets[endNode] = 0;  // Targets left unreached, for the next search
+        results[i].settledNodes = settledNodes;
+        if (!search.isSettled(endNode)) {
+            continue;
+        }
+        
+        std::vector<EdgeIndex> pathEdges;
+        for (NodeIndex node = endNode; node != startNode; node = search.parent[node]) {
+            pathEdges.push_back(search.parentEdge[node]);
+        }
+        std::reverse(pathEdges.begin(), pathEdges.end());
+        fillWeightedPath(graph, startNode, pathEdges, results[i]);
+    }
     
-    // Initialize backward search (from end node)
-    backwardQueue.push(std::make_pair(endNodeId, 0));
-    visited[endNodeId] = std::make_pair(0, -1); // depth 0, backward direction
+    return results;
+}
+
+Path findWeightedBidirectionalPathImpl(
+    const GraphSnapshot& graph,
+    const std::string& start,
+    const std::string& end,
+    int max_depth
+) {
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using EdgeIndex = GraphSnapshot::EdgeIndex;
+    constexpr double kInfinity = std::numeric_limits<double>::infinity();
     
-    // Fetch and store the start and end node documents
-    {
-        using namespace bsoncxx::builder::stream;
-        auto filter = document{} << connectFromField << startNodeId << finalize;
-        auto startNodeDoc = collection.find_one(filter.view());
-        if (startNodeDoc) {
-            nodeDocuments.insert(std::make_pair(
-                startNodeId, 
-                std::move(startNodeDoc.value())
-            ));
+    Path result;
+
+    if (start == end) {
+        result.found = true;
+        result.nodes.push_back(makeNodeIdDocument(start));
+        return result;
+    }
+
+    NodeIndex startNode = graph.findNode(start);
+    NodeIndex endNode = graph.findNode(end);
+    if (startNode == GraphSnapshot::kInvalidNode || endNode == GraphSnapshot::kInvalidNode) {
+        result.found = false;
+        return result;
+    }
+
+    // One Dijkstra per direction. For the forward side `parent` is the
+    // previous node towards the start; for the backward side it is the next
+    // node towards the end. parentEdge is always the forward edge between them.
+    DijkstraSearch& forward = threadDijkstraSearch(0);
+    DijkstraSearch& backward = threadDijkstraSearch(1);
+    forward.prepare(graph.nodeCount());
+    backward.prepare(graph.nodeCount());
+
+    forward.reach(startNode, 0, GraphSnapshot::kInvalidNode, 0, 0);
+    forward.queue.pushOrDecrease(startNode, 0);
+    backward.reach(endNode, 0, GraphSnapshot::kInvalidNode, 0, 0);
+    backward.queue.pushOrDecrease(endNode, 0);
+
+    // Best complete path seen so far, through meetingNode
+    double best = kInfinity;
+    NodeIndex meetingNode = GraphSnapshot::kInvalidNode;
+
+    auto considerMeeting = [&](NodeIndex node) {
+        double total = forward.distanceOf(node) + backward.distanceOf(node);
+        if (total < best && forward.hops[node] + backward.hops[node] <= max_depth) {
+            best = total;
+            meetingNode = node;
+        }
+    };
+
+    auto relax = [&](DijkstraSearch& side, NodeIndex from, NodeIndex to, EdgeIndex edge) {
+        if (side.isSettled(to)) return;
+
+        double candidate = side.distance[from] + graph.weight(edge);
+        if (candidate < side.distanceOf(to)) {
+            side.reach(to, candidate, from, edge, side.hops[from] + 1);
+            side.queue.pushOrDecrease(to, candidate);
+            considerMeeting(to);
+        }
+    };
+
+    while (!forward.queue.empty() && !backward.queue.empty()) {
+        // No unsettled node on either side can lead to a cheaper path
+        if (forward.queue.topKey() + backward.queue.topKey() >= best) {
+            break;
+        }
+
+        // Grow the side with the smaller radius so both balls stay balanced
+        bool expandForward = forward.queue.topKey() <= backward.queue.topKey();
+        DijkstraSearch& side = expandForward ? forward : backward;
+
+        NodeIndex current = side.queue.top();
+        side.queue.pop();
+        side.settled[current] = side.epoch;
+        ++result.settledNodes;
+
+        if (side.hops[current] >= max_depth) continue;
+
+        if (expandForward) {
+            for (auto edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+                relax(forward, current, graph.target(edge), edge);
+            }
         } else {
-            // Start node not found
-            return resultPath;
+            for (auto in = graph.inEdgeBegin(current); in < graph.inEdgeEnd(current); ++in) {
+                relax(backward, current, graph.inSource(in), graph.inEdge(in));
+            }
         }
+    }
+
+    if (meetingNode == GraphSnapshot::kInvalidNode) {
+        // No path found
+        result.found = false;
+        return result;
+    }
+
+    // Start -> meeting node from the forward parents, then meeting node -> end
+    // from the backward parents
+    std::vector<EdgeIndex> pathEdges;
+    for (NodeIndex node = meetingNode; node != startNode; node = forward.parent[node]) {
+        pathEdges.push_back(forward.parentEdge[node]);
+    }
+    std::reverse(pathEdges.begin(), pathEdges.end());
+    for (NodeIndex node = meetingNode; node != endNode; node = backward.parent[node]) {
+        pathEdges.push_back(backward.parentEdge[node]);
+    }
+
+    fillWeightedPath(graph, startNode, pathEdges, result);
+    return result;
+}
+
+namespace {
+
+// Per-thread search state for hierarchy queries, sized to the graph once and
+// reset by bumping a stamp, so a query only pays for the nodes it touches
+struct HierarchySearchSide {
+    std::vector<double> distance;
+    std::vector<GraphSnapshot::NodeIndex> parent;
+    std::vector<ContractionHierarchy::ArcIndex> parentArc;
+    std::vector<uint32_t> stamp;
+    IndexedHeap<double> queue;
+    
+    void prepare(size_t nodeCount, uint32_t epoch) {
+        if (stamp.size() != nodeCount || epoch == 1) {
+            distance.assign(nodeCount, 0);
+            parent.assign(nodeCount, GraphSnapshot::kInvalidNode);
+            parentArc.assign(nodeCount, 0);
+            stamp.assign(nodeCount, 0);
+        }
+        queue.reset(nodeCount);
+    }
+    
+    double distanceOf(GraphSnapshot::NodeIndex node, uint32_t epoch) const {
+        return stamp[node] == epoch ? distance[node] : std::numeric_limits<double>::infinity();
+    }
+};
+
+struct HierarchySearch {
+    HierarchySearchSide forward;
+    HierarchySearchSide backward;
+    uint32_t epoch = 0;
+};
+
+} // namespace
+
+Path findContractionHierarchyPathImpl(
+    const GraphSnapshot& graph,
+    const ContractionHierarchy& hierarchy,
+    const std::string& start,
+    const std::string& end
+) {
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using ArcIndex = ContractionHierarchy::ArcIndex;
+    constexpr double kInfinity = std::numeric_limits<double>::infinity();
+    
+    Path result;
+
+    if (start == end) {
+        result.found = true;
+        result.nodes.push_back(makeNodeIdDocument(start));
+        return result;
+    }
+
+    NodeIndex startNode = graph.findNode(start);
+    NodeIndex endNode = graph.findNode(end);
+    if (startNode == GraphSnapshot::kInvalidNode || endNode == GraphSnapshot::kInvalidNode ||
+        hierarchy.nodeCount() != graph.nodeCount()) {
+        result.found = false;
+        return result;
+    }
+
+    thread_local HierarchySearch search;
+    uint32_t epoch = ++search.epoch;
+    if (epoch == 0) {
+        epoch = search.epoch = 1;  // Stamps wrapped around; prepare() clears them
+    }
+    auto& forward = search.forward;
+    auto& backward = search.backward;
+    forward.prepare(graph.nodeCount(), epoch);
+    backward.prepare(graph.nodeCount(), epoch);
+
+    // Best complete path seen so far, through meetingNode
+    double best = kInfinity;
+    NodeIndex meetingNode = GraphSnapshot::kInvalidNode;
+
+    auto reach = [&](HierarchySearchSide& side, HierarchySearchSide& other,
+                     NodeIndex node, double candidate, NodeIndex from, ArcIndex arc) {
+        if (candidate >= side.distanceOf(node, epoch)) return;
+        side.distance[node] = candidate;
+        side.parent[node] = from;
+        side.parentArc[node] = arc;
+        side.stamp[node] = epoch;
+        side.queue.pushOrDecrease(node, candidate);
         
-        filter = document{} << connectFromField << endNodeId << finalize;
-        auto endNodeDoc = collection.find_one(filter.view());
-        if (endNodeDoc) {
-            nodeDocuments.insert(std::make_pair(
-                endNodeId, 
-                std::move(endNodeDoc.value())
-            ));
+        double total = candidate + other.distanceOf(node, epoch);
+        if (total < best) {
+            best = total;
+            meetingNode = node;
+        }
+    };
+
+    reach(forward, backward, startNode, 0, GraphSnapshot::kInvalidNode, 0);
+    reach(backward, forward, endNode, 0, GraphSnapshot::kInvalidNode, 0);
+
+    // Both sides only climb the hierarchy, so neither can stop at the first
+    // meeting; a side is done once its smallest key reaches the best total
+    while (true) {
+        bool forwardOpen = !forward.queue.empty() && forward.queue.topKey() < best;
+        bool backwardOpen = !backward.queue.empty() && backward.queue.topKey() < best;
+        if (!forwardOpen && !backwardOpen) {
+            break;
+        }
+        bool expandForward = forwardOpen &&
+            (!backwardOpen || forward.queue.topKey() <= backward.queue.topKey());
+        HierarchySearchSide& side = expandForward ? forward : backward;
+        HierarchySearchSide& other = expandForward ? backward : forward;
+
+        NodeIndex current = side.queue.top();
+        double distance = side.queue.topKey();
+        side.queue.pop();
+        ++result.settledNodes;
+
+        if (expandForward) {
+            for (ArcIndex arc = hierarchy.upBegin(current); arc < hierarchy.upEnd(current); ++arc) {
+                const auto& up = hierarchy.upArc(arc);
+                reach(side, other, up.node, distance + up.weight, current, arc);
+            }
         } else {
-            // End node not found
-            return resultPath;
+            for (ArcIndex arc = hierarchy.downBegin(current); arc < hierarchy.downEnd(current); ++arc) {
+                const auto& down = hierarchy.downArc(arc);
+                reach(side, other, down.node, distance + down.weight, current, arc);
+            }
         }
     }
+
+    if (meetingNode == GraphSnapshot::kInvalidNode) {
+        // No path found
+        result.found = false;
+        return result;
+    }
+
+    // Hierarchy arcs start -> meeting node (upward) and meeting node -> end
+    // (downward), each unpacked into original edges in path order
+    std::vector<NodeIndex> upChain;
+    for (NodeIndex node = meetingNode; node != startNode; node = forward.parent[node]) {
+        upChain.push_back(node);
+    }
+    std::reverse(upChain.begin(), upChain.end());
+
+    std::vector<std::pair<NodeIndex, double>> edges;
+    for (NodeIndex node : upChain) {
+        hierarchy.unpackUpArc(forward.parent[node], forward.parentArc[node], edges);
+    }
+    for (NodeIndex node = meetingNode; node != endNode; node = backward.parent[node]) {
+        hierarchy.unpackDownArc(backward.parent[node], backward.parentArc[node], edges);
+    }
+
+    result.found = true;
+    result.nodes.push_back(makeNodeIdDocument(graph.nodeId(startNode)));
+    result.totalWeight = 0;
+    for (const auto& edge : edges) {
+        result.nodes.push_back(makeNodeIdDocument(graph.nodeId(edge.first)));
+        result.edgeWeights.push_back(edge.second);
+        result.totalWeight += edge.second;
+    }
+    result.depth = static_cast<int>(edges.size());
+    result.cost = static_cast<int>(result.totalWeight);
+    return result;
+}
+
+namespace {
+
+// Workspace of one spur search of findKShortestPathsImpl, reused by the
+// thread that runs it
+struct SpurSearch {
+    std::vector<double> distance;
+    std::vector<GraphSnapshot::NodeIndex> parent;
+    std::vector<GraphSnapshot::EdgeIndex> parentEdge;
+    std::vector<uint32_t> stamp;   // distance and parents are valid when == epoch
+    std::vector<uint32_t> banned;  // Node is on the root path when == epoch
+    IndexedHeap<double> queue;
+    uint32_t epoch = 0;
     
-    // Variables to track meeting point
-    bool pathFound = false;
-    bsoncxx::oid meetingNode;
-    int totalPathLength = -1;
+    void prepare(size_t nodeCount) {
+        if (++epoch == 0 || stamp.size() != nodeCount) {
+            distance.assign(nodeCount, 0);
+            parent.assign(nodeCount, GraphSnapshot::kInvalidNode);
+            parentEdge.assign(nodeCount, 0);
+            stamp.assign(nodeCount, 0);
+            banned.assign(nodeCount, 0);
+            epoch = 1;
+        }
+        queue.reset(nodeCount);
+    }
+};
+
+// A loopless start -> end path given by its snapshot edges. Ordered by cost,
+// then length, then edges, so equal paths collapse in a std::set.
+struct CandidatePath {
+    double cost;
+    std::vector<GraphSnapshot::EdgeIndex> edges;
+    size_t deviation;  // Position of the spur node in the path it branched from
+    int settledNodes;  // Nodes settled by the search that found it
     
-    // Continue until either both queues are empty or max depth is reached from both directions
-    while (!forwardQueue.empty() || !backwardQueue.empty()) {
-        // Process one level at a time for better balance
-        
-        // Process forward queue (if not empty and within depth limit)
-        if (!forwardQueue.empty()) {
-            auto current = forwardQueue.front();
-            auto currentId = current.first;
-            auto depth = current.second;
-            forwardQueue.pop();
-            
-            // Skip if we've reached maximum depth from forward direction
-            if (depth >= maxDepth / 2) {
-                continue;
+    bool operator<(const CandidatePath& other) const {
+        if (cost != other.cost) return cost < other.cost;
+        if (edges.size() != other.edges.size()) return edges.size() < other.edges.size();
+        return edges < other.edges;
+    }
+};
+
+} // namespace
+
+std::vector<Path> findKShortestPathsImpl(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    const std::string& start,
+    const std::string& end,
+    size_t k
+) {
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using EdgeIndex = GraphSnapshot::EdgeIndex;
+    constexpr double kInfinity = std::numeric_limits<double>::infinity();
+    
+    std::vector<Path> results;
+    if (k == 0) {
+        return results;
+    }
+    
+    if (start == end) {
+        // The empty path is the only loopless one
+        results.emplace_back();
+        results.back().found = true;
+        results.back().nodes.push_back(makeNodeIdDocument(start));
+        return results;
+    }
+    
+    NodeIndex startNode = graph.findNode(start);
+    NodeIndex endNode = graph.findNode(end);
+    if (startNode == GraphSnapshot::kInvalidNode || endNode == GraphSnapshot::kInvalidNode) {
+        return results;
+    }
+    
+    // --- Reverse shortest-path tree, shared by every spur search ---
+    // A reverse Dijkstra from end settles every node up to the start's
+    // distance. Settled nodes know their exact distance to end and their
+    // tree edge towards it; the others are at least `radius` away. Removing
+    // edges and nodes only lengthens paths, so this stays a consistent A*
+    // heuristic in every spur graph.
+    size_t nodeCount = graph.nodeCount();
+    std::vector<double> toEnd(nodeCount, kInfinity);
+    std::vector<EdgeIndex> treeEdge(nodeCount);
+    std::vector<bool> inTree(nodeCount, false);
+    double radius = kInfinity;
+    int treeSettled = 0;
+    {
+        IndexedHeap<double> queue(nodeCount);
+        toEnd[endNode] = 0;
+        queue.pushOrDecrease(endNode, 0);
+        while (!queue.empty()) {
+            if (inTree[startNode] && queue.topKey() > toEnd[startNode]) {
+                radius = queue.topKey();
+                break;
             }
+            NodeIndex current = queue.top();
+            queue.pop();
+            inTree[current] = true;
+            ++treeSettled;
             
-            // Get current node document
-            auto currentDocIt = nodeDocuments.find(currentId);
-            if (currentDocIt == nodeDocuments.end()) {
-                continue; // Skip if document not found
+            for (auto reverseEdge = graph.inEdgeBegin(current);
+                 reverseEdge < graph.inEdgeEnd(current); ++reverseEdge) {
+                NodeIndex previous = graph.inSource(reverseEdge);
+                EdgeIndex edge = graph.inEdge(reverseEdge);
+                double candidate = toEnd[current] + graph.weight(edge);
+                if (!inTree[previous] && candidate < toEnd[previous]) {
+                    toEnd[previous] = candidate;
+                    treeEdge[previous] = edge;
+                    queue.pushOrDecrease(previous, candidate);
+                }
             }
-            
-            bsoncxx::document::view currentDoc = currentDocIt->second.view();
-            
-            // Check for connections
-            if (currentDoc[connectToField] && currentDoc[connectToField].type() == bsoncxx::type::k_array) {
-                // Process all connections
-                for (auto&& connValue : currentDoc[connectToField].get_array().value) {
-                    bsoncxx::oid neighborId;
-                    
-                    // Handle different connection formats
-                    if (connValue.type() == bsoncxx::type::k_oid) {
-                        neighborId = connValue.get_oid().value;
-                    } else if (connValue.type() == bsoncxx::type::k_document && 
-                              connValue.get_document().view()[connectFromField]) {
-                        neighborId = connValue.get_document().view()[connectFromField].get_oid().value;
-                    } else {
-                        continue; // Skip invalid connections
+        }
+    }
+    if (!inTree[startNode]) {
+        // No path found
+        return results;
+    }
+    auto heuristic = [&](NodeIndex node) {
+        return inTree[node] ? toEnd[node] : radius;
+    };
+    
+    auto treePath = [&](NodeIndex from, std::vector<EdgeIndex>& edges) {
+        for (NodeIndex node = from; node != endNode; node = graph.target(treeEdge[node])) {
+            edges.push_back(treeEdge[node]);
+        }
+    };
+    
+    std::vector<CandidatePath> accepted;
+    accepted.push_back({toEnd[startNode], {}, 0, treeSettled});
+    treePath(startNode, accepted.back().edges);
+    
+    // --- Yen's algorithm ---
+    // Each accepted path spurs from every node after the one it deviated at
+    // (Lawler's refinement); the spur searches of one round run in parallel.
+    std::set<CandidatePath> candidates;
+    while (accepted.size() < k) {
+        const CandidatePath& previous = accepted.back();
+        
+        std::vector<NodeIndex> pathNodes{startNode};
+        for (EdgeIndex edge : previous.edges) {
+            pathNodes.push_back(graph.target(edge));
+        }
+        
+        // Edges leaving the spur node that earlier paths with the same root took
+        size_t spurCount = previous.edges.size() - previous.deviation;
+        std::vector<std::vector<EdgeIndex>> bannedEdges(spurCount);
+        for (size_t spur = 0; spur < spurCount; ++spur) {
+            size_t position = previous.deviation + spur;
+            for (const auto& path : accepted) {
+                if (path.edges.size() > position &&
+                    std::equal(previous.edges.begin(), previous.edges.begin() + position,
+                               path.edges.begin())) {
+                    bannedEdges[spur].push_back(path.edges[position]);
+                }
+            }
+        }
+        
+        std::vector<std::optional<CandidatePath>> spurPaths(spurCount);
+        pool.parallelFor(spurCount, 1, [&](size_t begin, size_t finish, size_t) {
+            thread_local SpurSearch search;
+            for (size_t spur = begin; spur < finish; ++spur) {
+                size_t position = previous.deviation + spur;
+                NodeIndex spurNode = pathNodes[position];
+                const auto& banned = bannedEdges[spur];
+                auto isBannedEdge = [&](EdgeIndex edge) {
+                    return std::find(banned.begin(), banned.end(), edge) != banned.end();
+                };
+                
+                search.prepare(nodeCount);
+                uint32_t epoch = search.epoch;
+                double rootCost = 0;
+                for (size_t i = 0; i < position; ++i) {
+                    search.banned[pathNodes[i]] = epoch;
+                    rootCost += graph.weight(previous.edges[i]);
+                }
+                
+                CandidatePath candidate{
+                    rootCost, {previous.edges.begin(), previous.edges.begin() + position},
+                    position, 0};
+                
+                // The tree path from the spur node is optimal if it avoids the root
+                // and the banned edges
+                bool treeUsable = inTree[spurNode] && !isBannedEdge(treeEdge[spurNode]);
+                for (NodeIndex node = spurNode; treeUsable && node != endNode;
+                     node = graph.target(treeEdge[node])) {
+                    treeUsable = search.banned[graph.target(treeEdge[node])] != epoch;
+                }
+                if (treeUsable) {
+                    candidate.cost += toEnd[spurNode];
+                    treePath(spurNode, candidate.edges);
+                    spurPaths[spur] = std::move(candidate);
+                    continue;
+                }
+                
+                // Otherwise A* from the spur node around the root and banned edges
+                search.distance[spurNode] = 0;
+                search.stamp[spurNode] = epoch;
+                search.queue.pushOrDecrease(spurNode, heuristic(spurNode));
+                while (!search.queue.empty()) {
+                    NodeIndex current = search.queue.top();
+                    search.queue.pop();
+                    ++candidate.settledNodes;
+                    if (current == endNode) {
+                        break;
                     }
                     
-                    // Check if this node has been visited
-                    auto visitedIt = visited.find(neighborId);
-                    
-                    if (visitedIt == visited.end()) {
-                        // Not visited - add to forward queue
-                        forwardParent[neighborId] = currentId;
-                        visited[neighborId] = std::make_pair(depth + 1, 1); // Forward direction
-                        
-                        // Fetch neighbor document
-                        using namespace bsoncxx::builder::stream;
-                        auto filter = document{} << connectFromField << neighborId << finalize;
-                        auto neighborDoc = collection.find_one(filter.view());
-                        
-                        if (neighborDoc) {
-                            nodeDocuments.insert(std::make_pair(
-                                neighborId, 
-                                std::move(neighborDoc.value())
-                            ));
-                            forwardQueue.push(std::make_pair(neighborId, depth + 1));
+                    for (auto edge = graph.edgeBegin(current); edge < graph.edgeEnd(current); ++edge) {
+                        NodeIndex next = graph.target(edge);
+                        if (search.banned[next] == epoch ||
+                            (current == spurNode && isBannedEdge(edge))) {
+                            continue;
                         }
-                    } 
-                    else if (visitedIt->second.second == -1) {
-                        // Visited from backward direction - the search fronts have met!
-                        int forwardDepth = depth + 1;
-                        int backwardDepth = visitedIt->second.first;
-                        int pathLength = forwardDepth + backwardDepth;
+                        double bound = heuristic(next);
+                        if (bound == kInfinity) continue;  // end is unreachable from next
                         
-                        // Check if this is the first meeting or a shorter path
-                        if (totalPathLength == -1 || pathLength < totalPathLength) {
-                            meetingNode = neighborId;
-                            totalPathLength = pathLength;
-                            pathFound = true;
-                            
-                            // Record parent for the forward direction
-                            forwardParent[neighborId] = currentId;
+                        double distance = search.distance[current] + graph.weight(edge);
+                        if (search.stamp[next] != epoch || distance < search.distance[next]) {
+                            search.distance[next] = distance;
+                            search.parent[next] = current;
+                            search.parentEdge[next] = edge;
+                            search.stamp[next] = epoch;
+                            search.queue.pushOrDecrease(next, distance + bound);
                         }
                     }
                 }
+                if (search.stamp[endNode] != epoch) {
+                    continue;  // No spur path
+                }
+                
+                std::vector<EdgeIndex> spurEdges;
+                for (NodeIndex node = endNode; node != spurNode; node = search.parent[node]) {
+                    spurEdges.push_back(search.parentEdge[node]);
+                }
+                candidate.cost += search.distance[endNode];
+                candidate.edges.insert(candidate.edges.end(), spurEdges.rbegin(), spurEdges.rend());
+                spurPaths[spur] = std::move(candidate);
             }
-        }
+        });
         
-        // If we found a path, we can optionally continue to look for shorter paths
-        // Or we can break here for the first path found:
-        if (pathFound) {
+        for (auto& spurPath : spurPaths) {
+            if (spurPath) {
+                candidates.insert(std::move(*spurPath));
+            }
+        }
+        if (candidates.empty()) {
             break;
         }
+        accepted.push_back(*candidates.begin());
+        candidates.erase(candidates.begin());
+    }
+    
+    for (const auto& path : accepted) {
+        results.emplace_back();
+        fillWeightedPath(graph, startNode, path.edges, results.back());
+        results.back().settledNodes = path.settledNodes;
+    }
+    return results;
+}
+
+// Fetch the documents of every node whose connections point at one of the
+// given nodes, using `$in` queries of at most `batchSize` ids each. Both
+// direct ObjectId references and embedded connection documents are matched.
+// With a prefetch pipeline every chunk is sent up front and the documents are
+// visited as they arrive, so later chunks travel while earlier ones are linked.
+// Returns the number of queries sent to the server.
+template <typename Visitor>
+static int fetchPredecessorDocuments(
+    mongocxx::collection& collection,
+    const std::vector<NodeIndex>& nodes,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    size_t batchSize,
+    const TraversalState& state,
+    FetchPipeline* prefetch,
+    Visitor&& visit) {
+    
+    using namespace bsoncxx::builder::stream;
+    
+    if (batchSize == 0) {
+        batchSize = kDefaultFetchBatchSize;
+    }
+    
+    // Only the id and connections of a predecessor are needed to link it
+    mongocxx::options::find opts;
+    opts.batch_size(static_cast<int32_t>(batchSize));
+    opts.projection(makeTraversalProjection(connectToField, connectFromField).view());
+    
+    std::string embeddedField = connectToField + "." + connectFromField;
+    
+    int roundTrips = 0;
+    for (size_t offset = 0; offset < nodes.size(); offset += batchSize) {
+        size_t chunkEnd = std::min(nodes.size(), offset + batchSize);
+        
+        array idArray;
+        for (size_t i = offset; i < chunkEnd; ++i) {
+            idArray << state.ids.oid(nodes[i]);
+        }
         
-        // Process backward queue (if not empty and within depth limit)
-        if (!backwardQueue.empty()) {
-            auto current = backwardQueue.front();
-            auto currentId = current.first;
-            auto depth = current.second;
-            backwardQueue.pop();
-            
-            // Skip if we've reached maximum depth from backward direction
-            if (depth >= maxDepth / 2) {
-                continue;
+        auto filter = document{} 
+            << "$or" << open_array
+                << open_document
+                    << connectToField << open_document
+                        << "$in" << bsoncxx::types::b_array{idArray.view()}
+                    << close_document
+                << close_document
+                << open_document
+                    << embeddedField << open_document
+                        << "$in" << bsoncxx::types::b_array{idArray.view()}
+                    << close_document
+                << close_document
+            << close_array
+            << finalize;
+        
+        if (prefetch) {
+            prefetch->submit(std::move(filter), opts);
+            continue;
+        }
+        
+        auto cursor = collection.find(filter.view(), opts);
+        ++roundTrips;
+        
+        for (auto&& doc : cursor) {
+            visit(doc);
+        }
+    }
+    
+    if (prefetch) {
+        std::vector<bsoncxx::document::value> batch;
+        while (prefetch->nextBatch(batch)) {
+            for (const auto& doc : batch) {
+                visit(doc.view());
             }
+        }
+        roundTrips += prefetch->takeRoundTrips();
+    }
+    
+    return roundTrips;
+}
+
+/**
+ * Bidirectional Search Implementation
+ */
+Path findBidirectionalPathImpl(
+    mongocxx::collection& collection,
+    const bsoncxx::oid& startNodeId,
+    const bsoncxx::oid& endNodeId,
+    const std::string& connectToField,
+    const std::string& connectFromField,
+    int maxDepth,
+    size_t fetchBatchSize,
+    FetchPipeline* prefetch) {
+    
+    Path resultPath;
+    
+    if (fetchBatchSize == 0) {
+        fetchBatchSize = kDefaultFetchBatchSize;
+    }
+    
+    // Visited nodes with their depth, direction (1 forward, -1 backward),
+    // parents on both sides and projected documents, indexed by interned id
+    TraversalState state;
+    auto projection = makeTraversalProjection(connectToField, connectFromField);
+    auto fetchOptions = makeFetchOptions(fetchBatchSize, projection.view());
+    
+    NodeIndex startNode = state.visit(startNodeId, kNoNode, 0, 1);
+    
+    // Early exit check - if start and end are the same
+    if (startNodeId == endNodeId) {
+        // Fetch the single node and return
+        resultPath.roundTrips += fetchNodeDocuments(
+            collection, {startNode}, connectFromField, fetchBatchSize, state);
+        if (state.hasDocument(startNode)) {
+            resultPath.nodes.push_back(*state.documents[startNode]);
+            resultPath.depth = 0;
+        }
+        return resultPath;
+    }
+    
+    NodeIndex endNode = state.visit(endNodeId, kNoNode, 0, -1);
+    
+    // Fetch and store the start and end node documents together
+    resultPath.roundTrips += fetchNodeDocuments(
+        collection, {startNode, endNode}, connectFromField, fetchBatchSize, state,
+        projection.view());
+    if (!state.hasDocument(startNode) || !state.hasDocument(endNode)) {
+        // Start or end node not found
+        return resultPath;
+    }
+    
+    // Current level of each side and its depth
+    std::vector<NodeIndex> forwardFrontier{startNode};
+    std::vector<NodeIndex> backwardFrontier{endNode};
+    int forwardDepth = 0;
+    int backwardDepth = 0;
+    
+    // Shortest meeting found so far
+    NodeIndex meetingNode = kNoNode;
+    int totalPathLength = -1;
+    
+    // A level can only produce paths of forwardDepth + backwardDepth + 1 edges
+    while (!forwardFrontier.empty() && !backwardFrontier.empty() &&
+           forwardDepth + backwardDepth < maxDepth) {
+        
+        // Expand the side with the smaller frontier
+        bool expandForward = forwardFrontier.size() <= backwardFrontier.size();
+        std::vector<NodeIndex> nextFrontier;
+        
+        if (expandForward) {
+            resultPath.levels.push_back(
+                {true, forwardDepth, static_cast<int>(forwardFrontier.size())});
             
-            // Get current node document
-            auto currentDocIt = nodeDocuments.find(currentId);
-            if (currentDocIt == nodeDocuments.end()) {
-                continue; // Skip if document not found
+            // Documents of nodes discovered by the previous forward level are
+            // fetched together, right before they are needed (a prefetch
+            // pipeline has already brought them in)
+            std::vector<NodeIndex> missing;
+            for (NodeIndex node : forwardFrontier) {
+                if (!state.hasDocument(node)) {
+                    missing.push_back(node);
+                }
             }
+            resultPath.roundTrips += fetchNodeDocuments(
+                collection, missing, connectFromField, fetchBatchSize, state,
+                projection.view());
             
-            // For backward search, we need to find nodes that have the current node in their connections
-            // This requires a database query
-            using namespace bsoncxx::builder::stream;
-            
-            // Query to find nodes that connect to the current node
-            // Using $elemMatch for array fields, handling both direct OIDs and embedded documents
-            auto forwardMatchFilter = document{} 
-                << connectToField << open_document
-                    << "$elemMatch" << open_document
-                        << "$eq" << currentId
-                    << close_document
-                << close_document
-                << finalize;
+            size_t submitted = 0;  // nextFrontier already sent to the prefetch pipeline
+            for (NodeIndex currentNode : forwardFrontier) {
+                if (!state.hasDocument(currentNode)) {
+                    continue; // Skip if document not found
+                }
                 
-            // Alternative query for embedded documents if the connection is stored that way
-            auto embeddedMatchFilter = document{} 
-                << connectToField << open_document
-                    << "$elemMatch" << open_document
-                        << connectFromField << currentId
-                    << close_document
-                << close_document
-                << finalize;
+                forEachNeighbor(state.documents[currentNode]->view(), connectToField, connectFromField,
+                    [&](const bsoncxx::oid& neighborId) {
+                        NodeIndex neighbor = state.ids.find(neighborId);
+                        
+                        if (neighbor == kNoNode) {
+                            // Not visited - part of the next forward level
+                            nextFrontier.push_back(
+                                state.visit(neighborId, currentNode, forwardDepth + 1, 1));
+                        } else if (state.direction[neighbor] == -1) {
+                            // Visited from backward direction - the search fronts have met
+                            int pathLength = forwardDepth + 1 + state.depth[neighbor];
+                            if (totalPathLength == -1 || pathLength < totalPathLength) {
+                                meetingNode = neighbor;
+                                totalPathLength = pathLength;
+                                state.parent[neighbor] = currentNode;
+                            }
+                        }
+                    });
                 
-            // Combine queries with $or
-            auto filter = document{} 
-                << "$or" << open_array
-                    << forwardMatchFilter.view()
-                    << embeddedMatchFilter.view()
-                << close_array
-                << finalize;
+                // An expanded node only needs its parent pointer from now on
+                state.documents[currentNode].reset();
                 
-            // Find all incoming connections
-            auto cursor = collection.find(filter.view());
+                if (prefetch) {
+                    submitNodeChunks(*prefetch, nextFrontier, submitted, fetchBatchSize, false,
+                                     connectFromField, fetchOptions, state);
+                    receiveReadyDocuments(*prefetch, connectFromField, state);
+                }
+            }
             
-            for (auto&& doc : cursor) {
-                bsoncxx::oid neighborId = doc[connectFromField].get_oid().value;
-                
-                // Check if this node has been visited
-                auto visitedIt = visited.find(neighborId);
+            // The next forward level is fetched now rather than when it is
+            // expanded, so that its documents stream in during this level
+            // and the queue is empty before a backward level uses it
+            if (prefetch) {
+                if (meetingNode != kNoNode || forwardDepth + 1 + backwardDepth >= maxDepth) {
+                    prefetch->cancel();
+                    resultPath.roundTrips += prefetch->takeRoundTrips();
+                } else {
+                    submitNodeChunks(*prefetch, nextFrontier, submitted, fetchBatchSize, true,
+                                     connectFromField, fetchOptions, state);
+                    resultPath.roundTrips +=
+                        receiveNodeDocuments(*prefetch, connectFromField, state);
+                }
+            }
+            
+            forwardFrontier.swap(nextFrontier);
+            ++forwardDepth;
+        } else {
+            resultPath.levels.push_back(
+                {false, backwardDepth, static_cast<int>(backwardFrontier.size())});
+            
+            // Record a predecessor of a current backward level node
+            // (backward nodes are never expanded from their own documents)
+            auto discoverPredecessor = [&](const bsoncxx::oid& neighborId, NodeIndex child) {
+                NodeIndex neighbor = state.ids.find(neighborId);
                 
-                if (visitedIt == visited.end()) {
-                    // Not visited - add to backward queue
-                    backwardParent[neighborId] = currentId;
-                    visited[neighborId] = std::make_pair(depth + 1, -1); // Backward direction
-                    nodeDocuments.insert(std::make_pair(neighborId, doc));
-                    backwardQueue.push(std::make_pair(neighborId, depth + 1));
-                } 
-                else if (visitedIt->second.second == 1) {
-                    // Visited from forward direction - the search fronts have met!
-                    int forwardDepth = visitedIt->second.first;
-                    int backwardDepth = depth + 1;
-                    int pathLength = forwardDepth + backwardDepth;
-                    
-                    // Check if this is the first meeting or a shorter path
+                if (neighbor == kNoNode) {
+                    // Not visited - part of the next backward level
+                    nextFrontier.push_back(
+                        state.visit(neighborId, child, backwardDepth + 1, -1));
+                } else if (state.direction[neighbor] == 1) {
+                    // Visited from forward direction - the search fronts have met
+                    int pathLength = state.depth[neighbor] + backwardDepth + 1;
                     if (totalPathLength == -1 || pathLength < totalPathLength) {
-                        meetingNode = neighborId;
+                        meetingNode = neighbor;
                         totalPathLength = pathLength;
-                        pathFound = true;
-                        
-                        // Record parent for the backward direction
-                        backwardParent[neighborId] = currentId;
+                        state.backwardParent[neighbor] = child;
                     }
                 }
-            }
+            };
+            
+            // We need the nodes that have a frontier node in their connections.
+            // The whole level is matched with batched queries.
+            auto inCurrentLevel = [&](NodeIndex node) {
+                return node != kNoNode && state.direction[node] == -1 &&
+                       state.depth[node] == backwardDepth;
+            };
+            
+            resultPath.roundTrips += fetchPredecessorDocuments(
+                collection, backwardFrontier, connectToField, connectFromField,
+                fetchBatchSize, state, prefetch,
+                [&](const bsoncxx::document::view& doc) {
+                    auto idElement = doc[connectFromField];
+                    if (!idElement || idElement.type() != bsoncxx::type::k_oid) {
+                        return;
+                    }
+                    
+                    // Which frontier node does this predecessor lead to?
+                    NodeIndex child = kNoNode;
+                    forEachNeighbor(doc, connectToField, connectFromField,
+                        [&](const bsoncxx::oid& connectedId) {
+                            NodeIndex connected = state.ids.find(connectedId);
+                            if (child == kNoNode && inCurrentLevel(connected)) {
+                                child = connected;
+                            }
+                        });
+                    if (child != kNoNode) {
+                        discoverPredecessor(idElement.get_oid().value, child);
+                    }
+                });
+            
+            backwardFrontier.swap(nextFrontier);
+            ++backwardDepth;
         }
         
-        // If we found a path, we can optionally continue to look for shorter paths
-        // Or we can break here for the first path found:
-        if (pathFound) {
+        // Meetings are only resolved once the whole level has been expanded,
+        // so the best one found is a shortest path
+        if (meetingNode != kNoNode) {
             break;
         }
     }
     
     // If path found, reconstruct it from both ends
-    if (pathFound) {
+    if (meetingNode != kNoNode) {
         resultPath.depth = totalPathLength;
         
         // Reconstruct forward path (from start to meeting point)
-        std::vector<bsoncxx::oid> forwardPath;
-        bsoncxx::oid current = meetingNode;
-        
-        while (current != startNodeId) {
-            forwardPath.push_back(current);
-            auto parentIt = forwardParent.find(current);
-            if (parentIt == forwardParent.end()) {
-                break; // Something went wrong
-            }
-            current = parentIt->second;
+        std::vector<NodeIndex> completePath;
+        for (NodeIndex current = meetingNode; current != kNoNode; current = state.parent[current]) {
+            completePath.push_back(current);
         }
-        forwardPath.push_back(startNodeId);
-        std::reverse(forwardPath.begin(), forwardPath.end());
+        std::reverse(completePath.begin(), completePath.end());
         
-        // Reconstruct backward path (from meeting point to end)
-        std::vector<bsoncxx::oid> backwardPath;
-        current = meetingNode;
-        
-        while (current != endNodeId) {
-            auto parentIt = backwardParent.find(current);
-            if (parentIt == backwardParent.end()) {
-                break; // Something went wrong
-            }
-            current = parentIt->second;
-            backwardPath.push_back(current);
+        // Append backward path (from meeting point to end; the meeting node appears only once)
+        for (NodeIndex current = state.backwardParent[meetingNode]; current != kNoNode;
+             current = state.backwardParent[current]) {
+            completePath.push_back(current);
         }
         
-        // Combine paths (note: meeting node appears only once)
-        std::vector<bsoncxx::oid> completePath = forwardPath;
-        completePath.insert(completePath.end(), backwardPath.begin(), backwardPath.end());
-        
-        // Add node documents to result path
-        for (const auto& nodeId : completePath) {
-            auto docIt = nodeDocuments.find(nodeId);
-            if (docIt != nodeDocuments.end()) {
-                resultPath.nodes.push_back(docIt->second);
-            }
-        }
+        // Fetch the full documents of the path nodes only
+        resultPath.roundTrips += hydratePath(
+            collection, completePath, connectFromField, state, resultPath);
+    }
+    
+    return resultPath;
+}
+
+Path findSnapshotPathImpl(
+    mongocxx::collection& collection,
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    const bsoncxx::oid& startNodeId,
+    const bsoncxx::oid& endNodeId,
+    const std::string& connectFromField,
+    int maxDepth,
+    bool bidirectional) {
+    
+    Path resultPath;
+    
+    GraphSnapshot::NodeIndex start = graph.findNode(startNodeId);
+    GraphSnapshot::NodeIndex end = graph.findNode(endNodeId);
+    if (start == GraphSnapshot::kInvalidNode || end == GraphSnapshot::kInvalidNode) {
+        return resultPath;
+    }
+    
+    auto snapshotPath = bidirectional
+        ? parallelBidirectionalBfsPath(graph, pool, start, end, maxDepth, resultPath.levels)
+        : parallelBfsPath(graph, pool, start, end, maxDepth, resultPath.levels);
+    if (snapshotPath.empty()) {
+        return resultPath;
+    }
+    
+    // Fetch the full documents of the path nodes only
+    std::vector<bsoncxx::oid> nodeIds;
+    for (GraphSnapshot::NodeIndex node : snapshotPath) {
+        nodeIds.push_back(graph.nodeOid(node));
+    }
+    Path hydrated = hydrateNodePath(collection, nodeIds, connectFromField);
+    resultPath.nodes = std::move(hydrated.nodes);
+    resultPath.depth = hydrated.depth;
+    resultPath.roundTrips += hydrated.roundTrips;
+    
+    return resultPath;
+}
+
+Path hydrateNodePath(
+    mongocxx::collection& collection,
+    const std::vector<bsoncxx::oid>& nodeIds,
+    const std::string& connectFromField) {
+    
+    Path resultPath;
+    
+    TraversalState state;
+    std::vector<NodeIndex> path;
+    for (const auto& nodeId : nodeIds) {
+        path.push_back(state.visit(nodeId, kNoNode, 0, 1));
+    }
+    resultPath.roundTrips += hydratePath(
+        collection, path, connectFromField, state, resultPath);
+    
+    if (!path.empty() && resultPath.nodes.size() == path.size()) {
+        resultPath.depth = static_cast<int>(path.size()) - 1;
+    } else {
+        // A referenced id without a document, e.g. a dangling target
+        resultPath.nodes.clear();
     }
     
     return resultPath;
 }
 
 } // namespace graph_extension
-} // namespace mongo
\ No newline at end of file
+} // namespace mongo
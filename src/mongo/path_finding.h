@@ -3,12 +3,35 @@
 #include <mongocxx/collection.hpp>
 #include <bsoncxx/oid.hpp>
 #include <bsoncxx/document/value.hpp>
+#include "contraction_hierarchy.h"
+#include "graph_snapshot.h"
+#include "landmark_table.h"
 #include <string>
 #include <vector>
 
 namespace mongo {
 namespace graph_extension {
 
+class FetchPipeline;
+class ThreadPool;
+
+/**
+ * Default number of node ids sent in a single `$in` query when a traversal
+ * fetches a whole BFS level at once
+ */
+constexpr size_t kDefaultFetchBatchSize = 1000;
+
+/**
+ * Size of one BFS level expanded by a search, reported so batching and
+ * direction choices can be tuned
+ */
+struct LevelStats {
+    bool forward;      // Expanded from the start (true) or from the end (false)
+    int depth;         // Depth of the expanded level on its own side
+    int frontierSize;  // Nodes in the expanded level
+    bool bottomUp = false;  // Expanded by scanning unvisited nodes (in-memory BFS only)
+};
+
 /**
  * Represents a path through the graph
  */
@@ -19,15 +42,27 @@ struct Path {
     int depth;
     bool found;      // <--- Add this line
     int cost; 
+    int roundTrips;  // Queries sent to the server while searching
+    int settledNodes;  // Nodes settled by a weighted search
+    std::vector<LevelStats> levels;  // Levels expanded by a BFS, in order
+    bool fromCache = false;  // Rebuilt from a cached result instead of searched
     
-    Path() : depth(0), totalWeight(0), found(false), cost(0) {}
+    Path() : depth(0), totalWeight(0), found(false), cost(0), roundTrips(0), settledNodes(0) {}
     
     // Convert path to BSON document
     bsoncxx::document::value toBSON() const;
 };
 
 /**
- * Find a path between nodes in a MongoDB collection
+ * Find a path between nodes in a MongoDB collection.
+ * Each BFS level is fetched with `$in` queries of at most fetchBatchSize ids,
+ * projected to the id and connection fields; full documents are fetched for
+ * the path nodes only, with one `$in` query once the path is known.
+ *
+ * With a prefetch pipeline the next level is fetched on the pipeline's own
+ * connection: a chunk is sent as soon as fetchBatchSize new ids have been
+ * discovered, so its documents are on their way while the rest of the
+ * current level is still being expanded.
  */
 Path findBasicPath(
     mongocxx::collection& collection,
@@ -35,20 +70,89 @@ Path findBasicPath(
     const bsoncxx::oid& endNodeId,
     const std::string& connectToField,
     const std::string& connectFromField,
-    int maxDepth);
+    int maxDepth,
+    size_t fetchBatchSize = kDefaultFetchBatchSize,
+    FetchPipeline* prefetch = nullptr);
 
+/**
+ * Find the cheapest path between two node ids of a loaded edge snapshot
+ * using Dijkstra's algorithm with an indexed heap and parent pointers.
+ * Paths longer than max_depth edges are not considered.
+ *
+ * With a landmark table built for `graph` the search becomes A* with the ALT
+ * lower bound: same cost, far fewer settled nodes.
+ */
 Path findWeightedPathImpl(
-    mongocxx::collection& collection,
+    const GraphSnapshot& graph,
+    const std::string& start,
+    const std::string& end,
+    int max_depth,
+    const LandmarkTable* landmarks = nullptr);
+
+/**
+ * Find the cheapest paths from one start to several ends with a single
+ * Dijkstra search that runs until every end is settled. Each result is the
+ * one findWeightedPathImpl returns for that pair; settledNodes reports the
+ * shared search.
+ */
+std::vector<Path> findWeightedPathsFromImpl(
+    const GraphSnapshot& graph,
+    const std::string& start,
+    const std::vector<std::string>& ends,
+    int max_depth);
+
+/**
+ * Find the cheapest path with a forward Dijkstra from start and a reverse
+ * Dijkstra from end, stopping once top_f + top_b >= best. Returns the same
+ * cost as findWeightedPathImpl while settling far fewer nodes.
+ */
+Path findWeightedBidirectionalPathImpl(
+    const GraphSnapshot& graph,
     const std::string& start,
     const std::string& end,
-    const std::string& connect_field,
-    const std::string& id_field,
-    const std::string& weight_field,
     int max_depth);
 
+/**
+ * Find the cheapest path with an upward bidirectional search over a
+ * contraction hierarchy built for `graph`, unpacking shortcuts into the
+ * original edges. Exact, and settles a few hundred nodes even on road
+ * networks with millions; there is no hop limit.
+ */
+Path findContractionHierarchyPathImpl(
+    const GraphSnapshot& graph,
+    const ContractionHierarchy& hierarchy,
+    const std::string& start,
+    const std::string& end);
+
+/**
+ * Find up to k cheapest loopless paths from start to end, cheapest first,
+ * with Yen's algorithm. One reverse Dijkstra from end is shared by all spur
+ * searches: a spur node whose tree path avoids the root path takes it
+ * directly, the others run A* with the tree distances as lower bounds. The
+ * spur searches of each round run in parallel on `pool`. Each path reports
+ * the nodes settled by the search that found it.
+ */
+std::vector<Path> findKShortestPathsImpl(
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    const std::string& start,
+    const std::string& end,
+    size_t k);
+
 /**
  * Find a path between nodes using bidirectional search to improve performance
  * on large graphs. Searches simultaneously from start node and end node.
+ *
+ * The search is level-synchronous: each round expands a whole level on the
+ * side with the smaller frontier, fetching it with batched `$in` queries, and
+ * meetings are only resolved once the level is complete, so the returned
+ * path is a shortest one. Paths of up to maxDepth edges are found. As in
+ * findBasicPath, traversal reads projected documents and only the path
+ * nodes are fetched in full.
+ *
+ * A prefetch pipeline overlaps the queries with the expansion as in
+ * findBasicPath; backward levels send all their `$or` chunks at once and
+ * link predecessors as the documents arrive.
  */
 Path findBidirectionalPathImpl(
     mongocxx::collection& collection,
@@ -56,7 +160,36 @@ Path findBidirectionalPathImpl(
     const bsoncxx::oid& endNodeId,
     const std::string& connectToField,
     const std::string& connectFromField,
-    int maxDepth);
+    int maxDepth,
+    size_t fetchBatchSize = kDefaultFetchBatchSize,
+    FetchPipeline* prefetch = nullptr);
+
+/**
+ * Rebuild a path known by its node ids, e.g. from a cached result: one `$in`
+ * query on connectFromField fetches the documents. Returns an empty path if
+ * any of them no longer exists.
+ */
+Path hydrateNodePath(
+    mongocxx::collection& collection,
+    const std::vector<bsoncxx::oid>& nodeIds,
+    const std::string& connectFromField);
+
+/**
+ * Find a shortest path with the parallel, direction-optimizing BFS of
+ * parallel_bfs.h over a GraphSnapshot::loadAdjacency snapshot of the
+ * collection, searching from the start only (like findBasicPath) or from
+ * both ends (like findBidirectionalPathImpl). The only server round trip is
+ * the `$in` query that fetches the path documents.
+ */
+Path findSnapshotPathImpl(
+    mongocxx::collection& collection,
+    const GraphSnapshot& graph,
+    ThreadPool& pool,
+    const bsoncxx::oid& startNodeId,
+    const bsoncxx::oid& endNodeId,
+    const std::string& connectFromField,
+    int maxDepth,
+    bool bidirectional);
 
 } // namespace graph_extension
 } // namespace mongo
\ No newline at end of file
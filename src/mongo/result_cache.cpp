@@ -0,0 +1,323 @@
+#include "result_cache.h"
+#include "graph_connections.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <bsoncxx/builder/stream/document.hpp>
+
+namespace mongo {
+namespace graph_extension {
+
+std::string cacheNodeId(const bsoncxx::document::element& element) {
+    if (!element) {
+        return {};
+    }
+    if (element.type() == bsoncxx::type::k_oid) {
+        return element.get_oid().value.to_string();
+    }
+    if (element.type() == bsoncxx::type::k_string) {
+        return std::string(element.get_string().value);
+    }
+    return {};
+}
+
+bool changedNodeIds(
+    const bsoncxx::document::view& event,
+    const std::vector<std::string>& nodeFields,
+    const std::string& weightField,
+    std::vector<std::string>& nodeIds) {
+
+    auto operationType = event["operationType"];
+    if (!operationType || operationType.type() != bsoncxx::type::k_string) {
+        return false;
+    }
+    std::string_view operation = operationType.get_string().value;
+    bool isUpdate = operation == "update";
+    if (operation != "delete" && !isUpdate) {
+        // An inserted or replaced edge can shorten a path that avoids its
+        // nodes; other events of an ordinary stream drop, rename or invalidate it
+        return false;
+    }
+
+    auto collect = [&](const char* name) {
+        auto element = event[name];
+        if (!element || element.type() != bsoncxx::type::k_document) {
+            return false;
+        }
+        auto doc = element.get_document().value;
+        for (const auto& field : nodeFields) {
+            std::string nodeId = cacheNodeId(doc[field]);
+            if (!nodeId.empty()) {
+                nodeIds.push_back(std::move(nodeId));
+            }
+        }
+        return true;
+    };
+    collect("documentKey");
+    collect("fullDocument");
+    auto preImage = event["fullDocumentBeforeChange"];
+    bool hasPreImage = collect("fullDocumentBeforeChange");
+
+    // A delete only breaks or lengthens paths through its nodes, and so does
+    // an update that leaves the edge in place and does not lower its weight
+    if (isUpdate) {
+        auto description = event["updateDescription"];
+        if (!description || description.type() != bsoncxx::type::k_document) {
+            return false;
+        }
+        auto updatedFields = description.get_document().value["updatedFields"];
+        auto removedFields = description.get_document().value["removedFields"];
+
+        // Top-level name of a possibly dotted path
+        auto rootOf = [](std::string_view path) { return path.substr(0, path.find('.')); };
+        auto isNodeField = [&](std::string_view root) {
+            return std::find(nodeFields.begin(), nodeFields.end(), root) != nodeFields.end();
+        };
+
+        bool touchesWeight = false;
+        bsoncxx::document::element newWeight;
+        if (updatedFields && updatedFields.type() == bsoncxx::type::k_document) {
+            for (const auto& field : updatedFields.get_document().value) {
+                std::string_view root = rootOf(field.key());
+                if (isNodeField(root)) {
+                    return false;  // The edge moved
+                }
+                if (root == weightField) {
+                    if (field.key() != weightField) {
+                        return false;  // Part of the weight changed: cannot compare
+                    }
+                    touchesWeight = true;
+                    newWeight = field;
+                }
+            }
+        }
+        if (removedFields && removedFields.type() == bsoncxx::type::k_array) {
+            for (const auto& removed : removedFields.get_array().value) {
+                if (removed.type() != bsoncxx::type::k_string) {
+                    continue;
+                }
+                std::string_view root = rootOf(removed.get_string().value);
+                if (isNodeField(root)) {
+                    return false;
+                }
+                if (root == weightField) {
+                    touchesWeight = true;  // Counts as weight 1 from now on
+                }
+            }
+        }
+        // Telling a raise from a cut needs the weight before the change
+        if (touchesWeight &&
+            (!hasPreImage ||
+             readEdgeWeight(newWeight) <
+                 readEdgeWeight(preImage.get_document().value[weightField]))) {
+            return false;
+        }
+    }
+    return !nodeIds.empty();
+}
+
+CachedPath CachedPath::fromPath(const Path& path, const std::string& idField) {
+    CachedPath cached;
+    cached.found = !path.nodes.empty();
+    cached.depth = path.depth;
+    cached.edgeWeights = path.edgeWeights;
+    cached.totalWeight = path.totalWeight;
+    cached.nodeIds.reserve(path.nodes.size());
+    for (const auto& node : path.nodes) {
+        cached.nodeIds.push_back(cacheNodeId(node.view()[idField]));
+    }
+    return cached;
+}
+
+Path CachedPath::toWeightedPath() const {
+    using namespace bsoncxx::builder::stream;
+
+    Path path;
+    if (!found) {
+        return path;
+    }
+    path.found = true;
+    for (const auto& nodeId : nodeIds) {
+        path.nodes.push_back(document{} << "nodeId" << nodeId << finalize);
+    }
+    path.edgeWeights = edgeWeights;
+    path.totalWeight = totalWeight;
+    path.depth = depth;
+    path.cost = static_cast<int>(totalWeight);
+    return path;
+}
+
+std::vector<bsoncxx::oid> CachedPath::nodeOids() const {
+    std::vector<bsoncxx::oid> oids;
+    oids.reserve(nodeIds.size());
+    for (const auto& nodeId : nodeIds) {
+        oids.emplace_back(nodeId);
+    }
+    return oids;
+}
+
+PathResultCache::PathResultCache(size_t capacity) : _capacity(capacity) {}
+
+void PathResultCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = capacity;
+    while (_entries.size() > _capacity) {
+        erase(std::prev(_entries.end()));
+        ++_stats.evictions;
+    }
+}
+
+std::string PathResultCache::makeKey(
+    std::string_view algorithm,
+    std::string_view start,
+    std::string_view end,
+    int maxDepth,
+    std::string_view fields) {
+    // NUL cannot occur in field names, so the parts stay unambiguous
+    std::string key;
+    key.reserve(algorithm.size() + start.size() + end.size() + fields.size() + 16);
+    key.append(algorithm).push_back('\0');
+    key.append(fields).push_back('\0');
+    key.append(std::to_string(maxDepth)).push_back('\0');
+    key.append(start).push_back('\0');
+    key.append(end);
+    return key;
+}
+
+bool PathResultCache::lookup(
+    const std::string& ns,
+    const std::string& key,
+    CachedPath& path,
+    uint64_t& version) {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    version = _namespaces[ns].version;
+    if (_capacity == 0) {
+        return false;
+    }
+    auto it = _lookup.find(entryKey(ns, key));
+    if (it == _lookup.end()) {
+        ++_stats.misses;
+        return false;
+    }
+    _entries.splice(_entries.begin(), _entries, it->second);
+    path = it->second->path;
+    ++_stats.hits;
+    return true;
+}
+
+void PathResultCache::insert(
+    const std::string& ns,
+    const std::string& key,
+    CachedPath path,
+    uint64_t version) {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    NamespaceIndex& index = _namespaces[ns];
+    if (_capacity == 0 || index.version != version) {
+        return;  // Disabled, or the graph changed while the search ran
+    }
+
+    std::string fullKey = entryKey(ns, key);
+    auto existing = _lookup.find(fullKey);
+    if (existing != _lookup.end()) {
+        erase(existing->second);  // Another thread cached the same query first
+    }
+    while (_entries.size() >= _capacity) {
+        erase(std::prev(_entries.end()));
+        ++_stats.evictions;
+    }
+
+    _entries.push_front(Entry{ns, key, std::move(path)});
+    const Entry* entry = &_entries.front();
+    _lookup.emplace(std::move(fullKey), _entries.begin());
+    if (entry->path.found) {
+        for (const auto& nodeId : entry->path.nodeIds) {
+            index.byNode[nodeId].insert(entry);
+        }
+    } else {
+        index.notFound.insert(entry);
+    }
+}
+
+size_t PathResultCache::invalidateNodes(
+    const std::string& ns,
+    const std::vector<std::string>& nodeIds) {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    NamespaceIndex& index = _namespaces[ns];
+    ++index.version;
+
+    std::unordered_set<const Entry*> stale(index.notFound.begin(), index.notFound.end());
+    for (const auto& nodeId : nodeIds) {
+        auto it = index.byNode.find(nodeId);
+        if (it != index.byNode.end()) {
+            stale.insert(it->second.begin(), it->second.end());
+        }
+    }
+    for (const Entry* entry : stale) {
+        erase(_lookup.at(entryKey(entry->ns, entry->key)));
+    }
+    _stats.invalidations += stale.size();
+    return stale.size();
+}
+
+size_t PathResultCache::invalidateNamespace(const std::string& ns) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_namespaces[ns].version;
+
+    size_t dropped = 0;
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        auto next = std::next(it);
+        if (it->ns == ns) {
+            erase(it);
+            ++dropped;
+        }
+        it = next;
+    }
+    _stats.invalidations += dropped;
+    return dropped;
+}
+
+void PathResultCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _lookup.clear();
+    // Versions survive so in-flight searches still see the clear
+    for (auto& [ns, index] : _namespaces) {
+        ++index.version;
+        index.byNode.clear();
+        index.notFound.clear();
+    }
+}
+
+ResultCacheStats PathResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ResultCacheStats stats = _stats;
+    stats.entries = _entries.size();
+    stats.capacity = _capacity;
+    return stats;
+}
+
+void PathResultCache::erase(EntryList::iterator it) {
+    NamespaceIndex& index = _namespaces[it->ns];
+    const Entry* entry = &*it;
+    if (entry->path.found) {
+        for (const auto& nodeId : entry->path.nodeIds) {
+            auto nodeIt = index.byNode.find(nodeId);
+            if (nodeIt != index.byNode.end()) {
+                nodeIt->second.erase(entry);
+                if (nodeIt->second.empty()) {
+                    index.byNode.erase(nodeIt);
+                }
+            }
+        }
+    } else {
+        index.notFound.erase(entry);
+    }
+    _lookup.erase(entryKey(it->ns, it->key));
+    _entries.erase(it);
+}
+
+} // namespace graph_extension
+} // namespace mongo
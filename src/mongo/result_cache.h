@@ -0,0 +1,173 @@
+#pragma once
+
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "path_finding.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * A path query result reduced to what is needed to rebuild it: node ids and
+ * edge weights, without the node documents. ObjectIds are kept in hex, the
+ * form GraphSnapshot::nodeId gives them in weighted results.
+ */
+struct CachedPath {
+    bool found = false;
+    int depth = 0;
+    std::vector<std::string> nodeIds;
+    std::vector<double> edgeWeights;
+    double totalWeight = 0;
+
+    /**
+     * Keep the ids `path` holds in idField of each node document (the
+     * "nodeId" of a weighted path, connectFromField of a BFS path)
+     */
+    static CachedPath fromPath(const Path& path, const std::string& idField);
+
+    // {nodeId: ...} nodes, as returned by the weighted searches
+    Path toWeightedPath() const;
+
+    std::vector<bsoncxx::oid> nodeOids() const;
+};
+
+/**
+ * Key form of a node id value found in a document: an ObjectId in hex, or
+ * the string itself. Empty for any other type.
+ */
+std::string cacheNodeId(const bsoncxx::document::element& element);
+
+/**
+ * Collect the ids of the nodes a change stream event touches, read from
+ * nodeFields of its documentKey and of the document before and after the
+ * change: {"from", "to"} for an edge collection, the id and connection array
+ * fields for a node collection. Returns true only for writes that can break
+ * or lengthen paths through those nodes but shorten no other path: deletes,
+ * and updates that leave nodeFields alone and do not lower weightField.
+ * Returns false for everything else, in which case every result of the
+ * collection is suspect. That covers inserts and replaces, since a new edge
+ * can shorten a path that avoids its nodes, weight updates without a
+ * pre-image, deletes that cannot be narrowed down, and drops.
+ */
+bool changedNodeIds(
+    const bsoncxx::document::view& event,
+    const std::vector<std::string>& nodeFields,
+    const std::string& weightField,
+    std::vector<std::string>& nodeIds);
+
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;  // Entries dropped because the graph changed
+    uint64_t evictions = 0;      // Entries dropped to stay within capacity
+    size_t entries = 0;
+    size_t capacity = 0;
+};
+
+/**
+ * LRU cache of path query results, bounded by entry count and shared by all
+ * threads of a GraphExtension.
+ *
+ * Entries are indexed by namespace and by the nodes of their path, so a
+ * write can drop exactly the results it may have broken. Each namespace also
+ * has a version, bumped by every invalidation, which lets a search that
+ * started before a write discard its result instead of caching it.
+ */
+class PathResultCache {
+public:
+    explicit PathResultCache(size_t capacity = 0);
+
+    /**
+     * Maximum number of entries; 0 disables the cache and empties it
+     */
+    void setCapacity(size_t capacity);
+
+    /**
+     * Key of one query within its namespace. `fields` names the fields the
+     * graph is read from, including the weight field.
+     */
+    static std::string makeKey(
+        std::string_view algorithm,
+        std::string_view start,
+        std::string_view end,
+        int maxDepth,
+        std::string_view fields);
+
+    /**
+     * Copy a cached result into `path` and count a hit, or count a miss.
+     * `version` receives the namespace version to pass to insert().
+     */
+    bool lookup(
+        const std::string& ns,
+        const std::string& key,
+        CachedPath& path,
+        uint64_t& version);
+
+    /**
+     * Remember a result computed after a lookup() that returned `version`;
+     * ignored if the namespace has been invalidated since
+     */
+    void insert(
+        const std::string& ns,
+        const std::string& key,
+        CachedPath path,
+        uint64_t version);
+
+    /**
+     * Drop the results whose path contains one of `nodeIds` (cacheNodeId
+     * form), and every cached "no path" result of the namespace. Only for
+     * writes that cannot shorten another path (see changedNodeIds); anything
+     * else needs invalidateNamespace. Returns the number of entries dropped.
+     */
+    size_t invalidateNodes(const std::string& ns, const std::vector<std::string>& nodeIds);
+
+    /**
+     * Drop every result of a namespace
+     */
+    size_t invalidateNamespace(const std::string& ns);
+
+    void clear();
+
+    ResultCacheStats stats() const;
+
+private:
+    struct Entry {
+        std::string ns;
+        std::string key;
+        CachedPath path;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Results of one namespace, by the nodes they pass through
+    struct NamespaceIndex {
+        uint64_t version = 0;
+        std::unordered_map<std::string, std::unordered_set<const Entry*>> byNode;
+        std::unordered_set<const Entry*> notFound;
+    };
+
+    static std::string entryKey(const std::string& ns, const std::string& key) {
+        return ns + '\0' + key;
+    }
+
+    // Unlink an entry from the LRU list, the lookup map and its index
+    void erase(EntryList::iterator it);
+
+    mutable std::mutex _mutex;
+    size_t _capacity;
+    EntryList _entries;  // Most recently used first
+    std::unordered_map<std::string, EntryList::iterator> _lookup;
+    std::unordered_map<std::string, NamespaceIndex> _namespaces;
+    ResultCacheStats _stats;
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,316 @@
+#include "snapshot_maintainer.h"
+#include "graph_connections.h"
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/options/find.hpp>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+// Key of an edge document's _id, tagged with its type; empty for id types
+// whose edges cannot be followed through the stream
+std::string edgeKey(const bsoncxx::document::element& element) {
+    if (!element) {
+        return {};
+    }
+    switch (element.type()) {
+        case bsoncxx::type::k_oid: {
+            auto oid = element.get_oid().value;
+            return "o" + std::string(oid.bytes(), oid.size());
+        }
+        case bsoncxx::type::k_string:
+            return "s" + std::string(element.get_string().value);
+        case bsoncxx::type::k_int32:
+            return "i" + std::to_string(element.get_int32().value);
+        case bsoncxx::type::k_int64:
+            return "i" + std::to_string(element.get_int64().value);
+        default:
+            return {};
+    }
+}
+
+bsoncxx::document::element documentField(
+    const bsoncxx::document::view& event,
+    const char* name) {
+    auto element = event[name];
+    if (element && element.type() == bsoncxx::type::k_document) {
+        return element;
+    }
+    return {};
+}
+
+} // namespace
+
+SnapshotMaintainer::SnapshotMaintainer(
+    Layout layout,
+    std::string firstField,
+    std::string secondField,
+    std::string weightField)
+    : _layout(layout),
+      _firstField(std::move(firstField)),
+      _secondField(std::move(secondField)),
+      _weightField(std::move(weightField)) {}
+
+void SnapshotMaintainer::clear() {
+    _idType.reset();
+    _nodeIds.clear();
+    _outEdges.clear();
+    _edgeIds.clear();
+    _recordSources.clear();
+    _edgeCount = 0;
+    _pendingChanges = 0;
+}
+
+void SnapshotMaintainer::load(mongocxx::collection& collection) {
+    clear();
+
+    mongocxx::options::find opts;
+    if (_layout == Layout::kEdges) {
+        // _id identifies the edge when the stream reports a change to it
+        opts.projection(document{}
+            << "_id" << 1
+            << _firstField << 1
+            << _secondField << 1
+            << _weightField << 1
+            << finalize);
+        for (auto&& doc : collection.find({}, opts)) {
+            putEdge(edgeKey(doc["_id"]), doc);
+        }
+    } else {
+        opts.projection(document{}
+            << _secondField << 1
+            << _firstField << 1
+            << finalize);
+        for (auto&& doc : collection.find({}, opts)) {
+            putNode(doc);
+        }
+    }
+    _pendingChanges = 0;
+}
+
+bool SnapshotMaintainer::applyEvent(const bsoncxx::document::view& event) {
+    auto operationType = event["operationType"];
+    if (!operationType || operationType.type() != bsoncxx::type::k_string) {
+        return true;
+    }
+    std::string_view operation = operationType.get_string().value;
+    if (operation == "drop" || operation == "rename" || operation == "dropDatabase" ||
+        operation == "invalidate") {
+        return false;
+    }
+    bool isDelete = operation == "delete";
+    if (operation != "insert" && operation != "update" && operation != "replace" && !isDelete) {
+        return true;  // Index builds and other events without data changes
+    }
+    if (operation == "update" && !touchesGraphFields(event)) {
+        return true;
+    }
+
+    auto documentKey = documentField(event, "documentKey");
+    // updateLookup finds nothing if the document was deleted meanwhile; its
+    // delete event follows
+    auto fullDocument = documentField(event, "fullDocument");
+
+    if (_layout == Layout::kEdges) {
+        if (!documentKey) {
+            return true;
+        }
+        std::string key = edgeKey(documentKey.get_document().value["_id"]);
+        if (key.empty()) {
+            return true;
+        }
+        if (isDelete || !fullDocument) {
+            removeEdge(key);
+        } else {
+            putEdge(key, fullDocument.get_document().value);
+        }
+    } else {
+        if (!isDelete && fullDocument) {
+            putNode(fullDocument.get_document().value);
+        } else if (documentKey) {
+            clearNode(documentKey.get_document().value[_secondField]);
+        }
+    }
+    ++_pendingChanges;
+    return true;
+}
+
+bool SnapshotMaintainer::touchesGraphFields(const bsoncxx::document::view& event) const {
+    auto description = documentField(event, "updateDescription");
+    if (!description) {
+        return true;
+    }
+    auto updatedFields = description.get_document().value["updatedFields"];
+    auto removedFields = description.get_document().value["removedFields"];
+
+    // Top-level name of a possibly dotted path
+    auto touches = [&](std::string_view path) {
+        std::string_view root = path.substr(0, path.find('.'));
+        return root == _firstField || root == _secondField || root == _weightField;
+    };
+    if (updatedFields && updatedFields.type() == bsoncxx::type::k_document) {
+        for (auto&& field : updatedFields.get_document().value) {
+            if (touches(field.key())) {
+                return true;
+            }
+        }
+    }
+    if (removedFields && removedFields.type() == bsoncxx::type::k_array) {
+        for (auto&& field : removedFields.get_array().value) {
+            if (field.type() == bsoncxx::type::k_string && touches(field.get_string().value)) {
+                return true;
+            }
+        }
+    }
+    // A truncated array may be a connection array
+    auto truncatedArrays = description.get_document().value["truncatedArrays"];
+    return truncatedArrays && truncatedArrays.type() == bsoncxx::type::k_array &&
+           !truncatedArrays.get_array().value.empty();
+}
+
+SnapshotMaintainer::NodeIndex SnapshotMaintainer::internNode(
+    const bsoncxx::document::element& element) {
+    if (!element || !isNodeIdType(element.type())) {
+        return GraphSnapshot::kInvalidNode;
+    }
+    if (!_idType) {
+        _idType = element.type();
+    }
+    if (element.type() != *_idType) {
+        return GraphSnapshot::kInvalidNode;  // Mixed id types cannot share one dictionary
+    }
+
+    NodeIndex node = element.type() == bsoncxx::type::k_oid
+        ? _nodeIds.intern(element.get_oid().value)
+        : _nodeIds.intern(element.get_string().value);
+    if (node == _outEdges.size()) {
+        _outEdges.emplace_back();
+    }
+    return node;
+}
+
+void SnapshotMaintainer::putEdge(const std::string& key, const bsoncxx::document::view& doc) {
+    uint32_t record = kNoRecord;
+    if (!key.empty()) {
+        removeEdge(key);
+        record = _edgeIds.intern(key);
+        if (record == _recordSources.size()) {
+            _recordSources.push_back(GraphSnapshot::kInvalidNode);
+        }
+    }
+
+    // Same rules as GraphSnapshot::load
+    double weight = readEdgeWeight(doc[_weightField]);
+    if (!isUsableEdgeWeight(weight)) {
+        return;
+    }
+    auto fromElement = doc[_firstField];
+    auto toElement = doc[_secondField];
+    if (!fromElement || !toElement || fromElement.type() != toElement.type()) {
+        return;
+    }
+    NodeIndex source = internNode(fromElement);
+    if (source == GraphSnapshot::kInvalidNode) {
+        return;
+    }
+    NodeIndex target = internNode(toElement);
+
+    _outEdges[source].push_back({target, record, weight});
+    if (record != kNoRecord) {
+        _recordSources[record] = source;
+    }
+    ++_edgeCount;
+}
+
+void SnapshotMaintainer::removeEdge(const std::string& key) {
+    uint32_t record = _edgeIds.find(key);
+    if (record == IdInterner::kNotFound || _recordSources[record] == GraphSnapshot::kInvalidNode) {
+        return;  // Never seen, or already deleted
+    }
+    auto& edges = _outEdges[_recordSources[record]];
+    auto it = std::find_if(edges.begin(), edges.end(),
+                           [&](const OutEdge& edge) { return edge.record == record; });
+    if (it != edges.end()) {
+        *it = edges.back();
+        edges.pop_back();
+        --_edgeCount;
+    }
+    _recordSources[record] = GraphSnapshot::kInvalidNode;
+}
+
+void SnapshotMaintainer::putNode(const bsoncxx::document::view& doc) {
+    auto idElement = doc[_secondField];
+    if (!idElement || idElement.type() != bsoncxx::type::k_oid) {
+        return;  // Traversals only follow ObjectId references
+    }
+    NodeIndex source = internNode(idElement);
+    if (source == GraphSnapshot::kInvalidNode) {
+        return;
+    }
+
+    // Gather first: interning a neighbor may grow _outEdges
+    std::vector<OutEdge> edges;
+    forEachConnection(doc, _firstField, _secondField,
+        [&](const bsoncxx::oid& neighbor, const bsoncxx::document::view& embedded) {
+            double weight = embedded.empty() ? 1.0 : readEdgeWeight(embedded[_weightField]);
+            if (!isUsableEdgeWeight(weight)) {
+                return;
+            }
+            edges.push_back({_nodeIds.intern(neighbor), kNoRecord, weight});
+            if (edges.back().target == _outEdges.size()) {
+                _outEdges.emplace_back();
+            }
+        });
+
+    _edgeCount += edges.size();
+    _edgeCount -= _outEdges[source].size();
+    _outEdges[source] = std::move(edges);
+}
+
+void SnapshotMaintainer::clearNode(const bsoncxx::document::element& idElement) {
+    if (!idElement || idElement.type() != bsoncxx::type::k_oid) {
+        return;
+    }
+    NodeIndex node = _nodeIds.find(idElement.get_oid().value);
+    if (node == IdInterner::kNotFound) {
+        return;
+    }
+    // The node stays: other documents may still reference it
+    _edgeCount -= _outEdges[node].size();
+    _outEdges[node].clear();
+}
+
+std::shared_ptr<const GraphSnapshot> SnapshotMaintainer::compact() {
+    std::vector<GraphSnapshot::EdgeIndex> offsets;
+    std::vector<NodeIndex> targets;
+    std::vector<double> weights;
+    offsets.reserve(_outEdges.size() + 1);
+    targets.reserve(_edgeCount);
+    weights.reserve(_edgeCount);
+
+    offsets.push_back(0);
+    for (const auto& edges : _outEdges) {
+        for (const OutEdge& edge : edges) {
+            targets.push_back(edge.target);
+            weights.push_back(edge.weight);
+        }
+        offsets.push_back(static_cast<GraphSnapshot::EdgeIndex>(targets.size()));
+    }
+
+    _pendingChanges = 0;
+    auto idType = _idType == bsoncxx::type::k_oid || _layout == Layout::kAdjacency
+        ? GraphSnapshot::IdType::kObjectId
+        : GraphSnapshot::IdType::kString;
+    return GraphSnapshot::fromCsr(
+        _nodeIds, idType, std::move(offsets), std::move(targets), std::move(weights));
+}
+
+} // namespace graph_extension
+} // namespace mongo
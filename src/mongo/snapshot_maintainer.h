@@ -0,0 +1,128 @@
+#pragma once
+
+#include <mongocxx/collection.hpp>
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "graph_snapshot.h"
+#include "id_interner.h"
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Default pause between two snapshots published by a maintained collection
+ */
+constexpr std::chrono::milliseconds kDefaultCompactInterval{1000};
+
+/**
+ * Adjacency of one collection kept current from its change stream and
+ * published as immutable GraphSnapshots.
+ *
+ * The out-edges of every node live in an append buffer of their own, so a
+ * write only touches the lists of the nodes it concerns. Writes to an edge
+ * collection are matched to edges by document _id, which makes replaying
+ * events that the initial scan already saw harmless; writes to a node
+ * collection replace the node's whole out-list. compact() folds the lists
+ * into a fresh CSR in O(nodes + edges) without going back to the server.
+ * Nodes are never removed from the dictionary, so node indices stay the same
+ * from one snapshot to the next.
+ *
+ * Not thread-safe: a single maintainer thread loads, applies and compacts,
+ * while queries read the snapshots it has published.
+ */
+class SnapshotMaintainer {
+public:
+    enum class Layout {
+        kEdges,     // {from, to, weight} documents, as GraphSnapshot::load reads
+        kAdjacency  // Node documents with connection arrays, as loadAdjacency reads
+    };
+
+    /**
+     * For kEdges the fields are (fromField, toField, weightField); for
+     * kAdjacency (connectToField, connectFromField, weightField).
+     */
+    SnapshotMaintainer(
+        Layout layout,
+        std::string firstField,
+        std::string secondField,
+        std::string weightField);
+
+    /**
+     * Replace the state with one scan of the collection
+     */
+    void load(mongocxx::collection& collection);
+
+    /**
+     * Apply one event of a change stream opened with fullDocument:
+     * updateLookup. Returns false if the event leaves the state unknown (a
+     * drop or rename), in which case the collection must be loaded again.
+     */
+    bool applyEvent(const bsoncxx::document::view& event);
+
+    /**
+     * Writes applied since the last compaction
+     */
+    size_t pendingChanges() const { return _pendingChanges; }
+
+    size_t edgeCount() const { return _edgeCount; }
+
+    /**
+     * Publish the current adjacency as a new snapshot
+     */
+    std::shared_ptr<const GraphSnapshot> compact();
+
+private:
+    using NodeIndex = GraphSnapshot::NodeIndex;
+
+    static constexpr uint32_t kNoRecord = UINT32_MAX;
+
+    struct OutEdge {
+        NodeIndex target;
+        uint32_t record;  // Edge document it came from; kNoRecord for kAdjacency
+        double weight;
+    };
+
+    void clear();
+
+    // Dense index of a node id, interning it if it is new; kInvalidNode if
+    // the id does not match the collection's id type
+    NodeIndex internNode(const bsoncxx::document::element& element);
+
+    // Edge collection: (re)place or remove the edge of one document
+    void putEdge(const std::string& edgeKey, const bsoncxx::document::view& doc);
+    void removeEdge(const std::string& edgeKey);
+
+    // Node collection: replace the out-list of one node document
+    void putNode(const bsoncxx::document::view& doc);
+    void clearNode(const bsoncxx::document::element& idElement);
+
+    // Whether an update event changed any field the graph is read from
+    bool touchesGraphFields(const bsoncxx::document::view& event) const;
+
+    Layout _layout;
+    std::string _firstField;
+    std::string _secondField;
+    std::string _weightField;
+
+    std::optional<bsoncxx::type> _idType;  // Set by the first node id seen
+    IdInterner _nodeIds;
+    std::vector<std::vector<OutEdge>> _outEdges;  // One append buffer per node
+
+    // kEdges: edge document _id -> record, and the source node of each live
+    // record (kInvalidNode once deleted)
+    IdInterner _edgeIds;
+    std::vector<NodeIndex> _recordSources;
+
+    size_t _edgeCount = 0;
+    size_t _pendingChanges = 0;
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+
+namespace mongo {
+namespace graph_extension {
+
+namespace {
+
+// Set on pool workers and on a caller while it runs a region, so nested
+// regions run inline instead of deadlocking
+thread_local bool tInParallelRegion = false;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t worker = 1; worker < threadCount; ++worker) {
+        _workers.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(const std::function<void(size_t)>& task) {
+    std::unique_lock<std::mutex> region(_regionMutex, std::defer_lock);
+    if (_workers.empty() || tInParallelRegion || !region.try_lock()) {
+        // Every worker index still runs, one after another on this thread
+        for (size_t worker = 0; worker < threadCount(); ++worker) {
+            task(worker);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _running = _workers.size();
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    tInParallelRegion = true;
+    task(0);
+    tInParallelRegion = false;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _finished.wait(lock, [&] { return _running == 0; });
+    _task = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+    tInParallelRegion = true;
+    uint64_t seen = 0;
+    while (true) {
+        const std::function<void(size_t)>* task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _stopping || _generation != seen; });
+            if (_stopping) {
+                return;
+            }
+            seen = _generation;
+            task = _task;
+        }
+
+        (*task)(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_running == 0) {
+                _finished.notify_one();
+            }
+        }
+    }
+}
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mongo {
+namespace graph_extension {
+
+/**
+ * Fixed set of worker threads for data-parallel loops over in-memory graphs.
+ *
+ * The calling thread takes part in every parallel region as worker 0, so a
+ * pool of N threads starts N - 1 workers. Only one region runs at a time; a
+ * region started from inside another one, or while the pool is busy with a
+ * different caller, runs inline on the calling thread instead of waiting.
+ */
+class ThreadPool {
+public:
+    /**
+     * threadCount == 0 uses one thread per hardware core
+     */
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t threadCount() const { return _workers.size() + 1; }
+
+    /**
+     * Run body(begin, end, worker) over [0, count) in chunks of `grain` items.
+     * Each thread starts on its own contiguous share of the chunks and steals
+     * chunks from the other shares once it runs out. `worker` is below
+     * threadCount(), so callers can keep per-worker buffers without locking.
+     */
+    template <typename Body>
+    void parallelFor(size_t count, size_t grain, Body&& body) {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+        size_t threads = threadCount();
+        if (chunks == 1 || threads == 1) {
+            body(size_t{0}, count, size_t{0});
+            return;
+        }
+
+        // One share of chunks per thread; a share's cursor is shared with thieves
+        struct alignas(64) Share {
+            std::atomic<size_t> next{0};
+            size_t end = 0;
+        };
+        std::vector<Share> shares(threads);
+        for (size_t t = 0; t < threads; ++t) {
+            shares[t].next.store(chunks * t / threads, std::memory_order_relaxed);
+            shares[t].end = chunks * (t + 1) / threads;
+        }
+
+        run([&](size_t worker) {
+            for (size_t i = 0; i < threads; ++i) {
+                Share& share = shares[(worker + i) % threads];
+                size_t chunk;
+                while ((chunk = share.next.fetch_add(1, std::memory_order_relaxed)) < share.end) {
+                    body(chunk * grain, std::min(count, (chunk + 1) * grain), worker);
+                }
+            }
+        });
+    }
+
+private:
+    // Run task(worker) once for every worker index, in parallel if possible
+    void run(const std::function<void(size_t)>& task);
+    void workerLoop(size_t worker);
+
+    std::vector<std::thread> _workers;
+
+    std::mutex _regionMutex;  // Held by the caller of the running region
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _finished;
+    const std::function<void(size_t)>* _task = nullptr;
+    uint64_t _generation = 0;
+    size_t _running = 0;
+    bool _stopping = false;
+};
+
+} // namespace graph_extension
+} // namespace mongo
@@ -0,0 +1,435 @@
+// graph_load.cpp
+//
+// Loads a SNAP edge list (e.g. data/wiki-Vote.txt or roadNet-CA.txt) into an
+// edge collection, the native counterpart of data/load_snap_to_mongo.py and
+// api/load_roadnet_to_mongo.py. Edges become {from: "N<id>", to: "N<id>",
+// weight} documents as those scripts write them.
+//
+// The file is memory-mapped and cut into chunks at line boundaries; worker
+// threads parse chunks with a plain integer parser and stream unordered
+// insert_many batches, each on a connection of its own, so nothing larger
+// than one batch per thread is ever held. With --snapshot the parsed edges
+// are also written as a GraphSnapshot file that GraphExtension::mapSnapshot
+// opens without scanning the collection.
+//
+// Usage: graph_load <snap-file> [options]
+//   --uri <uri>              default mongodb://localhost:27017
+//   --db <name>              default graph
+//   --collection <name>      default edges
+//   --prefix <text>          node id prefix, default N
+//   --weight <int>           weight of every edge, default 1
+//   --random-weights <a> <b> uniform integer weights in [a, b], the same for
+//                            every load of the same file
+//   --threads <n>            default: number of cores
+//   --batch <n>              documents per insert_many, default 10000
+//   --snapshot <path>        also write the binary snapshot file
+//   --drop                   drop the collection first
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/options/insert.hpp>
+#include "mongo/graph_snapshot.h"
+#include "mongo/id_interner.h"
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+using mongo::graph_extension::GraphSnapshot;
+using mongo::graph_extension::IdInterner;
+
+namespace {
+
+struct Options {
+    std::string path;
+    std::string uri = "mongodb://localhost:27017";
+    std::string dbName = "graph";
+    std::string collectionName = "edges";
+    std::string prefix = "N";
+    int weight = 1;
+    bool randomWeights = false;
+    int minWeight = 1;
+    int maxWeight = 10;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t batchSize = 10000;
+    std::string snapshotPath;
+    bool drop = false;
+};
+
+// Edges of one chunk, kept in file order for the snapshot
+struct ChunkEdges {
+    std::vector<uint64_t> from;
+    std::vector<uint64_t> to;
+    std::vector<int> weight;
+};
+
+bool parseArguments(int argc, char* argv[], Options& options) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    auto number = [&](size_t& i, auto& value) {
+        if (i + 1 >= args.size()) {
+            return false;
+        }
+        const std::string& text = args[++i];
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    };
+    auto text = [&](size_t& i, std::string& value) {
+        if (i + 1 >= args.size()) {
+            return false;
+        }
+        value = args[++i];
+        return true;
+    };
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool ok = true;
+        if (arg == "--uri") {
+            ok = text(i, options.uri);
+        } else if (arg == "--db") {
+            ok = text(i, options.dbName);
+        } else if (arg == "--collection") {
+            ok = text(i, options.collectionName);
+        } else if (arg == "--prefix") {
+            ok = text(i, options.prefix);
+        } else if (arg == "--weight") {
+            ok = number(i, options.weight) && options.weight >= 0;
+        } else if (arg == "--random-weights") {
+            options.randomWeights = true;
+            ok = number(i, options.minWeight) && number(i, options.maxWeight) &&
+                 options.minWeight >= 0 && options.minWeight <= options.maxWeight;
+        } else if (arg == "--threads") {
+            ok = number(i, options.threads) && options.threads > 0;
+        } else if (arg == "--batch") {
+            ok = number(i, options.batchSize) && options.batchSize > 0;
+        } else if (arg == "--snapshot") {
+            ok = text(i, options.snapshotPath);
+        } else if (arg == "--drop") {
+            options.drop = true;
+        } else if (options.path.empty() && arg.rfind("--", 0) != 0) {
+            options.path = arg;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "❌ Bad argument " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.path.empty()) {
+        std::cerr << "Usage: graph_load <snap-file> [--uri <uri>] [--db <name>] "
+                     "[--collection <name>] [--prefix <text>] [--weight <int> | "
+                     "--random-weights <min> <max>] [--threads <n>] [--batch <n>] "
+                     "[--snapshot <path>] [--drop]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the next unsigned integer of a line, skipping blanks before it;
+// false at the end of the line or on anything else
+bool parseId(const char*& cursor, const char* end, uint64_t& value) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t')) {
+        ++cursor;
+    }
+    if (cursor == end || *cursor < '0' || *cursor > '9') {
+        return false;
+    }
+    value = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        value = value * 10 + static_cast<uint64_t>(*cursor - '0');
+        ++cursor;
+    }
+    return true;
+}
+
+// Same rules as load_snap_to_mongo.py: comments and lines without exactly
+// two ids are skipped
+bool parseEdge(const char* line, const char* end, uint64_t& from, uint64_t& to) {
+    if (line < end && *line == '#') {
+        return false;
+    }
+    if (!parseId(line, end, from) || !parseId(line, end, to)) {
+        return false;
+    }
+    while (line < end && (*line == ' ' || *line == '\t' || *line == '\r')) {
+        ++line;
+    }
+    return line == end;
+}
+
+void appendNodeId(std::string& buffer, const std::string& prefix, uint64_t id) {
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), id);
+    buffer.assign(prefix);
+    buffer.append(digits, result.ptr);
+}
+
+// Weight of the edge on the line starting at byte `offset` of the file: a
+// splitmix64 hash of the offset, so reloads agree whatever the thread count
+// (and so chunking) or the standard library
+int randomWeightAt(uint64_t offset, int minWeight, int maxWeight) {
+    uint64_t value = offset + 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    uint64_t range = static_cast<uint64_t>(maxWeight - minWeight) + 1;
+    return minWeight + static_cast<int>(value % range);
+}
+
+// Build the snapshot from the parsed edges the way GraphSnapshot::load would
+// have read them back from the collection
+bool writeSnapshot(
+    const std::vector<ChunkEdges>& chunks,
+    size_t edgeCount,
+    const std::string& prefix,
+    const std::string& path) {
+
+    using NodeIndex = GraphSnapshot::NodeIndex;
+    using EdgeIndex = GraphSnapshot::EdgeIndex;
+
+    IdInterner nodeIds;
+    nodeIds.reserve(edgeCount / 4 + 16);
+    std::vector<NodeIndex> sources;
+    std::vector<NodeIndex> targets;
+    sources.reserve(edgeCount);
+    targets.reserve(edgeCount);
+
+    std::string id;
+    for (const ChunkEdges& chunk : chunks) {
+        for (size_t i = 0; i < chunk.from.size(); ++i) {
+            appendNodeId(id, prefix, chunk.from[i]);
+            sources.push_back(nodeIds.intern(id));
+            appendNodeId(id, prefix, chunk.to[i]);
+            targets.push_back(nodeIds.intern(id));
+        }
+    }
+
+    // Counting sort by source into CSR order
+    std::vector<EdgeIndex> offsets(nodeIds.size() + 1, 0);
+    for (NodeIndex source : sources) {
+        ++offsets[source + 1];
+    }
+    for (size_t i = 0; i < nodeIds.size(); ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<EdgeIndex> cursor(offsets.begin(), offsets.end() - 1);
+    std::vector<NodeIndex> sortedTargets(targets.size());
+    std::vector<double> weights(targets.size());
+    size_t edge = 0;
+    for (const ChunkEdges& chunk : chunks) {
+        for (int weight : chunk.weight) {
+            EdgeIndex slot = cursor[sources[edge]]++;
+            sortedTargets[slot] = targets[edge];
+            weights[slot] = weight;
+            ++edge;
+        }
+    }
+
+    auto snapshot = GraphSnapshot::fromCsr(
+        std::move(nodeIds), GraphSnapshot::IdType::kString,
+        std::move(offsets), std::move(sortedTargets), std::move(weights));
+    return snapshot->save(path);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        return 1;
+    }
+
+    // --- Map the edge list ---
+    int fd = ::open(options.path.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || ::fstat(fd, &status) != 0) {
+        std::cerr << "❌ Cannot open " << options.path << std::endl;
+        return 1;
+    }
+    size_t fileBytes = static_cast<size_t>(status.st_size);
+    const char* text = nullptr;
+    if (fileBytes > 0) {
+        void* mapped = ::mmap(nullptr, fileBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "❌ Cannot map " << options.path << std::endl;
+            ::close(fd);
+            return 1;
+        }
+        ::madvise(mapped, fileBytes, MADV_SEQUENTIAL);
+        text = static_cast<const char*>(mapped);
+    }
+    ::close(fd);
+
+    // Chunk boundaries at line starts; several chunks per thread balance
+    // lines of uneven length
+    size_t chunkCount = std::max<size_t>(1, std::min(options.threads * 4, fileBytes / 4096 + 1));
+    std::vector<size_t> bounds(chunkCount + 1, fileBytes);
+    bounds[0] = 0;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        size_t position = std::max(bounds[i - 1], fileBytes / chunkCount * i);
+        while (position < fileBytes && position > 0 && text[position - 1] != '\n') {
+            ++position;
+        }
+        bounds[i] = position;
+    }
+
+    mongocxx::instance instance{};
+    mongocxx::pool pool{mongocxx::uri{options.uri}};
+
+    if (options.drop) {
+        try {
+            auto client = pool.acquire();
+            (*client)[options.dbName][options.collectionName].drop();
+        } catch (const std::exception& e) {
+            std::cerr << "❌ Cannot drop " << options.collectionName << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<ChunkEdges> chunks(options.snapshotPath.empty() ? 0 : chunkCount);
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> inserted{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    std::string error;
+
+    auto worker = [&]() {
+        try {
+            auto client = pool.acquire();
+            auto collection = (*client)[options.dbName][options.collectionName];
+            mongocxx::options::insert insertOptions;
+            insertOptions.ordered(false);
+
+            std::vector<bsoncxx::document::value> batch;
+            batch.reserve(options.batchSize);
+            std::string fromId;
+            std::string toId;
+            auto flush = [&]() {
+                if (batch.empty()) {
+                    return;
+                }
+                collection.insert_many(batch, insertOptions);
+                inserted += batch.size();
+                batch.clear();
+            };
+
+            for (size_t index = nextChunk++; index < chunkCount && !failed; index = nextChunk++) {
+                ChunkEdges* edges = chunks.empty() ? nullptr : &chunks[index];
+
+                const char* line = text + bounds[index];
+                const char* chunkEnd = text + bounds[index + 1];
+                while (line < chunkEnd) {
+                    const char* lineEnd = std::find(line, chunkEnd, '\n');
+                    uint64_t from = 0;
+                    uint64_t to = 0;
+                    if (parseEdge(line, lineEnd, from, to)) {
+                        int weight = options.randomWeights
+                            ? randomWeightAt(static_cast<uint64_t>(line - text),
+                                             options.minWeight, options.maxWeight)
+                            : options.weight;
+                        appendNodeId(fromId, options.prefix, from);
+                        appendNodeId(toId, options.prefix, to);
+                        batch.push_back(document{}
+                            << "from" << fromId
+                            << "to" << toId
+                            << "weight" << weight
+                            << finalize);
+                        if (edges) {
+                            edges->from.push_back(from);
+                            edges->to.push_back(to);
+                            edges->weight.push_back(weight);
+                        }
+                        if (batch.size() == options.batchSize) {
+                            flush();
+                        }
+                    }
+                    line = lineEnd + 1;
+                }
+            }
+            flush();
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!failed.exchange(true)) {
+                error = e.what();
+            }
+        }
+    };
+
+    // --- Parse and insert, reporting the rate once a second ---
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedSeconds = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::mutex reportMutex;
+    std::condition_variable reportWake;
+    bool done = false;
+    std::thread reporter([&]() {
+        std::unique_lock<std::mutex> lock(reportMutex);
+        while (!reportWake.wait_for(lock, std::chrono::seconds(1), [&] { return done; })) {
+            double seconds = elapsedSeconds();
+            std::cout << "\r" << inserted.load() << " edges, "
+                      << static_cast<size_t>(inserted.load() / seconds) << " edges/sec" << std::flush;
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        done = true;
+    }
+    reportWake.notify_one();
+    reporter.join();
+
+    if (text) {
+        ::munmap(const_cast<char*>(text), fileBytes);
+    }
+    if (failed) {
+        std::cerr << "\n❌ Insert failed after " << inserted.load() << " edges: " << error << std::endl;
+        return 1;
+    }
+
+    double seconds = elapsedSeconds();
+    std::cout << "\r✅ Inserted " << inserted.load() << " edges in " << seconds << " s ("
+              << static_cast<size_t>(inserted.load() / std::max(seconds, 1e-9))
+              << " edges/sec) on " << options.threads << " connections" << std::endl;
+
+    // --- Snapshot file ---
+    if (!options.snapshotPath.empty()) {
+        auto snapshotStart = std::chrono::steady_clock::now();
+        if (!writeSnapshot(chunks, inserted.load(), options.prefix, options.snapshotPath)) {
+            std::cerr << "❌ Cannot write snapshot " << options.snapshotPath << std::endl;
+            return 1;
+        }
+        double snapshotSeconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - snapshotStart).count();
+        std::cout << "✅ Wrote snapshot " << options.snapshotPath << " in "
+                  << snapshotSeconds << " s" << std::endl;
+    }
+
+    return 0;
+}